@@ -4,7 +4,9 @@
  */
 #include "csapp.h"
 #include "cache.h"
-#include <stdbool.h>
+#include "slab.h"
+#include "dedup.h"
+#include "purge.h"
 
 //#define DEBUG // uncomment this line to enable debugging
 
@@ -26,139 +28,423 @@
 int lru = 1;
 /* cache helper function definitions */
 
-/* 
- * creates a cache at the begining of the connection and returns a pointer to 
+/* FNV-1a hash of the key, used to pick the shard */
+unsigned long hash_key(char *key)
+{
+    unsigned long hash = 14695981039346656037UL;
+
+    while(*key)
+    {
+        hash ^= (unsigned char)*key++;
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+/*
+ * creates a cache at the begining of the connection and returns a pointer to
  * the cache. When the connection stops(proxy exit); we will call free cache
  * function to free the cache
+ * capacity is split evenly between the nshards shards.
  */
-cacheq_t *create_cache(void)
+cache_t *create_cache(size_t capacity, size_t max_object, int nshards)
 {
-    cacheq_t *cache = malloc(sizeof(cacheq_t));
+    cache_t *cache;
+    int i;
+
+    if(nshards < 1)
+        nshards = 1;
+
+    cache = malloc(sizeof(cache_t));
     if(cache == NULL)
     {
         unix_error("malloc error\n");
-        return false; 
+        return NULL;
+    }
+    cache->shards = calloc(nshards, sizeof(cacheq_t));
+    if(cache->shards == NULL)
+    {
+        free(cache);
+        unix_error("malloc error\n");
+        return NULL;
+    }
+
+    cache->nshards = nshards;
+    cache->max_cache_size = capacity;
+    cache->max_object_size = max_object;
+    cache->demote = NULL;
+    cache->deadline = NULL;
+    cache->swept = cache->swept_bytes = 0;
+    Sem_init(&cache->trim, 0, 0);
+
+    for(i = 0; i < nshards; i++)
+    {
+        cache->shards[i].head = NULL;
+        cache->shards[i].tail = NULL;
+        cache->shards[i].cache_size = 0;
+        cache->shards[i].saved = 0;
+        cache->shards[i].max_size = capacity / nshards;
+        cache->shards[i].owner = cache;
+        cache->shards[i].readcnt = 0;
+        Sem_init(&cache->shards[i].mutex, 0, 1);
+        Sem_init(&cache->shards[i].w, 0, 1);
+        wheel_init(&cache->shards[i].wheel, time(NULL));
     }
-    cache->head = NULL;
-    cache->tail = NULL;
-    cache->cache_size = 0;
     return cache;
 }
 
+/*
+ * cache_shard() returns the shard responsible for key
+ */
+cacheq_t *cache_shard(cache_t *cache, char *key)
+{
+    return &cache->shards[hash_key(key) % cache->nshards];
+}
+
+/*
+ * readers-writer lock of a shard; readers may search and serve,
+ * the writer may add, evict and remove lines.
+ * Reader preferred, the first reader in takes the writer lock and the
+ * last reader out releases it.
+ */
+void cache_rlock(cacheq_t *shard)
+{
+    P(&shard->mutex);
+    shard->readcnt++;
+    if(shard->readcnt == 1)
+        P(&shard->w);
+    V(&shard->mutex);
+}
+
+void cache_runlock(cacheq_t *shard)
+{
+    P(&shard->mutex);
+    shard->readcnt--;
+    if(shard->readcnt == 0)
+        V(&shard->w);
+    V(&shard->mutex);
+}
+
+void cache_wlock(cacheq_t *shard)
+{
+    P(&shard->w);
+}
+
+void cache_wunlock(cacheq_t *shard)
+{
+    V(&shard->w);
+}
+
+/*
+ * cache_set_limits() changes the capacity and the max object size of a
+ * running cache. Growing takes effect immediately; when shrinking, the
+ * shards over their new budget are trimmed by the trimmer thread in
+ * batches of TRIM_BATCH evictions so that no request stalls behind a
+ * long eviction run.
+ */
+void cache_set_limits(cache_t *cache, size_t capacity, size_t max_object)
+{
+    int i;
+    bool over = false;
+
+    for(i = 0; i < cache->nshards; i++)
+    {
+        cache_wlock(&cache->shards[i]);
+        cache->shards[i].max_size = capacity / cache->nshards;
+        if(cache->shards[i].cache_size > cache->shards[i].max_size)
+            over = true;
+        cache_wunlock(&cache->shards[i]);
+    }
+    cache->max_cache_size = capacity;
+    cache->max_object_size = max_object;
+
+    if(over)
+        V(&cache->trim);
+}
+
+/*
+ * cache_trimmer() is the thread routine which evicts lines from shards
+ * that are over their budget after cache_set_limits() shrank the cache.
+ * Every pass takes each shard's writer lock for at most TRIM_BATCH
+ * evictions and then lets the request threads in again.
+ */
+void *cache_trimmer(void *vargp)
+{
+    cache_t *cache = (cache_t *)vargp;
+    cacheq_t *shard;
+    bool over;
+    int i, n;
+
+    Pthread_detach(pthread_self());
+    while(1)
+    {
+        P(&cache->trim);
+        do
+        {
+            over = false;
+            for(i = 0; i < cache->nshards; i++)
+            {
+                shard = &cache->shards[i];
+                cache_wlock(shard);
+                for(n = 0; n < TRIM_BATCH &&
+                            shard->cache_size > shard->max_size; n++)
+                    eviction(shard);
+                if(shard->cache_size > shard->max_size)
+                    over = true;
+                cache_wunlock(shard);
+            }
+            sched_yield();
+        }while(over);
+        dbg_printf("trimmer: cache now %lu bytes\n", cache_total_size(cache));
+    }
+    return NULL;
+}
+
+/*
+ * cache_schedule() files line in the wheel of its shard by the deadline
+ * the cache gives it; called with the writer lock held whenever the
+ * expiry of a line changes.
+ */
+void cache_schedule(cacheq_t *shard, cacheline_t *line)
+{
+    time_t when;
+
+    when = shard->owner->deadline ? shard->owner->deadline(line) :
+                                    line->expires;
+    if(when > 0)
+        wheel_add(&shard->wheel, &line->timer, when);
+    else
+        wheel_remove(&shard->wheel, &line->timer);
+}
+
+/*
+ * cache_sweep() reclaims the lines past their deadline, taking the
+ * writer lock of a shard for at most batch of them at a time, so that
+ * the request threads get in between. Dead lines are not demoted, the
+ * disk tier would have nothing to serve them for.
+ */
+size_t cache_sweep(cache_t *cache, int batch)
+{
+    void *fired[SWEEP_BATCH_MAX];
+    cacheline_t *line;
+    cacheq_t *shard;
+    time_t now = time(NULL);
+    size_t total = 0, bytes = 0;
+    int i, j, n;
+
+    if(batch <= 0)
+        return 0;
+    if(batch > SWEEP_BATCH_MAX)
+        batch = SWEEP_BATCH_MAX;
+    for(i = 0; i < cache->nshards; i++)
+    {
+        shard = &cache->shards[i];
+        do
+        {
+            cache_wlock(shard);
+            n = wheel_expire(&shard->wheel, now, fired, batch);
+            for(j = 0; j < n; j++)
+            {
+                line = (cacheline_t *)fired[j];
+                bytes += line->size;
+                remove_from_cache(shard, line);
+            }
+            cache_wunlock(shard);
+            total += n;
+            if(n == batch)
+                sched_yield();
+        }while(n == batch);
+    }
+    __sync_fetch_and_add(&cache->swept, total);
+    __sync_fetch_and_add(&cache->swept_bytes, bytes);
+    dbg_printf("sweep: %lu lines, %lu bytes\n", total, bytes);
+    return total;
+}
+
+/*
+ * cache_timers() returns the lines filed in the wheels of all shards
+ */
+size_t cache_timers(cache_t *cache)
+{
+    size_t total = 0;
+    int i;
+
+    for(i = 0; i < cache->nshards; i++)
+        total += cache->shards[i].wheel.count;
+    return total;
+}
+
+/*
+ * cache_total_size() returns the bytes currently stored in all shards
+ */
+size_t cache_total_size(cache_t *cache)
+{
+    size_t total = 0;
+    int i;
+
+    for(i = 0; i < cache->nshards; i++)
+        total += cache->shards[i].cache_size;
+    return total;
+}
+
+/* bytes compressing obj saved, 0 if it is not compressed */
+static size_t saved_by(webobj_t *obj)
+{
+    return obj->encoding == WEBOBJ_IDENTITY ? 0 : obj->raw_size - obj->size;
+}
+
+/*
+ * cache_saved_size() returns the bytes the bodies stored compressed in 
+ * all shards would take up in addition uncompressed
+ */
+size_t cache_saved_size(cache_t *cache)
+{
+    size_t total = 0;
+    int i;
+
+    for(i = 0; i < cache->nshards; i++)
+        total += cache->shards[i].saved;
+    return total;
+}
+
 /* 
  * This function adds a new webobject to the cache 
  * at the tail of the queue.
- * It checks the size of the response, if it is more than 100 KiB 
- * it will discard the response. Else it will store the webobject in the cache
+ * It checks the size of the response, if it is more than the max 
+ * object size it will discard the response. Else it will store the webobject in the cache
  */
-bool add_to_cache(cacheq_t *cache, char *key, char *web_object, size_t response_length)
+bool add_to_cache(cacheq_t *cache, char *key, char *variant, 
+                  webhdr_t *web_header, webobj_t *web_object, time_t expires)
 {
     // if the cache is empty; return false 
-    size_t object_len, key_len; 
+    size_t object_len, key_len, variant_len = 0; 
     if(cache == NULL)
         return false; 
     cacheline_t *newline;
-    newline = (cacheline_t *)malloc(sizeof(cacheline_t));
+    newline = (cacheline_t *)slab_alloc(sizeof(cacheline_t));
     if(newline == NULL)
         return false; 
 
-    object_len = response_length;
+    object_len = web_header->len + web_object->size;
 
     // if object size is bigger than the allowed object size
-    if(!(object_len < MAX_OBJECT_SIZE))
+    if(object_len > cache->owner->max_object_size)
     {   
-        free(newline);
+        slab_free(newline, sizeof(cacheline_t));
         return false; 
     }
 
-    newline->web_object = malloc(response_length);
-
     key_len = strlen(key) + 1;
     
-    newline->key = (char *)malloc(key_len);
+    newline->key = (char *)slab_alloc(key_len);
 
-    if((newline->web_object == NULL)||(newline->key == NULL))
+    if(newline->key == NULL)
     {
-        free(newline);
+        slab_free(newline, sizeof(cacheline_t));
         unix_error("malloc error\n");
         return false;
     }
 
+    newline->variant = NULL;
+    if(variant != NULL)
+    {
+        variant_len = strlen(variant) + 1;
+        if((newline->variant = (char *)slab_alloc(variant_len)) == NULL)
+        {
+            slab_free(newline->key, key_len);
+            slab_free(newline, sizeof(cacheline_t));
+            return false;
+        }
+        memcpy(newline->variant, variant, variant_len);
+    }
+
     // inserting the first element in cache
     if(cache->head == NULL && cache->tail == NULL)
     {
-        memcpy(newline->web_object, web_object, object_len);
+        webobj_get(web_object);
+        newline->web_object = web_object;
+        webhdr_get(web_header);
+        newline->web_header = web_header;
+        newline->expires = expires;
+        newline->hits = 0;
+        newline->refreshing = 0;
         memcpy(newline->key, key, key_len);
+        newline->hash = hash_key(key);
         newline->age = lru++;
         newline->size = object_len;
         newline->next = NULL;
+        newline->prev = NULL;
+        wheel_timer_init(&newline->timer, newline);
 
         cache->head = newline;
         cache->tail = newline; 
         cache->cache_size += object_len;
+        cache->saved += saved_by(web_object);
+        dedup_add(web_object);
+        purge_index_add(newline);
+        cache_schedule(cache, newline);
         return true;
     }
 
     // else insert at tail 
-    memcpy(newline->web_object, web_object, object_len);
+    webobj_get(web_object);
+    newline->web_object = web_object;
+    webhdr_get(web_header);
+    newline->web_header = web_header;
+    newline->expires = expires;
+    newline->hits = 0;
+    newline->refreshing = 0;
     memcpy(newline->key, key, key_len);
+    newline->hash = hash_key(key);
     newline->age = lru++;
     newline->next = NULL;
+    newline->prev = cache->tail;
     newline->size = object_len;
+    wheel_timer_init(&newline->timer, newline);
     cache->tail->next = newline;
     cache->tail = newline;
     cache->cache_size += object_len;
+    cache->saved += saved_by(web_object);
+    dedup_add(web_object);
+    purge_index_add(newline);
+    cache_schedule(cache, newline);
     return true;
 }
 
 /* 
  * remove_from_cacheline() removes a web object from cache 
- * when provided the pointer to evict the block.
+ * when provided the pointer to evict the block, in O(1) as the line 
+ * knows its neighbours. 
  * It returns whether the function was successfully able to 
  * remove the object from the cache or not. 
  */
 bool remove_from_cache(cacheq_t *cache, cacheline_t *line)
 {
-    if(cache == NULL || ((cache->head == NULL) && (cache->tail == NULL)))
+    if(cache == NULL || line == NULL || 
+       ((cache->head == NULL) && (cache->tail == NULL)))
         return false;
 
-    cacheline_t *temp, *prev; 
-
-    temp = line;
-    prev = cache->head; 
-
-    // if head is to be removed
-    if(cache->head == temp)
-    {
-        cache->head = temp->next; 
-        cache->cache_size -= temp->size;
-        free(temp->web_object);
-        free(temp->key);
-        free(temp);
-        return true;
-    }
-
-    // if it is tail to be removed
-    if(cache->tail == temp)
-    {
-        cache->tail->next = NULL;
-        cache->cache_size -= temp->size;
-        free(temp->web_object);
-        free(temp->key);
-        free(temp);
-        return true;
-    }
-
-    // if the element is in the middle
-    while((prev != NULL) && (prev->next != temp))
-        prev = prev->next; 
-        
-    prev->next = temp->next;
-    temp->next = NULL;
-    cache->cache_size -= temp->size;
-    free(temp->web_object);
-    free(temp->key);
-    free(temp);
+    if(line->prev != NULL)
+        line->prev->next = line->next;
+    else
+        cache->head = line->next;
+    if(line->next != NULL)
+        line->next->prev = line->prev;
+    else
+        cache->tail = line->prev;
+    line->next = line->prev = NULL;
+    wheel_remove(&cache->wheel, &line->timer);
+
+    cache->cache_size -= line->size;
+    cache->saved -= saved_by(line->web_object);
+    dedup_remove(line->web_object);
+    purge_index_remove(line);
+    webobj_put(line->web_object);
+    webhdr_put(line->web_header);
+    slab_free(line->key, strlen(line->key) + 1);
+    if(line->variant)
+        slab_free(line->variant, strlen(line->variant) + 1);
+    slab_free(line, sizeof(cacheline_t));
     return true;
 }
 
@@ -192,6 +478,8 @@ size_t eviction(cacheq_t *cache)
     
     if(target)
     {
+        if(cache->owner->demote)
+            cache->owner->demote(target);
         evict_size = target->size;
         status = remove_from_cache(cache, target); 
     }
@@ -211,27 +499,44 @@ size_t eviction(cacheq_t *cache)
 cacheline_t *search_cache(cacheq_t *cache, char *key)
 {   
     cacheline_t *target; 
+    unsigned long hash;
 
     // return NULL if there is nothing to search
     if(cache == NULL || ((cache->head == NULL) && (cache->tail == NULL)))
         return NULL;
+    // lines whose hash differs are passed over without comparing keys
+    hash = hash_key(key);
     target = cache->head; 
-    fflush(stdout);
-    while((target != NULL) && (strcmp(key, target->key)))
+    while((target != NULL) && 
+          (target->hash != hash || strcmp(key, target->key)))
         target = target->next; 
 
     return target; 
 }
 
 /* 
- * is_cache_full() returns true if the cache is full and false otherwise 
- * arguements are pointer to a cache, and the length of the new block 
+ * search_next() returns the next line after line with the same key, 
+ * another variant of it, or NULL 
+ */
+cacheline_t *search_next(cacheline_t *line)
+{
+    cacheline_t *target;
+
+    for(target = line->next; target != NULL; target = target->next)
+        if(target->hash == line->hash && !strcmp(line->key, target->key))
+            return target;
+    return NULL;
+}
+
+/* 
+ * is_cache_full() returns true if the shard is full and false otherwise 
+ * arguements are pointer to a shard, and the length of the new block 
  * being added. 
  */
 bool is_cache_full(cacheq_t *cache, size_t response_length)
 {
 
-    if(cache->cache_size + response_length > MAX_CACHE_SIZE)
+    if(cache->cache_size + response_length > cache->max_size)
         return true; 
     else 
         return false;
@@ -251,7 +556,6 @@ void print_cache(cacheq_t *cache)
     while(temp != NULL)
     {
         dbg_printf("key = %s\n", temp->key);
-        dbg_printf("web_object = %s\n", temp->web_object);
         dbg_printf("size = %lu\n", temp->size);
         dbg_printf("age = %d\n", temp->age);
         temp = temp->next;
@@ -4,14 +4,22 @@
  */
 
 /* 
- * The cache is implemented as a singly linked list; 
+ * The cache is implemented as a doubly linked list; 
  * fully associative cache, with LRU policy for eviction
  * The eviction can be multiple eviction of blocks if the block 
  * being evicted does not satisfy the storage requirement of the 
  * entering block. 
+ * Every shard also files its lines in a timer wheel (wheel.c) by the 
+ * time they may be reclaimed, so that the sweeper finds the dead ones 
+ * without walking the list. 
  */
 
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
 #include "csapp.h"
+#include "webobj.h"
+#include "wheel.h"
 #include <stdio.h>
 
 /* 
@@ -23,59 +31,212 @@
  * 
  */
 
-/* Max cache and object sizes */
+/* Default cache and object sizes */
 /* Max object size = 100 KiB
  * Max cache size = 1 MiB
+ * These are only the defaults, the running values live in cache_t
+ * and can be changed from the command line, the config file or the
+ * control port.
  */
 #define MAX_CACHE_SIZE (1024*1024)
 #define MAX_OBJECT_SIZE (100*1024)
 
+/* Default and max number of independently locked shards */
+#define DEFAULT_CACHE_SHARDS 1
+#define MAX_CACHE_SHARDS 256
+
+/* Number of lines evicted per lock hold while shrinking the cache */
+#define TRIM_BATCH 8
+
+/* Default seconds a stale line may be served while it is refreshed, 
+ * seconds before expiry a hot line is refreshed ahead of time, and the 
+ * hits that make a line hot */
+#define STALE_GRACE 10
+#define REFRESH_AHEAD 2
+#define REFRESH_MIN_HITS 4
+
+/* Default number of variants of one key that are kept */
+#define MAX_VARIANTS 8
+
+/* Default seconds error responses are kept as negative entries */
+#define NEGATIVE_TTL_4XX 10
+#define NEGATIVE_TTL_5XX 2
+
+/* Default seconds an expired line that can be revalidated is kept 
+ * after its grace, before the sweeper reclaims it */
+#define STALE_KEEP 300
+
 /* 
  * Structure for cache 
- * Key - URI of the web object 
- * Web-Object - Response sent by the server which the proxy will cache
- * size - size of the web object 
+ * Key - normalized URI of the web object (urlkey.c) 
+ * hash - hash_key() of the key, compared before the key itself 
+ * variant - secondary key of a response with a Vary header, the values 
+ *           of the request headers it names (http_variant()); NULL if 
+ *           the response does not vary. Several variants of one key are 
+ *           kept as lines of their own, up to max_variants 
+ * Web-Object - Response sent by the server which the proxy will cache, 
+ *              as a reference counted chain of segments
+ * Web-Header - status line and headers of that response 
+ * size - size of the header block plus the web object 
+ * expires - time until which the response is fresh; a stale line is 
+ *           revalidated with the server before it is served, or served 
+ *           while it is refreshed in the background during its grace 
+ * hits - times the line was served, to tell hot lines 
+ * refreshing - set while a background refresh of the line runs 
  * age - age of the cache element 
- * next - pointer to the next block of the cache 
+ * timer - files the line in the wheel of its shard by its deadline 
+ * next, prev - pointers to the next and previous blocks of the cache 
  */
 typedef struct cacheline cacheline_t;
 typedef struct cacheq cacheq_t;
+typedef struct cache cache_t;
 
 typedef struct cacheline{
     char *key;
-    char *web_object;
+    unsigned long hash;
+    char *variant;
+    webobj_t *web_object;
+    webhdr_t *web_header;
     size_t size;
     int age;
+    time_t expires;
+    int hits;
+    int refreshing;
+    wheel_timer_t timer;
     cacheline_t *next;
+    cacheline_t *prev;
 }cacheline_t;
 
+/* 
+ * One shard of the cache. Each shard is an independent LRU list with 
+ * its own readers-writer lock and its share of the total capacity. 
+ * Keys are spread over the shards by their hash. The wheel holds the 
+ * lines that have a deadline, under the writer lock. 
+ */
 typedef struct cacheq
 {
     size_t cache_size;
+    size_t max_size;
+    size_t saved;       // bytes compression saved on the bodies held
     cacheline_t *head;
     cacheline_t *tail;
+    cache_t *owner;
+    int readcnt;        // number of readers holding the lock
+    sem_t mutex, w;     // reader count mutex, writer lock
+    wheel_t wheel;      // lines by the second they may be reclaimed
 }cacheq_t;
 
+/* 
+ * The whole cache: runtime limits and the array of shards. 
+ * max_cache_size and max_object_size may change while the proxy runs, 
+ * the shard count is fixed once the cache is created. 
+ */
+typedef struct cache
+{
+    size_t max_cache_size;
+    size_t max_object_size;
+    int nshards;
+    cacheq_t *shards;
+    sem_t trim;         // posted when a shard is over its budget
+    // called for every LRU victim before it is freed, may be NULL
+    void (*demote)(cacheline_t *line);
+    // returns when line may be reclaimed, 0 for never; if NULL lines 
+    // are reclaimed once they expire
+    time_t (*deadline)(cacheline_t *line);
+    size_t swept;       // lines reclaimed by cache_sweep()
+    size_t swept_bytes;
+}cache_t;
+
 /* helper function declarations */
 
 /* 
  * creates a cache at the begining of the connection and returns a pointer to 
  * the cache. When the connection stops(proxy exit); we will call free cache
  * function to free the cache
+ * capacity is split evenly between the nshards shards. 
+ */
+cache_t *create_cache(size_t capacity, size_t max_object, int nshards);
+
+/* 
+ * hash_key() returns the FNV-1a hash of key 
+ */
+unsigned long hash_key(char *key);
+
+/* 
+ * cache_shard() returns the shard responsible for key 
+ */
+cacheq_t *cache_shard(cache_t *cache, char *key);
+
+/* 
+ * readers-writer lock of a shard; readers may search and serve, 
+ * the writer may add, evict and remove lines. 
  */
-cacheq_t *create_cache(void);
+void cache_rlock(cacheq_t *shard);
+void cache_runlock(cacheq_t *shard);
+void cache_wlock(cacheq_t *shard);
+void cache_wunlock(cacheq_t *shard);
+
+/* 
+ * cache_set_limits() changes the capacity and the max object size of a 
+ * running cache. Growing takes effect immediately; when shrinking, the 
+ * shards over their new budget are trimmed by the trimmer thread in 
+ * batches of TRIM_BATCH evictions so that no request stalls behind a 
+ * long eviction run. 
+ */
+void cache_set_limits(cache_t *cache, size_t capacity, size_t max_object);
+
+/* 
+ * cache_trimmer() is the thread routine which evicts lines from shards 
+ * that are over their budget after cache_set_limits() shrank the cache. 
+ * The argument is the cache_t to trim. 
+ */
+void *cache_trimmer(void *vargp);
+
+/* 
+ * cache_schedule() files line in the wheel of its shard by the deadline 
+ * the cache gives it; called with the writer lock held whenever the 
+ * expiry of a line changes. 
+ */
+void cache_schedule(cacheq_t *shard, cacheline_t *line);
+
+/* 
+ * cache_sweep() reclaims the lines past their deadline, taking the 
+ * writer lock of a shard for at most batch of them at a time. 
+ * returns the lines reclaimed 
+ */
+size_t cache_sweep(cache_t *cache, int batch);
+
+/* 
+ * cache_timers() returns the lines filed in the wheels of all shards 
+ */
+size_t cache_timers(cache_t *cache);
+
+/* 
+ * cache_total_size() returns the bytes currently stored in all shards 
+ */
+size_t cache_total_size(cache_t *cache);
+
+/* 
+ * cache_saved_size() returns the bytes the bodies stored compressed in 
+ * all shards would take up in addition uncompressed 
+ */
+size_t cache_saved_size(cache_t *cache);
 
 /* 
  * This function adds a new webobject to the cache 
  * at the tail of the queue.
- * It checks the size of the response, if it is more than 100 KiB 
- * it will discard the response. Else it will store the webobject in the cache
+ * It checks the size of the response, if it is more than the max 
+ * object size it will discard the response. Else it will store the webobject in the cache
+ * The cache takes its own references to whdr and wobjct, the segments are 
+ * not copied. variant is the secondary key of the line, or NULL. 
  */
-bool add_to_cache(cacheq_t *cache, char *key, char *wobjct, size_t rspns_ln);
+bool add_to_cache(cacheq_t *cache, char *key, char *variant, 
+                  webhdr_t *whdr, webobj_t *wobjct, time_t expires);
 
 /* 
  * remove_from_cacheline() removes a web object from cache 
- * when provided the pointer to evict the block.
+ * when provided the pointer to evict the block, in O(1) as the line 
+ * knows its neighbours. 
  * It returns whether the function was successfully able to 
  * remove the object from the cache or not. 
  */
@@ -88,6 +249,7 @@ bool remove_from_cache(cacheq_t *cache, cacheline_t *line);
  * the queue. on reaching the tail pointer, return the oldest element 
  * in the queue to the caller which then evicts that element from 
  * the queue by calling remove_from_cache()
+ * The victim is handed to the demote hook of the cache first, if any. 
  */
 size_t eviction(cacheq_t *cache);
 
@@ -99,8 +261,14 @@ size_t eviction(cacheq_t *cache);
 cacheline_t *search_cache(cacheq_t *cache, char *key);
 
 /* 
- * is_cache_full() returns true if the cache is full and false otherwise 
- * arguements are pointer to a cache, and the length of the new block 
+ * search_next() returns the next line after line with the same key, 
+ * another variant of it, or NULL 
+ */
+cacheline_t *search_next(cacheline_t *line);
+
+/* 
+ * is_cache_full() returns true if the shard is full and false otherwise 
+ * arguements are pointer to a shard, and the length of the new block 
  * being added. 
  */
 bool is_cache_full(cacheq_t* cache, size_t response_length);
@@ -111,4 +279,6 @@ bool is_cache_full(cacheq_t* cache, size_t response_length);
  */
 void print_cache(cacheq_t *cache);
 
-/* end helper declarations */
\ No newline at end of file
+/* end helper declarations */
+
+#endif /* __CACHE_H__ */
@@ -0,0 +1,232 @@
+/* Compressed storage file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+#include "csapp.h"
+#include "compress.h"
+#include "config.h"
+#include "http.h"
+#include <strings.h>
+#include <zlib.h>
+
+//#define DEBUG // uncomment this line to enable debugging
+
+#ifdef DEBUG
+/* When debugging is enabled, these form aliases to useful functions */
+#define dbg_printf(...) printf(__VA_ARGS__)
+#else
+/* When debugging is disabled, no code gets generated for these */
+#define dbg_printf(...)
+#endif
+
+/* windowBits asking zlib for a gzip wrapper instead of a zlib one */
+#define GZIP_WINDOW (15 + 16)
+
+static compress_stats_t cz_stats;
+
+/* CPU time of the calling thread in microseconds */
+static long cpu_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+/* whether the Content-Type of hdr is named in compress_types */
+static bool compressible_type(char *hdr, size_t len)
+{
+    char type[MAXLINE], list[MAXLINE], *save, *name;
+    size_t n, tlen;
+
+    if(!http_header_value(hdr, len, "Content-Type", type, MAXLINE))
+        return false;
+    tlen = strcspn(type, " ;");
+
+    strcpy(list, config.compress_types);
+    for(name = strtok_r(list, " ,\t", &save); name != NULL;
+        name = strtok_r(NULL, " ,\t", &save))
+    {
+        n = strlen(name);
+        if(name[n - 1] == '*' ? tlen >= n - 1 &&
+                                !strncasecmp(type, name, n - 1) :
+                                tlen == n && !strncasecmp(type, name, n))
+            return true;
+    }
+    return false;
+}
+
+/*
+ * deflate_into() runs deflate with flush over the input set in zs,
+ * appending what comes out to out. returns false if out could not grow
+ */
+static bool deflate_into(z_stream *zs, webobj_t *out, int flush)
+{
+    size_t avail;
+    char *dst;
+    int rc;
+
+    do
+    {
+        if((dst = webobj_reserve(out, &avail)) == NULL)
+            return false;
+        zs->next_out = (Bytef *)dst;
+        zs->avail_out = avail;
+        rc = deflate(zs, flush);
+        webobj_commit(out, avail - zs->avail_out);
+        if(rc == Z_STREAM_ERROR)
+            return false;
+    }while(zs->avail_out == 0 && rc != Z_STREAM_END);
+    return true;
+}
+
+/* whether what went into zs came out small enough to be worth it */
+static bool shrunk(z_stream *zs)
+{
+    return zs->total_out * 100 <= zs->total_in * COMPRESS_MAX_RATIO;
+}
+
+/*
+ * compress_wanted() tells whether the body of the response with the
+ * header block hdr is one to keep compressed
+ */
+bool compress_wanted(char *hdr, size_t len)
+{
+    return config.cache_compress && http_compressible(hdr, len) &&
+           compressible_type(hdr, len);
+}
+
+/*
+ * compress_body() returns the object to store as the body of the
+ * response with the header block hdr: obj compressed if that is
+ * allowed and worth it, obj itself otherwise. Either way the caller
+ * gets a reference of its own
+ */
+webobj_t *compress_body(char *hdr, size_t len, webobj_t *obj)
+{
+    webobj_t *out;
+    segment_t *seg;
+    z_stream zs;
+    long start;
+    bool ok = true;
+
+    if(obj->encoding != WEBOBJ_IDENTITY ||
+       obj->size < config.compress_min_size ||
+       !compress_wanted(hdr, len) || (out = webobj_create()) == NULL)
+    {
+        webobj_get(obj);
+        return obj;
+    }
+
+    start = cpu_us();
+    memset(&zs, 0, sizeof(zs));
+    if(deflateInit2(&zs, config.compress_level, Z_DEFLATED, GZIP_WINDOW,
+                    8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        webobj_put(out);
+        webobj_get(obj);
+        return obj;
+    }
+
+    // the first segment tells whether the body compresses at all, a
+    // body that is compressed already is given up after 16K
+    for(seg = obj->head; seg != NULL && ok; seg = seg->next)
+    {
+        zs.next_in = (Bytef *)seg->data;
+        zs.avail_in = seg->len;
+        if(seg == obj->head && seg->next != NULL)
+            ok = deflate_into(&zs, out, Z_SYNC_FLUSH) && shrunk(&zs);
+        else
+            ok = deflate_into(&zs, out,
+                              seg->next ? Z_NO_FLUSH : Z_FINISH);
+    }
+    ok = ok && shrunk(&zs);
+    deflateEnd(&zs);
+    __sync_fetch_and_add(&cz_stats.deflate_us, cpu_us() - start);
+
+    if(!ok)
+    {
+        __sync_fetch_and_add(&cz_stats.skipped, 1);
+        webobj_put(out);
+        webobj_get(obj);
+        return obj;
+    }
+    out->encoding = WEBOBJ_GZIP;
+    out->raw_size = obj->size;
+    // still the same body to dedup.c
+    memcpy(out->digest, obj->digest, sizeof(out->digest));
+    out->digested = obj->digested;
+    __sync_fetch_and_add(&cz_stats.compressed, 1);
+    __sync_fetch_and_add(&cz_stats.raw_bytes, obj->size);
+    __sync_fetch_and_add(&cz_stats.stored_bytes, out->size);
+    dbg_printf("compress: %lu -> %lu bytes\n", obj->size, out->size);
+    return out;
+}
+
+/*
+ * inflate_object() returns the body of a compressed obj as a new object
+ * holding one reference, or NULL if it could not be inflated
+ */
+webobj_t *inflate_object(webobj_t *obj)
+{
+    webobj_t *out;
+    segment_t *seg;
+    z_stream zs;
+    size_t avail;
+    char *dst;
+    long start;
+    int rc = Z_OK;
+
+    if((out = webobj_create()) == NULL)
+        return NULL;
+    start = cpu_us();
+    memset(&zs, 0, sizeof(zs));
+    if(inflateInit2(&zs, GZIP_WINDOW) != Z_OK)
+    {
+        webobj_put(out);
+        return NULL;
+    }
+
+    for(seg = obj->head; seg != NULL && rc == Z_OK; seg = seg->next)
+    {
+        zs.next_in = (Bytef *)seg->data;
+        zs.avail_in = seg->len;
+        do
+        {
+            if((dst = webobj_reserve(out, &avail)) == NULL)
+            {
+                rc = Z_MEM_ERROR;
+                break;
+            }
+            zs.next_out = (Bytef *)dst;
+            zs.avail_out = avail;
+            rc = inflate(&zs, Z_NO_FLUSH);
+            webobj_commit(out, avail - zs.avail_out);
+        }while(rc == Z_OK && zs.avail_out == 0);
+    }
+    inflateEnd(&zs);
+    __sync_fetch_and_add(&cz_stats.inflate_us, cpu_us() - start);
+
+    if(rc != Z_STREAM_END || out->size != obj->raw_size)
+    {
+        dbg_printf("compress: inflating failed, %d\n", rc);
+        webobj_put(out);
+        return NULL;
+    }
+    return out;
+}
+
+/* compress_count_served() counts a hit sent encoded, or inflated */
+void compress_count_served(bool encoded)
+{
+    if(encoded)
+        __sync_fetch_and_add(&cz_stats.served_encoded, 1);
+    else
+        __sync_fetch_and_add(&cz_stats.served_inflated, 1);
+}
+
+/* compress_get_stats() fills in the counters */
+void compress_get_stats(compress_stats_t *stats)
+{
+    *stats = cz_stats;
+}
@@ -0,0 +1,78 @@
+/* Compressed storage header file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+
+/*
+ * Compression of cached bodies, so that a small cache holds more of the
+ * text a site is made of. With cache_compress on, a response stored in
+ * the memory cache is kept gzip compressed (zlib, at compress_level)
+ * when
+ *
+ *   - its Content-Type is one of compress_types, where a name ending
+ *     in '*' matches every type starting with the rest, so that the
+ *     default covers all of text/ as well as JSON, JavaScript, XML and
+ *     SVG
+ *   - it is at least compress_min_size bytes, not encoded already, and
+ *     has no Cache-Control: no-transform
+ *   - it shrinks: the first segment has to come down to
+ *     COMPRESS_MAX_RATIO percent or less, or compressing is given up
+ *     there, and so does the whole body
+ *
+ * so JPEG, GIF and other bodies that are compressed already are never
+ * touched. A client that accepts gzip is sent the stored bytes as they
+ * are, with Content-Encoding: gzip; any other gets the body inflated
+ * when it asks for it.
+ */
+
+#ifndef __COMPRESS_H__
+#define __COMPRESS_H__
+
+#include "csapp.h"
+#include "webobj.h"
+
+#define COMPRESS_LEVEL 1            /* default zlib level, fastest */
+#define COMPRESS_MIN_SIZE 1024      /* default smallest body compressed */
+#define COMPRESS_MAX_RATIO 90       /* percent a body has to shrink to */
+#define COMPRESS_TYPES "text/* application/json application/javascript " \
+                       "application/xml image/svg+xml"
+
+typedef struct compress_stats
+{
+    size_t compressed;       // bodies stored compressed
+    size_t skipped;          // bodies tried that did not shrink enough
+    size_t raw_bytes;        // size of the compressed bodies before
+    size_t stored_bytes;     // and after
+    size_t served_encoded;   // hits sent compressed
+    size_t served_inflated;  // hits inflated for the client
+    size_t deflate_us;       // CPU time spent compressing
+    size_t inflate_us;       // and inflating
+}compress_stats_t;
+
+/*
+ * compress_wanted() tells whether the body of the response with the
+ * header block hdr is one to keep compressed
+ */
+bool compress_wanted(char *hdr, size_t len);
+
+/*
+ * compress_body() returns the object to store as the body of the
+ * response with the header block hdr: obj compressed if that is
+ * allowed and worth it, obj itself otherwise. Either way the caller
+ * gets a reference of its own
+ */
+webobj_t *compress_body(char *hdr, size_t len, webobj_t *obj);
+
+/*
+ * inflate_object() returns the body of a compressed obj as a new object
+ * holding one reference, or NULL if it could not be inflated
+ */
+webobj_t *inflate_object(webobj_t *obj);
+
+/* compress_count_served() counts a hit sent encoded, or inflated */
+void compress_count_served(bool encoded);
+
+/* compress_get_stats() fills in the counters */
+void compress_get_stats(compress_stats_t *stats);
+
+#endif /* __COMPRESS_H__ */
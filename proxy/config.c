@@ -0,0 +1,568 @@
+/* Proxy configuration file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+#include "csapp.h"
+#include "cache.h"
+#include "config.h"
+#include "dcache.h"
+#include "upstream.h"
+#include "dns.h"
+#include "health.h"
+#include "hedge.h"
+#include "compress.h"
+#include "pressure.h"
+#include "purge.h"
+#include "engine.h"
+#include <strings.h>
+
+//#define DEBUG // uncomment this line to enable debugging
+
+#ifdef DEBUG
+/* When debugging is enabled, these form aliases to useful functions */
+#define dbg_printf(...) printf(__VA_ARGS__)
+#else
+/* When debugging is disabled, no code gets generated for these */
+#define dbg_printf(...)
+#endif
+
+proxy_config_t config;
+
+/* strips leading and trailing whitespace in place */
+static char *trim(char *str)
+{
+    char *end;
+
+    while(isspace((unsigned char)*str))
+        str++;
+
+    end = str + strlen(str);
+    while(end > str && isspace((unsigned char)end[-1]))
+        end--;
+    *end = '\0';
+    return str;
+}
+
+/* fills in the compile time defaults */
+void config_defaults(proxy_config_t *cfg)
+{
+    cfg->cache_size = MAX_CACHE_SIZE;
+    cfg->mem_adaptive = false;
+    cfg->mem_cgroup[0] = '\0';
+    cfg->mem_high_water = MEM_HIGH_WATER;
+    cfg->mem_pressure = MEM_PRESSURE;
+    cfg->mem_min_cache = MEM_MIN_CACHE;
+    cfg->max_object_size = MAX_OBJECT_SIZE;
+    cfg->shards = DEFAULT_CACHE_SHARDS;
+    cfg->event_loops = -1;
+    cfg->handoff_threads = ENGINE_HANDOFF_THREADS;
+    cfg->hugepages = false;
+    cfg->memfd_arena = false;
+    cfg->cache_dedup = true;
+    cfg->cache_compress = false;
+    cfg->compress_level = COMPRESS_LEVEL;
+    cfg->compress_min_size = COMPRESS_MIN_SIZE;
+    strcpy(cfg->compress_types, COMPRESS_TYPES);
+    cfg->disk_dir[0] = '\0';
+    cfg->disk_size = DCACHE_SIZE;
+    cfg->disk_segment_size = DCACHE_SEGMENT_SIZE;
+    cfg->snapshot_path[0] = '\0';
+    cfg->snapshot_interval = 0;
+    cfg->default_ttl = 0;
+    cfg->stale_grace = STALE_GRACE;
+    cfg->refresh_ahead = REFRESH_AHEAD;
+    cfg->refresh_min_hits = REFRESH_MIN_HITS;
+    cfg->cache_key_normalize = true;
+    cfg->cache_key_strip[0] = '\0';
+    cfg->max_variants = MAX_VARIANTS;
+    cfg->negative_ttl_4xx = NEGATIVE_TTL_4XX;
+    cfg->negative_ttl_5xx = NEGATIVE_TTL_5XX;
+    cfg->negative_connect_ttl = NEGATIVE_CONNECT_TTL;
+    cfg->stale_keep = STALE_KEEP;
+    cfg->sweep_batch = SWEEP_BATCH;
+    strcpy(cfg->purge_tag_header, PURGE_TAG_HEADER);
+    cfg->splice_relay = true;
+    cfg->upstream_groups[0] = '\0';
+    cfg->health_interval = HEALTH_INTERVAL;
+    cfg->health_path[0] = '\0';
+    cfg->breaker_failures = BREAKER_FAILURES;
+    cfg->breaker_open_time = BREAKER_OPEN_TIME;
+    cfg->hedge_percentile = HEDGE_PERCENTILE;
+    cfg->hedge_min_delay = HEDGE_MIN_DELAY;
+    cfg->hedge_budget = HEDGE_BUDGET;
+    cfg->upstream_keepalive = true;
+    cfg->upstream_max_idle = UPSTREAM_MAX_IDLE;
+    cfg->upstream_idle_timeout = UPSTREAM_IDLE_TIMEOUT;
+    cfg->upstream_max_lifetime = UPSTREAM_MAX_LIFETIME;
+    cfg->upstream_connect_timeout = UPSTREAM_CONNECT_TIMEOUT;
+    cfg->upstream_attempt_timeout = UPSTREAM_ATTEMPT_TIMEOUT;
+    cfg->upstream_race_delay = UPSTREAM_RACE_DELAY;
+    cfg->dns_ttl = DNS_TTL;
+    cfg->dns_negative_ttl = DNS_NEGATIVE_TTL;
+    cfg->control_port[0] = '\0';
+    cfg->config_file[0] = '\0';
+}
+
+/*
+ * parse_size() converts "64M" style strings to bytes.
+ * returns 0 on a malformed string
+ */
+size_t parse_size(char *str)
+{
+    char *end;
+    unsigned long long value;
+
+    errno = 0;
+    value = strtoull(str, &end, 10);
+    if(errno || end == str)
+        return 0;
+
+    switch(toupper((unsigned char)*end))
+    {
+        case 'G':
+            value *= 1024;
+            /* fall through */
+        case 'M':
+            value *= 1024;
+            /* fall through */
+        case 'K':
+            value *= 1024;
+            end++;
+            break;
+        default:
+            break;
+    }
+
+    if(*trim(end) != '\0')
+        return 0;
+    return (size_t)value;
+}
+
+/*
+ * parse_bool() converts on/off, yes/no, true/false and 1/0.
+ * returns -1 on a malformed string
+ */
+int parse_bool(char *str)
+{
+    if(!strcasecmp(str, "on") || !strcasecmp(str, "yes") ||
+       !strcasecmp(str, "true") || !strcmp(str, "1"))
+        return 1;
+    if(!strcasecmp(str, "off") || !strcasecmp(str, "no") ||
+       !strcasecmp(str, "false") || !strcmp(str, "0"))
+        return 0;
+    return -1;
+}
+
+/*
+ * config_set() sets a single key to the string value.
+ * returns 0 on success, -1 if the key is unknown or the value invalid
+ */
+int config_set(proxy_config_t *cfg, char *key, char *value)
+{
+    size_t size;
+    int n;
+
+    if(!strcmp(key, "cache_size"))
+    {
+        if((size = parse_size(value)) == 0)
+            return -1;
+        cfg->cache_size = size;
+    }
+    else if(!strcmp(key, "mem_adaptive"))
+    {
+        if((n = parse_bool(value)) < 0)
+            return -1;
+        cfg->mem_adaptive = n;
+    }
+    else if(!strcmp(key, "mem_cgroup"))
+    {
+        strncpy(cfg->mem_cgroup, value, MAXLINE - 1);
+        cfg->mem_cgroup[MAXLINE - 1] = '\0';
+    }
+    else if(!strcmp(key, "mem_high_water"))
+    {
+        n = atoi(value);
+        if(n < 1 || n > 100)
+            return -1;
+        cfg->mem_high_water = n;
+    }
+    else if(!strcmp(key, "mem_pressure"))
+    {
+        n = atoi(value);
+        if(n < 1 || n > 100)
+            return -1;
+        cfg->mem_pressure = n;
+    }
+    else if(!strcmp(key, "mem_min_cache"))
+    {
+        if((size = parse_size(value)) == 0)
+            return -1;
+        cfg->mem_min_cache = size;
+    }
+    else if(!strcmp(key, "max_object_size"))
+    {
+        if((size = parse_size(value)) == 0)
+            return -1;
+        cfg->max_object_size = size;
+    }
+    else if(!strcmp(key, "shards"))
+    {
+        n = atoi(value);
+        if(n < 1 || n > MAX_CACHE_SHARDS)
+            return -1;
+        cfg->shards = n;
+    }
+    else if(!strcmp(key, "event_loops"))
+    {
+        if(!strcasecmp(value, "auto"))
+            n = -1;
+        else if((n = atoi(value)) < 0 || (n == 0 && strcmp(value, "0")))
+            return -1;
+        cfg->event_loops = n;
+    }
+    else if(!strcmp(key, "handoff_threads"))
+    {
+        n = atoi(value);
+        if(n < 1 || n > ENGINE_MAX_HANDOFF_THREADS)
+            return -1;
+        cfg->handoff_threads = n;
+    }
+    else if(!strcmp(key, "hugepages"))
+    {
+        if((n = parse_bool(value)) < 0)
+            return -1;
+        cfg->hugepages = n;
+    }
+    else if(!strcmp(key, "memfd_arena"))
+    {
+        if((n = parse_bool(value)) < 0)
+            return -1;
+        cfg->memfd_arena = n;
+    }
+    else if(!strcmp(key, "cache_dedup"))
+    {
+        if((n = parse_bool(value)) < 0)
+            return -1;
+        cfg->cache_dedup = n;
+    }
+    else if(!strcmp(key, "cache_compress"))
+    {
+        if((n = parse_bool(value)) < 0)
+            return -1;
+        cfg->cache_compress = n;
+    }
+    else if(!strcmp(key, "compress_level"))
+    {
+        n = atoi(value);
+        if(n < 1 || n > 9)
+            return -1;
+        cfg->compress_level = n;
+    }
+    else if(!strcmp(key, "compress_min_size"))
+    {
+        if((size = parse_size(value)) == 0)
+            return -1;
+        cfg->compress_min_size = size;
+    }
+    else if(!strcmp(key, "compress_types"))
+    {
+        strncpy(cfg->compress_types, value, MAXLINE - 1);
+        cfg->compress_types[MAXLINE - 1] = '\0';
+    }
+    else if(!strcmp(key, "disk_dir"))
+    {
+        strncpy(cfg->disk_dir, value, MAXLINE - 1);
+        cfg->disk_dir[MAXLINE - 1] = '\0';
+    }
+    else if(!strcmp(key, "disk_size"))
+    {
+        if((size = parse_size(value)) == 0)
+            return -1;
+        cfg->disk_size = size;
+    }
+    else if(!strcmp(key, "disk_segment_size"))
+    {
+        if((size = parse_size(value)) == 0)
+            return -1;
+        cfg->disk_segment_size = size;
+    }
+    else if(!strcmp(key, "snapshot_path"))
+    {
+        strncpy(cfg->snapshot_path, value, MAXLINE - 1);
+        cfg->snapshot_path[MAXLINE - 1] = '\0';
+    }
+    else if(!strcmp(key, "snapshot_interval"))
+    {
+        n = atoi(value);
+        if(n < 0)
+            return -1;
+        cfg->snapshot_interval = n;
+    }
+    else if(!strcmp(key, "default_ttl"))
+    {
+        n = atoi(value);
+        if(n < 0)
+            return -1;
+        cfg->default_ttl = n;
+    }
+    else if(!strcmp(key, "stale_grace"))
+    {
+        n = atoi(value);
+        if(n < 0)
+            return -1;
+        cfg->stale_grace = n;
+    }
+    else if(!strcmp(key, "refresh_ahead"))
+    {
+        n = atoi(value);
+        if(n < 0)
+            return -1;
+        cfg->refresh_ahead = n;
+    }
+    else if(!strcmp(key, "refresh_min_hits"))
+    {
+        n = atoi(value);
+        if(n < 0)
+            return -1;
+        cfg->refresh_min_hits = n;
+    }
+    else if(!strcmp(key, "cache_key_normalize"))
+    {
+        if((n = parse_bool(value)) < 0)
+            return -1;
+        cfg->cache_key_normalize = n;
+    }
+    else if(!strcmp(key, "cache_key_strip"))
+    {
+        strncpy(cfg->cache_key_strip, value, MAXLINE - 1);
+        cfg->cache_key_strip[MAXLINE - 1] = '\0';
+    }
+    else if(!strcmp(key, "max_variants"))
+    {
+        n = atoi(value);
+        if(n < 1)
+            return -1;
+        cfg->max_variants = n;
+    }
+    else if(!strcmp(key, "negative_ttl_4xx"))
+    {
+        n = atoi(value);
+        if(n < 0)
+            return -1;
+        cfg->negative_ttl_4xx = n;
+    }
+    else if(!strcmp(key, "negative_ttl_5xx"))
+    {
+        n = atoi(value);
+        if(n < 0)
+            return -1;
+        cfg->negative_ttl_5xx = n;
+    }
+    else if(!strcmp(key, "negative_connect_ttl"))
+    {
+        n = atoi(value);
+        if(n < 0)
+            return -1;
+        cfg->negative_connect_ttl = n;
+    }
+    else if(!strcmp(key, "stale_keep"))
+    {
+        n = atoi(value);
+        if(n < -1)
+            return -1;
+        cfg->stale_keep = n;
+    }
+    else if(!strcmp(key, "sweep_batch"))
+    {
+        n = atoi(value);
+        if(n < 0 || n > SWEEP_BATCH_MAX)
+            return -1;
+        cfg->sweep_batch = n;
+    }
+    else if(!strcmp(key, "purge_tag_header"))
+    {
+        strncpy(cfg->purge_tag_header, value, MAXLINE - 1);
+        cfg->purge_tag_header[MAXLINE - 1] = '\0';
+    }
+    else if(!strcmp(key, "splice_relay"))
+    {
+        if((n = parse_bool(value)) < 0)
+            return -1;
+        cfg->splice_relay = n;
+    }
+    else if(!strcmp(key, "upstream_groups"))
+    {
+        strncpy(cfg->upstream_groups, value, MAXLINE - 1);
+        cfg->upstream_groups[MAXLINE - 1] = '\0';
+    }
+    else if(!strcmp(key, "health_interval"))
+    {
+        n = atoi(value);
+        if(n < 0)
+            return -1;
+        cfg->health_interval = n;
+    }
+    else if(!strcmp(key, "health_path"))
+    {
+        if(value[0] != '/' || strlen(value) >= HEALTH_PATH_MAX)
+            return -1;
+        strncpy(cfg->health_path, value, MAXLINE - 1);
+        cfg->health_path[MAXLINE - 1] = '\0';
+    }
+    else if(!strcmp(key, "breaker_failures"))
+    {
+        n = atoi(value);
+        if(n < 0)
+            return -1;
+        cfg->breaker_failures = n;
+    }
+    else if(!strcmp(key, "breaker_open_time"))
+    {
+        n = atoi(value);
+        if(n < 1)
+            return -1;
+        cfg->breaker_open_time = n;
+    }
+    else if(!strcmp(key, "hedge_percentile"))
+    {
+        n = atoi(value);
+        if(n < 0 || n > 99)
+            return -1;
+        cfg->hedge_percentile = n;
+    }
+    else if(!strcmp(key, "hedge_min_delay"))
+    {
+        n = atoi(value);
+        if(n < 0)
+            return -1;
+        cfg->hedge_min_delay = n;
+    }
+    else if(!strcmp(key, "hedge_budget"))
+    {
+        n = atoi(value);
+        if(n < 0 || n > 100)
+            return -1;
+        cfg->hedge_budget = n;
+    }
+    else if(!strcmp(key, "upstream_keepalive"))
+    {
+        if((n = parse_bool(value)) < 0)
+            return -1;
+        cfg->upstream_keepalive = n;
+    }
+    else if(!strcmp(key, "upstream_max_idle"))
+    {
+        n = atoi(value);
+        if(n < 0)
+            return -1;
+        cfg->upstream_max_idle = n;
+    }
+    else if(!strcmp(key, "upstream_idle_timeout"))
+    {
+        n = atoi(value);
+        if(n < 0)
+            return -1;
+        cfg->upstream_idle_timeout = n;
+    }
+    else if(!strcmp(key, "upstream_max_lifetime"))
+    {
+        n = atoi(value);
+        if(n < 0)
+            return -1;
+        cfg->upstream_max_lifetime = n;
+    }
+    else if(!strcmp(key, "upstream_connect_timeout"))
+    {
+        n = atoi(value);
+        if(n <= 0)
+            return -1;
+        cfg->upstream_connect_timeout = n;
+    }
+    else if(!strcmp(key, "upstream_attempt_timeout"))
+    {
+        n = atoi(value);
+        if(n <= 0)
+            return -1;
+        cfg->upstream_attempt_timeout = n;
+    }
+    else if(!strcmp(key, "upstream_race_delay"))
+    {
+        n = atoi(value);
+        if(n < 0)
+            return -1;
+        cfg->upstream_race_delay = n;
+    }
+    else if(!strcmp(key, "dns_ttl"))
+    {
+        n = atoi(value);
+        if(n < 0)
+            return -1;
+        cfg->dns_ttl = n;
+    }
+    else if(!strcmp(key, "dns_negative_ttl"))
+    {
+        n = atoi(value);
+        if(n < 0)
+            return -1;
+        cfg->dns_negative_ttl = n;
+    }
+    else if(!strcmp(key, "control_port"))
+    {
+        strncpy(cfg->control_port, value, MAXLINE - 1);
+        cfg->control_port[MAXLINE - 1] = '\0';
+    }
+    else
+        return -1;
+
+    dbg_printf("config: %s = %s\n", key, value);
+    return 0;
+}
+
+/*
+ * config_load_file() reads "key = value" lines from path.
+ * returns 0 on success, -1 if the file cannot be read or has bad lines
+ */
+int config_load_file(proxy_config_t *cfg, char *path)
+{
+    FILE *fp;
+    char line[MAXLINE], *key, *value, *sep;
+    int lineno = 0, status = 0;
+
+    if((fp = fopen(path, "r")) == NULL)
+    {
+        fprintf(stderr, "config: cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    while(fgets(line, MAXLINE, fp) != NULL)
+    {
+        lineno++;
+        if((sep = strchr(line, '#')) != NULL)
+            *sep = '\0';
+
+        key = trim(line);
+        if(*key == '\0')
+            continue;
+
+        if((sep = strchr(key, '=')) == NULL)
+        {
+            fprintf(stderr, "config: %s:%d: expected key = value\n",
+                            path, lineno);
+            status = -1;
+            continue;
+        }
+        *sep = '\0';
+        key = trim(key);
+        value = trim(sep + 1);
+
+        if(config_set(cfg, key, value) < 0)
+        {
+            fprintf(stderr, "config: %s:%d: bad setting '%s'\n",
+                            path, lineno, key);
+            status = -1;
+        }
+    }
+
+    fclose(fp);
+    return status;
+}
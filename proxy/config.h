@@ -0,0 +1,169 @@
+/* Proxy configuration header file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+
+/*
+ * Runtime configuration of the proxy. The values start out as the
+ * compile time defaults from cache.h, are overridden by the config
+ * file (-f) and then by the command line flags. The control port can
+ * change them again while the proxy is running.
+ *
+ * Config file format: one "key = value" pair per line, '#' starts a
+ * comment. Sizes accept an optional K, M or G suffix.
+ *
+ *   cache_size      = 64M
+ *   mem_adaptive    = on
+ *   mem_cgroup      = /sys/fs/cgroup/proxy.service
+ *   mem_high_water  = 90
+ *   mem_pressure    = 10
+ *   mem_min_cache   = 4M
+ *   max_object_size = 1M
+ *   shards          = 16
+ *   event_loops     = auto
+ *   handoff_threads = 128
+ *   control_port    = 15213
+ *   hugepages       = on
+ *   memfd_arena     = on
+ *   cache_dedup     = on
+ *   cache_compress  = on
+ *   compress_level  = 1
+ *   compress_min_size = 1K
+ *   compress_types  = text/html text/css application/json
+ *   disk_dir        = /var/cache/proxy
+ *   disk_size       = 10G
+ *   disk_segment_size = 64M
+ *   snapshot_path   = /var/cache/proxy/snap
+ *   snapshot_interval = 300
+ *   default_ttl     = 0
+ *   stale_grace     = 10
+ *   refresh_ahead   = 2
+ *   refresh_min_hits = 4
+ *   cache_key_normalize = on
+ *   cache_key_strip = utm_* fbclid gclid
+ *   max_variants    = 8
+ *   negative_ttl_4xx = 10
+ *   negative_ttl_5xx = 2
+ *   negative_connect_ttl = 2
+ *   stale_keep      = 300
+ *   sweep_batch     = 32
+ *   purge_tag_header = Surrogate-Key
+ *   splice_relay    = on
+ *   upstream_groups = /etc/proxy/upstreams
+ *   health_interval = 5
+ *   health_path     = /healthz
+ *   breaker_failures = 5
+ *   breaker_open_time = 10
+ *   hedge_percentile = 95
+ *   hedge_min_delay = 10
+ *   hedge_budget    = 5
+ *   upstream_keepalive = on
+ *   upstream_max_idle = 8
+ *   upstream_idle_timeout = 30
+ *   upstream_max_lifetime = 300
+ *   upstream_connect_timeout = 5000
+ *   upstream_attempt_timeout = 2000
+ *   upstream_race_delay = 250
+ *   dns_ttl         = 60
+ *   dns_negative_ttl = 5
+ */
+
+#ifndef __CONFIG_H__
+#define __CONFIG_H__
+
+#include "csapp.h"
+
+typedef struct proxy_config
+{
+    size_t cache_size;           /* total cache capacity in bytes */
+    bool mem_adaptive;           /* size the cache by memory pressure, */
+                                 /* cache_size is the ceiling */
+    char mem_cgroup[MAXLINE];    /* cgroup directory, "" = our own */
+    int mem_high_water;          /* percent of the cgroup limit to stay under */
+    int mem_pressure;            /* PSI some avg10 percent that shrinks */
+    size_t mem_min_cache;        /* smallest the cache is shrunk to */
+    size_t max_object_size;      /* largest cacheable web object */
+    int shards;                  /* number of cache shards (startup only) */
+    int event_loops;             /* epoll loops, 0 = thread per client, */
+                                 /* -1 = one per core (startup only) */
+    int handoff_threads;         /* threads serving handed off requests */
+                                 /* (startup only) */
+    bool hugepages;              /* back slab arenas with hugepages */
+    bool memfd_arena;            /* carve arenas from a memfd, for sendfile */
+    bool cache_dedup;            /* share bodies that are the same bytes */
+    bool cache_compress;         /* store compressible bodies gzipped */
+    int compress_level;          /* zlib level they are compressed at */
+    size_t compress_min_size;    /* smallest body compressed */
+    char compress_types[MAXLINE]; /* Content-Types compressed */
+    char disk_dir[MAXLINE];      /* disk tier directory, "" if disabled */
+    size_t disk_size;            /* disk tier capacity */
+    size_t disk_segment_size;    /* size of one disk segment file */
+    char snapshot_path[MAXLINE]; /* snapshot file prefix, "" if disabled */
+    int snapshot_interval;       /* seconds between snapshots, 0 = exit only */
+    long default_ttl;            /* freshness of responses without any */
+    long stale_grace;            /* serve stale this long while refreshing */
+    long refresh_ahead;          /* refresh hot entries this close to expiry */
+    int refresh_min_hits;        /* hits that make an entry hot */
+    bool cache_key_normalize;    /* key the cache by normalized URIs */
+    char cache_key_strip[MAXLINE]; /* query parameters left out of keys */
+    int max_variants;            /* Vary variants kept per key */
+    long negative_ttl_4xx;       /* seconds a 404 and the like are cached */
+    long negative_ttl_5xx;       /* seconds a 5xx is cached */
+    long negative_connect_ttl;   /* seconds a failed connect is cached */
+    long stale_keep;             /* seconds expired lines with validators stay */
+    int sweep_batch;             /* expired things reclaimed per lock hold */
+    char purge_tag_header[MAXLINE]; /* response header listing the tags, */
+                                 /* "" = no tags (startup only) */
+    bool splice_relay;           /* splice uncached bodies to the client */
+    char upstream_groups[MAXLINE]; /* backend groups file (startup only) */
+    long health_interval;        /* seconds between probes, 0 = none */
+    char health_path[MAXLINE];   /* path probes GET, "" = connect only */
+    int breaker_failures;        /* failures in a row that open a breaker */
+    long breaker_open_time;      /* seconds before a half-open trial */
+    int hedge_percentile;        /* hedge after this percentile, 0 = never */
+    long hedge_min_delay;        /* ms a request waits before a hedge */
+    int hedge_budget;            /* hedges allowed per 100 requests */
+    bool upstream_keepalive;     /* pool upstream connections */
+    int upstream_max_idle;       /* idle connections kept per origin */
+    long upstream_idle_timeout;  /* seconds an idle connection is kept */
+    long upstream_max_lifetime;  /* seconds a connection is reused for */
+    long upstream_connect_timeout; /* ms to open a connection */
+    long upstream_attempt_timeout; /* ms to connect to one address */
+    long upstream_race_delay;    /* ms before racing the next address */
+    long dns_ttl;                /* seconds a resolved name is cached */
+    long dns_negative_ttl;       /* seconds a failed lookup is cached */
+    char control_port[MAXLINE];  /* local control port, "" if disabled */
+    char config_file[MAXLINE];   /* file to re-read on "reload" */
+}proxy_config_t;
+
+/* the configuration the proxy is currently running with */
+extern proxy_config_t config;
+
+/* fills in the compile time defaults */
+void config_defaults(proxy_config_t *cfg);
+
+/*
+ * config_set() sets a single key to the string value.
+ * returns 0 on success, -1 if the key is unknown or the value invalid
+ */
+int config_set(proxy_config_t *cfg, char *key, char *value);
+
+/*
+ * config_load_file() reads "key = value" lines from path.
+ * returns 0 on success, -1 if the file cannot be read or has bad lines
+ */
+int config_load_file(proxy_config_t *cfg, char *path);
+
+/*
+ * parse_size() converts "64M" style strings to bytes.
+ * returns 0 on a malformed string
+ */
+size_t parse_size(char *str);
+
+/*
+ * parse_bool() converts on/off, yes/no, true/false and 1/0.
+ * returns -1 on a malformed string
+ */
+int parse_bool(char *str);
+
+#endif /* __CONFIG_H__ */
@@ -0,0 +1,575 @@
+/* Control port file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+#include "csapp.h"
+#include "cache.h"
+#include "config.h"
+#include "control.h"
+#include "slab.h"
+#include "dcache.h"
+#include "snapshot.h"
+#include "http.h"
+#include "inflight.h"
+#include "upstream.h"
+#include "dns.h"
+#include "engine.h"
+#include "lb.h"
+#include "health.h"
+#include "hedge.h"
+#include "urlkey.h"
+#include "memfd.h"
+#include "compress.h"
+#include "dedup.h"
+#include "pressure.h"
+#include "purge.h"
+
+//#define DEBUG // uncomment this line to enable debugging
+
+#ifdef DEBUG
+/* When debugging is enabled, these form aliases to useful functions */
+#define dbg_printf(...) printf(__VA_ARGS__)
+#else
+/* When debugging is disabled, no code gets generated for these */
+#define dbg_printf(...)
+#endif
+
+static cache_t *ctl_cache;
+static int ctl_listenfd;
+
+/* serializes config changes coming from the control port */
+static sem_t config_mutex;
+
+static void *control_thread(void *vargp);
+static void control_serve(int fd);
+
+/*
+ * open_local_listenfd() is open_listenfd() restricted to the
+ * loopback address, the control port must not be reachable remotely
+ */
+static int open_local_listenfd(char *port)
+{
+    struct addrinfo hints, *listp, *p;
+    int listenfd = -1, rc, optval = 1;
+
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICSERV | AI_NUMERICHOST;
+    if((rc = getaddrinfo("127.0.0.1", port, &hints, &listp)) != 0)
+    {
+        fprintf(stderr, "control: getaddrinfo failed (port %s): %s\n",
+                        port, gai_strerror(rc));
+        return -1;
+    }
+
+    for(p = listp; p; p = p->ai_next)
+    {
+        if((listenfd = socket(p->ai_family, p->ai_socktype,
+                                            p->ai_protocol)) < 0)
+            continue;
+        setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR,
+                        (const void *)&optval, sizeof(int));
+        if(bind(listenfd, p->ai_addr, p->ai_addrlen) == 0 &&
+                        listen(listenfd, LISTENQ) == 0)
+            break;
+        close(listenfd);
+        listenfd = -1;
+    }
+
+    freeaddrinfo(listp);
+    return listenfd;
+}
+
+/*
+ * control_start() opens the control port and serves it from a
+ * detached thread. returns -1 if the port could not be opened
+ */
+int control_start(cache_t *cache, char *port)
+{
+    pthread_t tid;
+
+    Sem_init(&config_mutex, 0, 1);
+    if((ctl_listenfd = open_local_listenfd(port)) < 0)
+        return -1;
+
+    ctl_cache = cache;
+    Pthread_create(&tid, NULL, control_thread, NULL);
+    return 0;
+}
+
+/*
+ * control_apply() pushes the limits in the global config to the cache
+ */
+void control_apply(cache_t *cache)
+{
+    cache_set_limits(cache, config.cache_size, config.max_object_size);
+    if(config.disk_dir[0] != '\0')
+        dcache_set_capacity(config.disk_size);
+}
+
+/*
+ * control connections are served one at a time, admin traffic is
+ * rare and this keeps config changes ordered
+ */
+static void *control_thread(void *vargp)
+{
+    struct sockaddr_storage clientaddr;
+    socklen_t clientlen;
+    int connfd;
+
+    Pthread_detach(pthread_self());
+    while(1)
+    {
+        clientlen = sizeof(struct sockaddr_storage);
+        if((connfd = accept(ctl_listenfd, (SA *)&clientaddr,
+                                        &clientlen)) < 0)
+            continue;
+        control_serve(connfd);
+        close(connfd);
+    }
+    return NULL;
+}
+
+/* writes a formatted reply line to the control connection */
+static void reply(int fd, const char *fmt, ...)
+{
+    char buf[MAXLINE];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(buf, MAXLINE, fmt, ap);
+    va_end(ap);
+    rio_writen(fd, buf, strlen(buf));
+}
+
+/* "set <key> <value>" */
+static void cmd_set(int fd, char *key, char *value)
+{
+    proxy_config_t next;
+
+    if(!strcmp(key, "shards") || !strcmp(key, "event_loops") || 
+       !strcmp(key, "handoff_threads") ||
+       !strcmp(key, "control_port") || !strcmp(key, "upstream_groups") ||
+       !strcmp(key, "hugepages") || !strcmp(key, "memfd_arena") || 
+       !strcmp(key, "disk_dir") || !strcmp(key, "purge_tag_header") ||
+       !strcmp(key, "disk_segment_size") || !strncmp(key, "snapshot_", 9))
+    {
+        reply(fd, "ERR %s can only be changed at startup\n", key);
+        return;
+    }
+
+    P(&config_mutex);
+    next = config;
+    if(config_set(&next, key, value) < 0)
+    {
+        V(&config_mutex);
+        reply(fd, "ERR bad setting %s\n", key);
+        return;
+    }
+    config = next;
+    control_apply(ctl_cache);
+    V(&config_mutex);
+    reply(fd, "OK\n");
+}
+
+/* "reload": re-read the config file, startup-only keys are kept */
+static void cmd_reload(int fd)
+{
+    proxy_config_t next;
+
+    if(config.config_file[0] == '\0')
+    {
+        reply(fd, "ERR no config file\n");
+        return;
+    }
+
+    P(&config_mutex);
+    next = config;
+    if(config_load_file(&next, config.config_file) < 0)
+    {
+        V(&config_mutex);
+        reply(fd, "ERR could not load %s\n", config.config_file);
+        return;
+    }
+    if(next.shards != config.shards || next.hugepages != config.hugepages ||
+       next.memfd_arena != config.memfd_arena ||
+       next.event_loops != config.event_loops ||
+       next.handoff_threads != config.handoff_threads ||
+       strcmp(next.upstream_groups, config.upstream_groups) ||
+       strcmp(next.disk_dir, config.disk_dir) ||
+       next.disk_segment_size != config.disk_segment_size ||
+       strcmp(next.snapshot_path, config.snapshot_path) ||
+       next.snapshot_interval != config.snapshot_interval ||
+       strcmp(next.purge_tag_header, config.purge_tag_header))
+        reply(fd, "startup-only settings ignored until restart\n");
+    next.shards = config.shards;
+    next.event_loops = config.event_loops;
+    next.handoff_threads = config.handoff_threads;
+    strcpy(next.upstream_groups, config.upstream_groups);
+    next.hugepages = config.hugepages;
+    next.memfd_arena = config.memfd_arena;
+    strcpy(next.disk_dir, config.disk_dir);
+    next.disk_segment_size = config.disk_segment_size;
+    strcpy(next.snapshot_path, config.snapshot_path);
+    next.snapshot_interval = config.snapshot_interval;
+    strcpy(next.purge_tag_header, config.purge_tag_header);
+    strcpy(next.control_port, config.control_port);
+    config = next;
+    control_apply(ctl_cache);
+    V(&config_mutex);
+    reply(fd, "OK\n");
+}
+
+/* "config" */
+static void cmd_config(int fd)
+{
+    reply(fd, "cache_size %lu\n", config.cache_size);
+    reply(fd, "mem_adaptive %s\n", config.mem_adaptive ? "on" : "off");
+    reply(fd, "mem_cgroup %s\n", config.mem_cgroup);
+    reply(fd, "mem_high_water %d\n", config.mem_high_water);
+    reply(fd, "mem_pressure %d\n", config.mem_pressure);
+    reply(fd, "mem_min_cache %lu\n", config.mem_min_cache);
+    reply(fd, "max_object_size %lu\n", config.max_object_size);
+    reply(fd, "shards %d\n", config.shards);
+    reply(fd, "event_loops %d\n", config.event_loops);
+    reply(fd, "handoff_threads %d\n", config.handoff_threads);
+    reply(fd, "hugepages %s\n", config.hugepages ? "on" : "off");
+    reply(fd, "memfd_arena %s\n", config.memfd_arena ? "on" : "off");
+    reply(fd, "cache_dedup %s\n", config.cache_dedup ? "on" : "off");
+    reply(fd, "cache_compress %s\n", config.cache_compress ? "on" : "off");
+    reply(fd, "compress_level %d\n", config.compress_level);
+    reply(fd, "compress_min_size %lu\n", config.compress_min_size);
+    reply(fd, "compress_types %s\n", config.compress_types);
+    reply(fd, "disk_dir %s\n", config.disk_dir);
+    reply(fd, "disk_size %lu\n", config.disk_size);
+    reply(fd, "disk_segment_size %lu\n", config.disk_segment_size);
+    reply(fd, "snapshot_path %s\n", config.snapshot_path);
+    reply(fd, "snapshot_interval %d\n", config.snapshot_interval);
+    reply(fd, "default_ttl %ld\n", config.default_ttl);
+    reply(fd, "stale_grace %ld\n", config.stale_grace);
+    reply(fd, "refresh_ahead %ld\n", config.refresh_ahead);
+    reply(fd, "refresh_min_hits %d\n", config.refresh_min_hits);
+    reply(fd, "cache_key_normalize %s\n", 
+                config.cache_key_normalize ? "on" : "off");
+    reply(fd, "cache_key_strip %s\n", config.cache_key_strip);
+    reply(fd, "max_variants %d\n", config.max_variants);
+    reply(fd, "negative_ttl_4xx %ld\n", config.negative_ttl_4xx);
+    reply(fd, "negative_ttl_5xx %ld\n", config.negative_ttl_5xx);
+    reply(fd, "negative_connect_ttl %ld\n", config.negative_connect_ttl);
+    reply(fd, "stale_keep %ld\n", config.stale_keep);
+    reply(fd, "sweep_batch %d\n", config.sweep_batch);
+    reply(fd, "purge_tag_header %s\n", config.purge_tag_header);
+    reply(fd, "splice_relay %s\n", config.splice_relay ? "on" : "off");
+    reply(fd, "upstream_groups %s\n", config.upstream_groups);
+    reply(fd, "health_interval %ld\n", config.health_interval);
+    reply(fd, "health_path %s\n", config.health_path);
+    reply(fd, "breaker_failures %d\n", config.breaker_failures);
+    reply(fd, "breaker_open_time %ld\n", config.breaker_open_time);
+    reply(fd, "hedge_percentile %d\n", config.hedge_percentile);
+    reply(fd, "hedge_min_delay %ld\n", config.hedge_min_delay);
+    reply(fd, "hedge_budget %d\n", config.hedge_budget);
+    reply(fd, "upstream_keepalive %s\n", 
+                config.upstream_keepalive ? "on" : "off");
+    reply(fd, "upstream_max_idle %d\n", config.upstream_max_idle);
+    reply(fd, "upstream_idle_timeout %ld\n", config.upstream_idle_timeout);
+    reply(fd, "upstream_max_lifetime %ld\n", config.upstream_max_lifetime);
+    reply(fd, "upstream_connect_timeout %ld\n", 
+                config.upstream_connect_timeout);
+    reply(fd, "upstream_attempt_timeout %ld\n", 
+                config.upstream_attempt_timeout);
+    reply(fd, "upstream_race_delay %ld\n", config.upstream_race_delay);
+    reply(fd, "dns_ttl %ld\n", config.dns_ttl);
+    reply(fd, "dns_negative_ttl %ld\n", config.dns_negative_ttl);
+    reply(fd, "control_port %s\n", config.control_port);
+    reply(fd, "config_file %s\n", config.config_file);
+    reply(fd, "OK\n");
+}
+
+/* "stats" */
+static void cmd_stats(int fd)
+{
+    cacheq_t *shard;
+    slab_stats_t mem;
+    dcache_stats_t disk;
+    snapshot_stats_t snap;
+    inflight_stats_t flights;
+    upstream_stats_t upstream;
+    dns_stats_t dns;
+    engine_stats_t engine;
+    health_stats_t health;
+    hedge_stats_t hedge;
+    urlkey_stats_t keys;
+    memfd_stats_t memfd;
+    compress_stats_t cz;
+    dedup_stats_t dd;
+    pressure_stats_t pressure;
+    purge_stats_t purge;
+    int i;
+
+    slab_get_stats(&mem);
+    reply(fd, "cache_size %lu/%lu\n", cache_total_size(ctl_cache),
+                                      ctl_cache->max_cache_size);
+    reply(fd, "cache_timers %lu\n", cache_timers(ctl_cache));
+    reply(fd, "cache_swept %lu\n", ctl_cache->swept);
+    reply(fd, "cache_swept_bytes %lu\n", ctl_cache->swept_bytes);
+    // real memory behind the logical cache_size; fragmentation is the 
+    // share of the mapped arenas not holding requested bytes
+    reply(fd, "mem_arena %lu\n", mem.arena_bytes);
+    reply(fd, "mem_hugepage %lu\n", mem.hugepage_bytes);
+    reply(fd, "mem_memfd %lu\n", mem.memfd_bytes);
+    reply(fd, "mem_slab %lu\n", mem.slab_bytes);
+    reply(fd, "mem_used %lu\n", mem.used_bytes);
+    reply(fd, "mem_requested %lu\n", mem.requested_bytes);
+    reply(fd, "mem_large %lu\n", mem.large_bytes);
+    reply(fd, "mem_fragmentation %.1f%%\n", mem.arena_bytes == 0 ? 0.0 :
+                100.0 * (mem.arena_bytes - mem.requested_bytes) / 
+                mem.arena_bytes);
+    reply(fd, "mem_released %lu\n", mem.released_bytes);
+    // what the cache budget follows with mem_adaptive
+    pressure_get_stats(&pressure);
+    reply(fd, "mem_cgroup_limit %lu\n", pressure.limit);
+    reply(fd, "mem_cgroup_current %lu\n", pressure.current);
+    reply(fd, "mem_psi_avg10 %.2f\n", pressure.psi);
+    reply(fd, "mem_shrinks %lu\n", pressure.shrinks);
+    reply(fd, "mem_grows %lu\n", pressure.grows);
+    memfd_get_stats(&memfd);
+    reply(fd, "memfd_sends %lu\n", memfd.sends);
+    reply(fd, "memfd_sent_bytes %lu\n", memfd.sent_bytes);
+    reply(fd, "memfd_drain_aborts %lu\n", memfd.drain_aborts);
+    // what the cache would hold were nothing compressed
+    compress_get_stats(&cz);
+    reply(fd, "cache_effective_size %lu\n", 
+                cache_total_size(ctl_cache) + cache_saved_size(ctl_cache));
+    reply(fd, "compress_stored %lu\n", cz.compressed);
+    reply(fd, "compress_skipped %lu\n", cz.skipped);
+    reply(fd, "compress_ratio %.1f%%\n", cz.raw_bytes == 0 ? 0.0 :
+                100.0 * cz.stored_bytes / cz.raw_bytes);
+    reply(fd, "compress_served_encoded %lu\n", cz.served_encoded);
+    reply(fd, "compress_served_inflated %lu\n", cz.served_inflated);
+    reply(fd, "compress_deflate_us %lu\n", cz.deflate_us);
+    reply(fd, "compress_inflate_us %lu\n", cz.inflate_us);
+    // the ratio of the body bytes lines refer to over those stored
+    dedup_get_stats(&dd);
+    reply(fd, "dedup_entries %lu\n", dd.entries);
+    reply(fd, "dedup_bytes %lu\n", dd.bytes);
+    reply(fd, "dedup_shared_bytes %lu\n", dd.shared_bytes);
+    reply(fd, "dedup_hits %lu\n", dd.hits);
+    reply(fd, "dedup_mismatches %lu\n", dd.mismatches);
+    reply(fd, "dedup_ratio %.2f\n", dd.bytes == 0 ? 1.0 :
+                (double)(dd.bytes + dd.shared_bytes) / dd.bytes);
+    purge_get_stats(&purge);
+    reply(fd, "purge_keys %lu\n", purge.keys);
+    reply(fd, "purge_nodes %lu\n", purge.nodes);
+    reply(fd, "purge_tags %lu\n", purge.tags);
+    reply(fd, "purge_tag_refs %lu\n", purge.tag_refs);
+    reply(fd, "purge_runs %lu\n", purge.purges);
+    reply(fd, "purge_purged %lu\n", purge.purged);
+    reply(fd, "purge_soft_purged %lu\n", purge.soft_purged);
+    reply(fd, "http_stored %lu\n", http_stats.stored);
+    reply(fd, "http_uncacheable %lu\n", http_stats.uncacheable);
+    reply(fd, "http_revalidated %lu\n", http_stats.revalidated);
+    reply(fd, "http_not_modified %lu\n", http_stats.not_modified);
+    reply(fd, "http_stale_served %lu\n", http_stats.stale_served);
+    reply(fd, "http_refreshes %lu\n", http_stats.refreshes);
+    reply(fd, "http_relayed %lu\n", http_stats.relayed);
+    reply(fd, "http_relayed_bytes %lu\n", http_stats.relayed_bytes);
+    reply(fd, "http_variants %lu\n", http_stats.variants);
+    reply(fd, "http_variant_evictions %lu\n", http_stats.variant_evictions);
+    reply(fd, "http_negative_stored %lu\n", http_stats.negative_stored);
+    reply(fd, "http_negative_hits %lu\n", http_stats.negative_hits);
+    reply(fd, "http_negative_bypassed %lu\n", http_stats.negative_bypassed);
+    urlkey_get_stats(&keys);
+    reply(fd, "key_made %lu\n", keys.keys);
+    reply(fd, "key_rewritten %lu\n", keys.rewritten);
+    reply(fd, "key_stripped_params %lu\n", keys.stripped);
+    inflight_get_stats(&flights);
+    reply(fd, "inflight_active %lu\n", flights.active);
+    reply(fd, "inflight_led %lu\n", flights.led);
+    reply(fd, "inflight_followed %lu\n", flights.followed);
+    reply(fd, "inflight_aborted %lu\n", flights.aborted);
+    reply(fd, "inflight_resumed %lu\n", flights.resumed);
+    upstream_get_stats(&upstream);
+    reply(fd, "upstream_connects %lu\n", upstream.connects);
+    reply(fd, "upstream_reused %lu\n", upstream.reused);
+    reply(fd, "upstream_retries %lu\n", upstream.retries);
+    reply(fd, "upstream_idle %lu\n", upstream.idle);
+    reply(fd, "upstream_raced %lu\n", upstream.raced);
+    reply(fd, "upstream_timeouts %lu\n", upstream.timeouts);
+    reply(fd, "upstream_swept %lu\n", upstream.swept);
+    engine_get_stats(&engine);
+    reply(fd, "engine_loops %lu\n", engine.loops);
+    reply(fd, "engine_conns %lu\n", engine.conns);
+    reply(fd, "engine_accepted %lu\n", engine.accepted);
+    reply(fd, "engine_served %lu\n", engine.served);
+    reply(fd, "engine_handoffs %lu\n", engine.handoffs);
+    reply(fd, "engine_handoffs_waiting %lu\n", engine.waiting);
+    reply(fd, "engine_handoffs_dropped %lu\n", engine.dropped);
+    reply(fd, "engine_draining %lu\n", engine.draining);
+    health_get_stats(&health);
+    reply(fd, "health_entries %lu\n", health.entries);
+    reply(fd, "health_trips %lu\n", health.trips);
+    reply(fd, "health_rejected %lu\n", health.rejected);
+    reply(fd, "health_trials %lu\n", health.trials);
+    reply(fd, "health_probes %lu\n", health.probes);
+    reply(fd, "health_probe_failures %lu\n", health.probe_failures);
+    reply(fd, "health_stale_served %lu\n", health.stale_served);
+    reply(fd, "health_connects_cached %lu\n", health.connects_cached);
+    hedge_get_stats(&hedge);
+    reply(fd, "hedge_requests %lu\n", hedge.requests);
+    reply(fd, "hedge_sent %lu\n", hedge.hedged);
+    reply(fd, "hedge_won %lu\n", hedge.won);
+    reply(fd, "hedge_denied %lu\n", hedge.denied);
+    reply(fd, "hedge_rate %.2f%%\n", hedge.requests == 0 ? 0.0 :
+                100.0 * hedge.hedged / hedge.requests);
+    reply(fd, "hedge_delay_ms %ld\n", hedge.delay);
+    dns_get_stats(&dns);
+    reply(fd, "dns_entries %lu\n", dns.entries);
+    reply(fd, "dns_hits %lu\n", dns.hits);
+    reply(fd, "dns_misses %lu\n", dns.misses);
+    reply(fd, "dns_negative_hits %lu\n", dns.negative_hits);
+    reply(fd, "dns_refreshes %lu\n", dns.refreshes);
+    reply(fd, "dns_failures %lu\n", dns.failures);
+    reply(fd, "dns_stale %lu\n", dns.stale);
+    if(config.disk_dir[0] != '\0')
+    {
+        dcache_get_stats(&disk);
+        reply(fd, "disk_size %lu/%lu\n", disk.disk_bytes, config.disk_size);
+        reply(fd, "disk_live %lu\n", disk.live_bytes);
+        reply(fd, "disk_entries %lu\n", disk.entries);
+        reply(fd, "disk_segments %d\n", disk.segments);
+        reply(fd, "disk_hits %lu\n", disk.hits);
+        reply(fd, "disk_demoted %lu\n", disk.demoted);
+        reply(fd, "disk_dropped %lu\n", disk.dropped);
+        reply(fd, "disk_compacted %lu\n", disk.compacted);
+    }
+    if(config.snapshot_path[0] != '\0')
+    {
+        snapshot_get_stats(&snap);
+        reply(fd, "snapshot_loaded %lu\n", snap.loaded);
+        reply(fd, "snapshot_hits %lu\n", snap.hits);
+        reply(fd, "snapshot_invalid %lu\n", snap.invalid);
+        reply(fd, "snapshot_written %lu\n", snap.written);
+        reply(fd, "snapshot_last_write %ld\n", (long)snap.last_write);
+    }
+    for(i = 0; i < ctl_cache->nshards; i++)
+    {
+        shard = &ctl_cache->shards[i];
+        reply(fd, "shard %d %lu/%lu\n", i, shard->cache_size,
+                                        shard->max_size);
+    }
+    reply(fd, "OK\n");
+}
+
+/* "slabs" */
+static void cmd_slabs(int fd)
+{
+    size_t size, used, carved;
+    int i;
+
+    for(i = 0; slab_class_stats(i, &size, &used, &carved) == 0; i++)
+        reply(fd, "class %d size %lu used %lu carved %lu\n",
+                    i, size, used, carved);
+    reply(fd, "OK\n");
+}
+
+/* "snapshot" */
+static void cmd_snapshot(int fd)
+{
+    if(config.snapshot_path[0] == '\0')
+        reply(fd, "ERR no snapshot_path\n");
+    else if(snapshot_write(ctl_cache, config.snapshot_path) < 0)
+        reply(fd, "ERR snapshot failed\n");
+    else
+        reply(fd, "OK\n");
+}
+
+/* "upstreams" */
+static void cmd_upstreams(int fd)
+{
+    group_t *g;
+    backend_t *b;
+    int i;
+
+    for(g = lb_groups(); g != NULL; g = g->next_group)
+    {
+        reply(fd, "group %s %s\n", g->name, lb_policy_name(g->policy));
+        for(i = 0; i < g->nbackends; i++)
+        {
+            b = &g->backends[i];
+            reply(fd, "backend %s:%s %s outstanding %d requests %lu\n",
+                        b->host, b->port, b->health ? 
+                        health_state_name(b->health->state) : "closed",
+                        b->outstanding, b->requests);
+        }
+    }
+    reply(fd, "OK\n");
+}
+
+/*
+ * "purge <key|prefix|tag> <arg>" and "softpurge ...": keys and prefixes
+ * are URIs, normalized the way request URIs are
+ */
+static void cmd_purge(int fd, char *kind, char *arg, bool soft)
+{
+    char key[MAXLINE];
+    purge_kind_t k;
+
+    if(!strcmp(kind, "key"))
+        k = PURGE_KEY;
+    else if(!strcmp(kind, "prefix"))
+        k = PURGE_PREFIX;
+    else if(!strcmp(kind, "tag"))
+        k = PURGE_TAG;
+    else
+    {
+        reply(fd, "ERR bad purge %s\n", kind);
+        return;
+    }
+
+    if(k == PURGE_TAG)
+        strcpy(key, arg);
+    else
+        urlkey_make(arg, key, MAXLINE);
+    reply(fd, "purged %lu\n", purge_run(ctl_cache, k, key, soft));
+    reply(fd, "OK\n");
+}
+
+/* reads and executes commands until the peer closes or sends quit */
+static void control_serve(int fd)
+{
+    char buf[MAXLINE], cmd[MAXLINE], key[MAXLINE], value[MAXLINE];
+    rio_t rio;
+    int n;
+
+    rio_readinitb(&rio, fd);
+    while(rio_readlineb(&rio, buf, MAXLINE) > 0)
+    {
+        n = sscanf(buf, "%s %s %s", cmd, key, value);
+        if(n <= 0)
+            continue;
+
+        dbg_printf("control: %s", buf);
+        if(!strcmp(cmd, "set") && n == 3)
+            cmd_set(fd, key, value);
+        else if(!strcmp(cmd, "reload"))
+            cmd_reload(fd);
+        else if(!strcmp(cmd, "config"))
+            cmd_config(fd);
+        else if(!strcmp(cmd, "stats"))
+            cmd_stats(fd);
+        else if(!strcmp(cmd, "slabs"))
+            cmd_slabs(fd);
+        else if(!strcmp(cmd, "snapshot"))
+            cmd_snapshot(fd);
+        else if(!strcmp(cmd, "upstreams"))
+            cmd_upstreams(fd);
+        else if(!strcmp(cmd, "purge") && n == 3)
+            cmd_purge(fd, key, value, false);
+        else if(!strcmp(cmd, "softpurge") && n == 3)
+            cmd_purge(fd, key, value, true);
+        else if(!strcmp(cmd, "quit"))
+            return;
+        else
+            reply(fd, "ERR unknown command\n");
+    }
+}
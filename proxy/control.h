@@ -0,0 +1,43 @@
+/* Control port header file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+
+/*
+ * The control port is a line based admin interface bound to the
+ * loopback address only, e.g. "nc localhost 15213". Commands:
+ *
+ *   set <key> <value>   change a config key and apply it live
+ *   reload              re-read the config file and apply it
+ *   config              print the running configuration
+ *   stats               print cache usage per shard and memory use
+ *   slabs               print the slab size classes
+ *   snapshot            write a cache snapshot now
+ *   upstreams           print the upstream groups and their backends
+ *   purge key <uri>     drop the cached responses of uri
+ *   purge prefix <uri>  drop those of every key starting with uri
+ *   purge tag <tag>     drop every response the origin tagged tag
+ *   softpurge ...       mark them stale instead (purge.h)
+ *   quit                close the control connection
+ *
+ * Every command answers with zero or more lines of output followed
+ * by "OK" or "ERR <reason>".
+ */
+
+#ifndef __CONTROL_H__
+#define __CONTROL_H__
+
+#include "cache.h"
+
+/*
+ * control_start() opens the control port and serves it from a
+ * detached thread. returns -1 if the port could not be opened
+ */
+int control_start(cache_t *cache, char *port);
+
+/*
+ * control_apply() pushes the limits in the global config to the cache
+ */
+void control_apply(cache_t *cache);
+
+#endif /* __CONTROL_H__ */
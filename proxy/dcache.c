@@ -0,0 +1,707 @@
+/* Disk cache file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+#include "csapp.h"
+#include "cache.h"
+#include "dcache.h"
+#include "http.h"
+#include "compress.h"
+#include "purge.h"
+#include <sys/sendfile.h>
+
+//#define DEBUG // uncomment this line to enable debugging
+
+#ifdef DEBUG
+/* When debugging is enabled, these form aliases to useful functions */
+#define dbg_printf(...) printf(__VA_ARGS__)
+#else
+/* When debugging is disabled, no code gets generated for these */
+#define dbg_printf(...)
+#endif
+
+#define DCACHE_MAGIC 0x64636832     /* "dch2" */
+#define DCACHE_BUCKETS 4096
+#define COPY_CHUNK (64*1024)
+/* longest cache directory, leaving room in a path for any file name */
+#define DCACHE_DIR_MAX (MAXLINE - 256)
+
+/* on-disk record header, followed by the key, the header block of the
+ * response and its body */
+typedef struct drec
+{
+    uint32_t magic;
+    uint32_t keylen;
+    uint64_t len;           // header block + body
+    uint32_t hdrlen;
+    uint32_t pad;
+    int64_t expires;
+}drec_t;
+
+/* one segment file */
+typedef struct dseg
+{
+    int id;
+    int fd;
+    off_t len;              // bytes appended so far
+    size_t live;            // bytes of records still in the index
+    int refcnt;             // the segment list plus readers
+    struct dseg *next;
+}dseg_t;
+
+/* index entry: where the response stored under key lives */
+typedef struct dentry
+{
+    char *key;
+    dseg_t *seg;
+    off_t off;              // offset of the response in seg
+    size_t len;             // header block + body
+    size_t reclen;          // record header + key + response
+    size_t hdrlen;
+    time_t expires;
+    char *tags;             // tag header of the response, for purges
+    struct dentry *next;
+}dentry_t;
+
+/* queued demotion */
+typedef struct demote
+{
+    char *key;
+    webhdr_t *hdr;
+    webobj_t *obj;
+    time_t expires;
+    struct demote *next;
+}demote_t;
+
+static char dc_dir[DCACHE_DIR_MAX];
+static size_t dc_capacity, dc_segsize;
+
+/* index, segment list and stats; the writer thread is the only one
+ * appending, so it writes files without holding the mutex */
+static sem_t dc_mutex;
+static dentry_t *buckets[DCACHE_BUCKETS];
+static dseg_t *seg_head, *seg_tail;     // oldest ... active
+static int next_seg_id = 1;
+static dcache_stats_t dc_stats;
+
+/* demotion queue */
+static sem_t q_mutex, q_items;
+static demote_t *q_head, *q_tail;
+static int q_len;
+
+static void *dcache_writer(void *vargp);
+
+/* drops a reference, the last one closes the file */
+static void seg_put(dseg_t *seg)
+{
+    if(__sync_sub_and_fetch(&seg->refcnt, 1) == 0)
+    {
+        close(seg->fd);
+        free(seg);
+    }
+}
+
+static void seg_path(char *buf, int id)
+{
+    snprintf(buf, MAXLINE, "%s/seg-%06d.log", dc_dir, id);
+}
+
+/* opens a new active segment, called by the writer */
+static dseg_t *seg_create(void)
+{
+    char path[MAXLINE];
+    dseg_t *seg;
+
+    if((seg = malloc(sizeof(dseg_t))) == NULL)
+        return NULL;
+
+    seg->id = next_seg_id++;
+    seg_path(path, seg->id);
+    if((seg->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600)) < 0)
+    {
+        fprintf(stderr, "dcache: cannot create %s: %s\n",
+                        path, strerror(errno));
+        free(seg);
+        return NULL;
+    }
+    seg->len = 0;
+    seg->live = 0;
+    seg->refcnt = 1;
+    seg->next = NULL;
+
+    P(&dc_mutex);
+    if(seg_tail == NULL)
+        seg_head = seg;
+    else
+        seg_tail->next = seg;
+    seg_tail = seg;
+    dc_stats.segments++;
+    V(&dc_mutex);
+    return seg;
+}
+
+/* index lookup, called with dc_mutex held */
+static dentry_t *index_find(char *key)
+{
+    dentry_t *e;
+
+    for(e = buckets[hash_key(key) % DCACHE_BUCKETS]; e; e = e->next)
+        if(!strcmp(e->key, key))
+            return e;
+    return NULL;
+}
+
+/* points key at a new record, called with dc_mutex held */
+static void index_put(char *key, dseg_t *seg, off_t off, size_t len,
+                      size_t reclen, size_t hdrlen, time_t expires,
+                      char *tags)
+{
+    dentry_t *e;
+    unsigned long b;
+
+    if((e = index_find(key)) != NULL)
+    {
+        e->seg->live -= e->reclen;
+        dc_stats.live_bytes -= e->reclen;
+    }
+    else
+    {
+        if((e = malloc(sizeof(dentry_t))) == NULL)
+            return;
+        if((e->key = strdup(key)) == NULL)
+        {
+            free(e);
+            return;
+        }
+        e->tags = NULL;
+        b = hash_key(key) % DCACHE_BUCKETS;
+        e->next = buckets[b];
+        buckets[b] = e;
+        dc_stats.entries++;
+    }
+    if(tags != e->tags)
+    {
+        free(e->tags);
+        e->tags = tags ? strdup(tags) : NULL;
+    }
+
+    e->seg = seg;
+    e->off = off;
+    e->len = len;
+    e->reclen = reclen;
+    e->hdrlen = hdrlen;
+    e->expires = expires;
+    seg->live += reclen;
+    dc_stats.live_bytes += reclen;
+}
+
+/*
+ * seg_drop() removes a sealed segment and every index entry in it.
+ * The file is unlinked right away; readers still sending from it keep
+ * the descriptor open through their reference.
+ */
+static void seg_drop(dseg_t *seg)
+{
+    char path[MAXLINE];
+    dentry_t **pp, *e;
+    dseg_t **sp;
+    int b;
+
+    P(&dc_mutex);
+    for(b = 0; b < DCACHE_BUCKETS; b++)
+    {
+        pp = &buckets[b];
+        while((e = *pp) != NULL)
+        {
+            if(e->seg == seg)
+            {
+                *pp = e->next;
+                dc_stats.live_bytes -= e->reclen;
+                dc_stats.entries--;
+                free(e->key);
+                free(e->tags);
+                free(e);
+            }
+            else
+                pp = &e->next;
+        }
+    }
+
+    for(sp = &seg_head; *sp != seg; sp = &(*sp)->next)
+        ;
+    *sp = seg->next;
+    dc_stats.disk_bytes -= seg->len;
+    dc_stats.segments--;
+    V(&dc_mutex);
+
+    seg_path(path, seg->id);
+    unlink(path);
+    seg_put(seg);
+}
+
+/*
+ * active_for() returns the segment the next reclen bytes go to,
+ * sealing the active one when the record does not fit
+ */
+static dseg_t *active_for(size_t reclen)
+{
+    dseg_t *seg = seg_tail;
+
+    if(seg == NULL || (seg->len > 0 && seg->len + reclen > dc_segsize))
+        seg = seg_create();
+    return seg;
+}
+
+/* accounts an appended record and indexes it */
+static void commit_record(dseg_t *seg, char *key, off_t body, size_t len,
+                          size_t reclen, size_t hdrlen, time_t expires,
+                          char *tags)
+{
+    P(&dc_mutex);
+    seg->len += reclen;
+    dc_stats.disk_bytes += reclen;
+    index_put(key, seg, body, len, reclen, hdrlen, expires, tags);
+    dc_stats.demoted++;
+    V(&dc_mutex);
+}
+
+/* writes the record header and key at off */
+static bool write_header(dseg_t *seg, off_t off, char *key, size_t len,
+                         size_t hdrlen, time_t expires)
+{
+    drec_t hdr;
+    size_t keylen = strlen(key);
+
+    hdr.magic = DCACHE_MAGIC;
+    hdr.keylen = keylen;
+    hdr.len = len;
+    hdr.hdrlen = hdrlen;
+    hdr.pad = 0;
+    hdr.expires = expires;
+    if(pwrite(seg->fd, &hdr, sizeof(hdr), off) != sizeof(hdr) ||
+       pwrite(seg->fd, key, keylen, off + sizeof(hdr)) != (ssize_t)keylen)
+        return false;
+    return true;
+}
+
+/* appends a demoted response to the active segment */
+static void append_object(demote_t *d)
+{
+    char tags[MAXLINE];
+    size_t len, reclen;
+    webobj_t *raw;
+    segment_t *s;
+    dseg_t *seg;
+    off_t off, body;
+
+    // the disk tier sends its records as they are, uncompressed
+    if(d->obj->encoding != WEBOBJ_IDENTITY)
+    {
+        if((raw = inflate_object(d->obj)) == NULL)
+            return;
+        webobj_put(d->obj);
+        d->obj = raw;
+    }
+    len = d->hdr->len + d->obj->size;
+    reclen = sizeof(drec_t) + strlen(d->key) + len;
+
+    if((seg = active_for(reclen)) == NULL)
+        return;
+
+    off = seg->len;
+    if(!write_header(seg, off, d->key, len, d->hdr->len, d->expires))
+        return;
+
+    body = off + sizeof(drec_t) + strlen(d->key);
+    if(pwrite(seg->fd, d->hdr->data, d->hdr->len, body) != 
+            (ssize_t)d->hdr->len)
+        return;
+    off = body + d->hdr->len;
+    for(s = d->obj->head; s != NULL; s = s->next)
+    {
+        if(pwrite(seg->fd, s->data, s->len, off) != (ssize_t)s->len)
+            return;
+        off += s->len;
+    }
+
+    commit_record(seg, d->key, body, len, reclen, d->hdr->len, d->expires,
+                  purge_tags(d->hdr->data, d->hdr->len, tags, MAXLINE) ?
+                  tags : NULL);
+}
+
+/*
+ * copy_forward() moves one live record of a segment being compacted
+ * into the active segment, unless the key was re-demoted meanwhile
+ */
+static void copy_forward(char *key, dseg_t *from, off_t src, size_t len,
+                         size_t hdrlen, time_t expires)
+{
+    size_t reclen = sizeof(drec_t) + strlen(key) + len, n, done;
+    char buf[COPY_CHUNK];
+    dentry_t *e;
+    dseg_t *seg;
+    off_t body;
+    ssize_t rc;
+
+    if((seg = active_for(reclen)) == NULL || seg == from)
+        return;
+    if(!write_header(seg, seg->len, key, len, hdrlen, expires))
+        return;
+
+    body = seg->len + sizeof(drec_t) + strlen(key);
+    for(done = 0; done < len; done += rc)
+    {
+        n = len - done < COPY_CHUNK ? len - done : COPY_CHUNK;
+        if((rc = pread(from->fd, buf, n, src + done)) <= 0 ||
+           pwrite(seg->fd, buf, rc, body + done) != rc)
+            return;
+    }
+
+    P(&dc_mutex);
+    e = index_find(key);
+    if(e && e->seg == from && e->off == src)
+    {
+        seg->len += reclen;
+        dc_stats.disk_bytes += reclen;
+        index_put(key, seg, body, len, reclen, hdrlen, expires, e->tags);
+        dc_stats.compacted++;
+    }
+    else
+    {
+        // superseded; the bytes stay as dead space in the active segment
+        seg->len += reclen;
+        dc_stats.disk_bytes += reclen;
+    }
+    V(&dc_mutex);
+}
+
+/*
+ * compact() enforces the capacity by dropping the oldest segments, then
+ * rewrites at most one sparse sealed segment per call
+ */
+static void compact(void)
+{
+    dseg_t *seg, *victim = NULL;
+    dentry_t *e, *live = NULL, *next;
+    int b;
+
+    while(1)
+    {
+        P(&dc_mutex);
+        seg = seg_head;
+        if(seg == NULL || seg == seg_tail ||
+           dc_stats.disk_bytes <= dc_capacity)
+        {
+            V(&dc_mutex);
+            break;
+        }
+        V(&dc_mutex);
+        dbg_printf("dcache: over capacity, dropping segment %d\n", seg->id);
+        seg_drop(seg);
+    }
+
+    // pick the first sealed segment with too little live data and
+    // snapshot its live records
+    P(&dc_mutex);
+    for(seg = seg_head; seg != NULL && seg != seg_tail; seg = seg->next)
+    {
+        if(seg->live < DCACHE_COMPACT_RATIO * seg->len)
+        {
+            victim = seg;
+            break;
+        }
+    }
+    if(victim != NULL)
+    {
+        for(b = 0; b < DCACHE_BUCKETS; b++)
+        {
+            for(e = buckets[b]; e; e = e->next)
+            {
+                if(e->seg != victim)
+                    continue;
+                if((next = malloc(sizeof(dentry_t))) == NULL)
+                    continue;
+                *next = *e;
+                if((next->key = strdup(e->key)) == NULL)
+                {
+                    free(next);
+                    continue;
+                }
+                next->next = live;
+                live = next;
+            }
+        }
+    }
+    V(&dc_mutex);
+
+    if(victim == NULL)
+        return;
+
+    dbg_printf("dcache: compacting segment %d\n", victim->id);
+    for(e = live; e != NULL; e = next)
+    {
+        next = e->next;
+        copy_forward(e->key, victim, e->off, e->len, e->hdrlen, e->expires);
+        free(e->key);
+        free(e);
+    }
+    seg_drop(victim);
+}
+
+/*
+ * the writer thread drains the demotion queue and compacts whenever
+ * the queue has been idle for DCACHE_COMPACT_SECS
+ */
+static void *dcache_writer(void *vargp)
+{
+    struct timespec deadline;
+    demote_t *d;
+
+    Pthread_detach(pthread_self());
+    while(1)
+    {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += DCACHE_COMPACT_SECS;
+        if(sem_timedwait(&q_items, &deadline) < 0)
+        {
+            compact();
+            continue;
+        }
+
+        P(&q_mutex);
+        // dcache_purge() may have taken what was posted
+        if((d = q_head) == NULL)
+        {
+            V(&q_mutex);
+            continue;
+        }
+        q_head = d->next;
+        if(q_head == NULL)
+            q_tail = NULL;
+        q_len--;
+        V(&q_mutex);
+
+        append_object(d);
+        webobj_put(d->obj);
+        webhdr_put(d->hdr);
+        free(d->key);
+        free(d);
+
+        if(dc_stats.disk_bytes > dc_capacity)
+            compact();
+    }
+    return NULL;
+}
+
+/*
+ * dcache_init() creates dir if needed, removes stale segments and
+ * starts the writer thread. returns -1 if the directory is unusable
+ */
+int dcache_init(char *dir, size_t capacity, size_t segment_size)
+{
+    char path[MAXLINE];
+    struct dirent *ent;
+    pthread_t tid;
+    DIR *dp;
+
+    if(strlen(dir) >= DCACHE_DIR_MAX)
+    {
+        fprintf(stderr, "dcache: directory name too long: %s\n", dir);
+        return -1;
+    }
+    strcpy(dc_dir, dir);
+    dc_capacity = capacity;
+    dc_segsize = segment_size;
+
+    if(mkdir(dc_dir, 0700) < 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "dcache: cannot create %s: %s\n",
+                        dc_dir, strerror(errno));
+        return -1;
+    }
+    if((dp = opendir(dc_dir)) == NULL)
+    {
+        fprintf(stderr, "dcache: cannot open %s: %s\n",
+                        dc_dir, strerror(errno));
+        return -1;
+    }
+    while((ent = readdir(dp)) != NULL)
+    {
+        if(!strncmp(ent->d_name, "seg-", 4) &&
+                    strstr(ent->d_name, ".log") != NULL)
+        {
+            snprintf(path, MAXLINE, "%s/%s", dc_dir, ent->d_name);
+            unlink(path);
+        }
+    }
+    closedir(dp);
+
+    Sem_init(&dc_mutex, 0, 1);
+    Sem_init(&q_mutex, 0, 1);
+    Sem_init(&q_items, 0, 0);
+    Pthread_create(&tid, NULL, dcache_writer, NULL);
+    return 0;
+}
+
+/* dcache_set_capacity() changes the tier size, enforced by compaction */
+void dcache_set_capacity(size_t capacity)
+{
+    dc_capacity = capacity;
+}
+
+/*
+ * dcache_demote() queues an evicted line to be written to disk. It
+ * takes its own references to the header block and the object and
+ * never blocks; the line is dropped if the queue is full.
+ */
+void dcache_demote(cacheline_t *line)
+{
+    demote_t *d;
+
+    // the disk tier keeps one response per key, variants stay in memory,
+    // and errors are not worth a write
+    if(line->variant != NULL ||
+       HTTP_NEGATIVE(http_status(line->web_header->data,
+                                 line->web_header->len)))
+        return;
+    P(&q_mutex);
+    if(q_len >= DCACHE_QUEUE_MAX || (d = malloc(sizeof(demote_t))) == NULL)
+    {
+        dc_stats.dropped++;
+        V(&q_mutex);
+        return;
+    }
+    if((d->key = strdup(line->key)) == NULL)
+    {
+        free(d);
+        V(&q_mutex);
+        return;
+    }
+    webobj_get(line->web_object);
+    d->obj = line->web_object;
+    webhdr_get(line->web_header);
+    d->hdr = line->web_header;
+    d->expires = line->expires;
+    d->next = NULL;
+    if(q_tail == NULL)
+        q_head = d;
+    else
+        q_tail->next = d;
+    q_tail = d;
+    q_len++;
+    V(&q_mutex);
+    V(&q_items);
+}
+
+/*
+ * dcache_serve() sends the response stored under key to fd.
+ * returns true if the key was found fresh and sent
+ */
+bool dcache_serve(char *key, int fd)
+{
+    dentry_t *e;
+    dseg_t *seg;
+    off_t off;
+    size_t len;
+    ssize_t n;
+
+    P(&dc_mutex);
+    // stale copies are not revalidated from disk, the memory tier
+    // fetches the key again and demotes the new response later
+    if((e = index_find(key)) == NULL || e->expires <= time(NULL))
+    {
+        V(&dc_mutex);
+        return false;
+    }
+    seg = e->seg;
+    __sync_add_and_fetch(&seg->refcnt, 1);
+    off = e->off;
+    len = e->len;
+    dc_stats.hits++;
+    V(&dc_mutex);
+
+    dbg_printf("dcache: hit %s, %lu bytes\n", key, len);
+    while(len > 0)
+    {
+        if((n = sendfile(fd, seg->fd, &off, len)) <= 0)
+        {
+            if(n < 0 && errno == EINTR)
+                continue;
+            break;
+        }
+        len -= n;
+    }
+    seg_put(seg);
+    return true;
+}
+
+/*
+ * dcache_purge() drops the entries a purge of kind and arg hits, and
+ * the demotions of them still queued. returns the entries dropped
+ */
+size_t dcache_purge(purge_kind_t kind, char *arg)
+{
+    char tags[MAXLINE];
+    dentry_t **pp, *e;
+    demote_t **dp, *d;
+    size_t n = 0;
+    int b, last = DCACHE_BUCKETS - 1;
+
+    // a key can only be in its own bucket
+    b = 0;
+    if(kind == PURGE_KEY)
+        b = last = hash_key(arg) % DCACHE_BUCKETS;
+    P(&dc_mutex);
+    for(; b <= last; b++)
+    {
+        pp = &buckets[b];
+        while((e = *pp) != NULL)
+        {
+            if(!purge_match(kind, arg, e->key, e->tags))
+            {
+                pp = &e->next;
+                continue;
+            }
+            // the record stays behind as dead space until compaction
+            *pp = e->next;
+            e->seg->live -= e->reclen;
+            dc_stats.live_bytes -= e->reclen;
+            dc_stats.entries--;
+            free(e->key);
+            free(e->tags);
+            free(e);
+            n++;
+        }
+    }
+    V(&dc_mutex);
+
+    P(&q_mutex);
+    q_tail = NULL;
+    for(dp = &q_head; (d = *dp) != NULL; )
+    {
+        if(!purge_match(kind, arg, d->key, kind == PURGE_TAG &&
+                        purge_tags(d->hdr->data, d->hdr->len, tags,
+                                   MAXLINE) ? tags : NULL))
+        {
+            q_tail = d;
+            dp = &d->next;
+            continue;
+        }
+        *dp = d->next;
+        q_len--;
+        webobj_put(d->obj);
+        webhdr_put(d->hdr);
+        free(d->key);
+        free(d);
+    }
+    V(&q_mutex);
+    return n;
+}
+
+/* dcache_get_stats() fills in the tier accounting */
+void dcache_get_stats(dcache_stats_t *stats)
+{
+    P(&dc_mutex);
+    *stats = dc_stats;
+    V(&dc_mutex);
+}
@@ -0,0 +1,91 @@
+/* Disk cache header file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+
+/*
+ * Second cache tier on local disk (or tmpfs). Responses evicted from
+ * the memory cache are demoted here instead of being dropped, with
+ * their header block and expiry time.
+ *
+ * The store is log structured: objects are appended to the active
+ * segment file in the cache directory, and an in-memory hash index
+ * maps each key to its segment, offset and length. Nothing is updated
+ * in place; a re-demoted key is appended again and the old record
+ * becomes dead space.
+ *
+ *   seg-000001.log  [hdr key body][hdr key body][hdr key body] sealed
+ *   seg-000002.log  [hdr key body][hdr key body]...            active
+ *
+ * A single background thread does all writing: it drains the demotion
+ * queue, and between batches it compacts. Sealed segments whose live
+ * bytes fell below DCACHE_COMPACT_RATIO have their live records copied
+ * forward into the active segment. When the tier is over its size, the
+ * oldest segment is dropped with all its records.
+ *
+ * Fresh disk hits are sent straight from the segment file with
+ * sendfile(), header block and body in one go; stale ones count as
+ * misses.
+ * Segment files are unlinked as soon as they are dropped, and a reader
+ * holds a reference that keeps the descriptor open until it is done.
+ * Segments from a previous run are discarded at startup.
+ */
+
+#ifndef __DCACHE_H__
+#define __DCACHE_H__
+
+#include "csapp.h"
+#include "cache.h"
+#include "webobj.h"
+#include "purge.h"
+
+#define DCACHE_SEGMENT_SIZE (64*1024*1024)  /* default segment file size */
+#define DCACHE_SIZE (1024*1024*1024)        /* default tier capacity */
+#define DCACHE_QUEUE_MAX 256        /* demotions waiting to be written */
+#define DCACHE_COMPACT_RATIO 0.5    /* compact segments less live than this */
+#define DCACHE_COMPACT_SECS 1       /* compaction check interval */
+
+typedef struct dcache_stats
+{
+    size_t disk_bytes;       // bytes in all segment files
+    size_t live_bytes;       // bytes of records still indexed
+    size_t entries;          // indexed keys
+    int segments;            // segment files
+    size_t hits;             // objects served from disk
+    size_t demoted;          // objects written by demotion
+    size_t dropped;          // demotions dropped, queue was full
+    size_t compacted;        // records copied forward by compaction
+}dcache_stats_t;
+
+/*
+ * dcache_init() creates dir if needed, removes stale segments and
+ * starts the writer thread. returns -1 if the directory is unusable
+ */
+int dcache_init(char *dir, size_t capacity, size_t segment_size);
+
+/* dcache_set_capacity() changes the tier size, enforced by compaction */
+void dcache_set_capacity(size_t capacity);
+
+/*
+ * dcache_demote() queues an evicted line to be written to disk. It
+ * takes its own references to the header block and the object and
+ * never blocks; the line is dropped if the queue is full.
+ */
+void dcache_demote(cacheline_t *line);
+
+/*
+ * dcache_serve() sends the response stored under key to fd.
+ * returns true if the key was found fresh and sent
+ */
+bool dcache_serve(char *key, int fd);
+
+/*
+ * dcache_purge() drops the entries a purge of kind and arg hits, and
+ * the demotions of them still queued. returns the entries dropped
+ */
+size_t dcache_purge(purge_kind_t kind, char *arg);
+
+/* dcache_get_stats() fills in the tier accounting */
+void dcache_get_stats(dcache_stats_t *stats);
+
+#endif /* __DCACHE_H__ */
@@ -0,0 +1,321 @@
+/* Body deduplication file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+#include "csapp.h"
+#include "dedup.h"
+#include "compress.h"
+
+//#define DEBUG // uncomment this line to enable debugging
+
+#ifdef DEBUG
+/* When debugging is enabled, these form aliases to useful functions */
+#define dbg_printf(...) printf(__VA_ARGS__)
+#else
+/* When debugging is disabled, no code gets generated for these */
+#define dbg_printf(...)
+#endif
+
+/* MurmurHash3 x64_128 constants */
+#define MURMUR_C1 0x87c37b91114253d5ULL
+#define MURMUR_C2 0x4cf5ad432745937fULL
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+typedef struct dedupentry
+{
+    uint64_t digest[2];
+    size_t raw_size;        // bytes of the body
+    webobj_t *obj;
+    int lines;              // cache lines using obj
+    struct dedupentry *next;
+}dedupentry_t;
+
+/* a MurmurHash3 over a body given in pieces */
+typedef struct murmur
+{
+    uint64_t h1, h2;
+    unsigned char tail[16]; // bytes short of a whole block
+    size_t ntail;
+    size_t len;
+}murmur_t;
+
+static dedupentry_t *buckets[DEDUP_BUCKETS];
+static sem_t dedup_mutex;
+static pthread_once_t dedup_once = PTHREAD_ONCE_INIT;
+static dedup_stats_t dd_stats;
+
+static void dedup_init(void)
+{
+    Sem_init(&dedup_mutex, 0, 1);
+}
+
+static uint64_t fmix64(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+/* mixes one 16 byte block into m */
+static void murmur_block(murmur_t *m, const unsigned char *p)
+{
+    uint64_t k1, k2;
+
+    memcpy(&k1, p, 8);
+    memcpy(&k2, p + 8, 8);
+
+    k1 *= MURMUR_C1;
+    k1 = ROTL64(k1, 31);
+    k1 *= MURMUR_C2;
+    m->h1 ^= k1;
+    m->h1 = ROTL64(m->h1, 27);
+    m->h1 += m->h2;
+    m->h1 = m->h1 * 5 + 0x52dce729;
+
+    k2 *= MURMUR_C2;
+    k2 = ROTL64(k2, 33);
+    k2 *= MURMUR_C1;
+    m->h2 ^= k2;
+    m->h2 = ROTL64(m->h2, 31);
+    m->h2 += m->h1;
+    m->h2 = m->h2 * 5 + 0x38495ab5;
+}
+
+/* feeds n more bytes at p into m */
+static void murmur_update(murmur_t *m, const unsigned char *p, size_t n)
+{
+    size_t take;
+
+    m->len += n;
+    if(m->ntail > 0)
+    {
+        take = 16 - m->ntail < n ? 16 - m->ntail : n;
+        memcpy(m->tail + m->ntail, p, take);
+        m->ntail += take;
+        p += take;
+        n -= take;
+        if(m->ntail < 16)
+            return;
+        murmur_block(m, m->tail);
+        m->ntail = 0;
+    }
+    for(; n >= 16; p += 16, n -= 16)
+        murmur_block(m, p);
+    memcpy(m->tail, p, n);
+    m->ntail = n;
+}
+
+/* mixes in the last bytes and the length, giving the digest */
+static void murmur_final(murmur_t *m, uint64_t digest[2])
+{
+    uint64_t k1 = 0, k2 = 0;
+    int i;
+
+    for(i = m->ntail - 1; i >= 8; i--)
+        k2 ^= (uint64_t)m->tail[i] << (8 * (i - 8));
+    if(m->ntail > 8)
+    {
+        k2 *= MURMUR_C2;
+        k2 = ROTL64(k2, 33);
+        k2 *= MURMUR_C1;
+        m->h2 ^= k2;
+    }
+    for(i = (m->ntail < 8 ? m->ntail : 8) - 1; i >= 0; i--)
+        k1 ^= (uint64_t)m->tail[i] << (8 * i);
+    if(m->ntail > 0)
+    {
+        k1 *= MURMUR_C1;
+        k1 = ROTL64(k1, 31);
+        k1 *= MURMUR_C2;
+        m->h1 ^= k1;
+    }
+
+    m->h1 ^= m->len;
+    m->h2 ^= m->len;
+    m->h1 += m->h2;
+    m->h2 += m->h1;
+    m->h1 = fmix64(m->h1);
+    m->h2 = fmix64(m->h2);
+    m->h1 += m->h2;
+    m->h2 += m->h1;
+    digest[0] = m->h1;
+    digest[1] = m->h2;
+}
+
+/*
+ * dedup_digest() names the body of obj, which is not compressed, by
+ * its MurmurHash3
+ */
+void dedup_digest(webobj_t *obj)
+{
+    murmur_t m;
+    segment_t *seg;
+
+    memset(&m, 0, sizeof(m));
+    for(seg = obj->head; seg != NULL; seg = seg->next)
+        murmur_update(&m, (unsigned char *)seg->data, seg->len);
+    murmur_final(&m, obj->digest);
+    obj->digested = true;
+}
+
+/* the entry of the body with digest and raw_size, called locked */
+static dedupentry_t *lookup(uint64_t digest[2], size_t raw_size)
+{
+    dedupentry_t *e;
+
+    for(e = buckets[digest[0] % DEDUP_BUCKETS]; e != NULL; e = e->next)
+        if(e->digest[0] == digest[0] && e->digest[1] == digest[1] &&
+           e->raw_size == raw_size)
+            return e;
+    return NULL;
+}
+
+/* bytes of the body of obj once decoded */
+static size_t body_size(webobj_t *obj)
+{
+    return obj->encoding == WEBOBJ_IDENTITY ? obj->size : obj->raw_size;
+}
+
+/* whether the objects a and b, not compressed, hold the same bytes */
+static bool same_bytes(webobj_t *a, webobj_t *b)
+{
+    segment_t *sa = a->head, *sb = b->head;
+    size_t oa = 0, ob = 0, n;
+
+    if(a->size != b->size)
+        return false;
+    while(sa != NULL && sb != NULL)
+    {
+        n = sa->len - oa < sb->len - ob ? sa->len - oa : sb->len - ob;
+        if(memcmp(sa->data + oa, sb->data + ob, n))
+            return false;
+        if((oa += n) == sa->len)
+        {
+            sa = sa->next;
+            oa = 0;
+        }
+        if((ob += n) == sb->len)
+        {
+            sb = sb->next;
+            ob = 0;
+        }
+    }
+    return true;
+}
+
+/*
+ * dedup_find() returns a reference to the stored object holding the
+ * same body as obj, or NULL if there is none. A compressed one is only
+ * returned if encoded is set
+ */
+webobj_t *dedup_find(webobj_t *obj, bool encoded)
+{
+    dedupentry_t *e;
+    webobj_t *found = NULL, *raw;
+    bool same;
+
+    if(!obj->digested)
+        return NULL;
+    pthread_once(&dedup_once, dedup_init);
+    P(&dedup_mutex);
+    if((e = lookup(obj->digest, body_size(obj))) != NULL && e->obj != obj &&
+       (encoded || e->obj->encoding == WEBOBJ_IDENTITY))
+    {
+        found = e->obj;
+        webobj_get(found);
+    }
+    V(&dedup_mutex);
+    if(found == NULL)
+        return NULL;
+
+    // the digest only says the bodies are likely the same
+    if(found->encoding == WEBOBJ_IDENTITY)
+        same = same_bytes(found, obj);
+    else if((raw = inflate_object(found)) != NULL)
+    {
+        same = same_bytes(raw, obj);
+        webobj_put(raw);
+    }
+    else
+        same = false;
+
+    if(!same)
+    {
+        __sync_fetch_and_add(&dd_stats.mismatches, 1);
+        webobj_put(found);
+        return NULL;
+    }
+    __sync_fetch_and_add(&dd_stats.hits, 1);
+    return found;
+}
+
+/*
+ * dedup_add() records that a cache line uses obj, storing it if no
+ * object with its digest is stored; called under the shard lock
+ */
+void dedup_add(webobj_t *obj)
+{
+    dedupentry_t *e;
+    int b;
+
+    if(!obj->digested)
+        return;
+    pthread_once(&dedup_once, dedup_init);
+    P(&dedup_mutex);
+    if((e = lookup(obj->digest, body_size(obj))) != NULL)
+    {
+        // another object with the digest is not shared through the store
+        if(e->obj == obj && e->lines++ > 0)
+            dd_stats.shared_bytes += obj->size;
+    }
+    else if((e = malloc(sizeof(dedupentry_t))) != NULL)
+    {
+        memcpy(e->digest, obj->digest, sizeof(e->digest));
+        e->raw_size = body_size(obj);
+        e->obj = obj;
+        e->lines = 1;
+        b = obj->digest[0] % DEDUP_BUCKETS;
+        e->next = buckets[b];
+        buckets[b] = e;
+        dd_stats.entries++;
+        dd_stats.bytes += obj->size;
+    }
+    V(&dedup_mutex);
+}
+
+/* dedup_remove() records that a cache line no longer uses obj */
+void dedup_remove(webobj_t *obj)
+{
+    dedupentry_t *e, **pp;
+
+    if(!obj->digested)
+        return;
+    pthread_once(&dedup_once, dedup_init);
+    P(&dedup_mutex);
+    for(pp = &buckets[obj->digest[0] % DEDUP_BUCKETS]; (e = *pp) != NULL;
+        pp = &e->next)
+    {
+        if(e->obj != obj)
+            continue;
+        if(--e->lines > 0)
+            dd_stats.shared_bytes -= obj->size;
+        else
+        {
+            *pp = e->next;
+            dd_stats.entries--;
+            dd_stats.bytes -= obj->size;
+            free(e);
+        }
+        break;
+    }
+    V(&dedup_mutex);
+}
+
+/* dedup_get_stats() fills in the counters */
+void dedup_get_stats(dedup_stats_t *stats)
+{
+    *stats = dd_stats;
+}
@@ -0,0 +1,71 @@
+/* Body deduplication header file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+
+/*
+ * Content addressed store of cached bodies, so that URIs answering
+ * with the same bytes (cache busting query strings, mirrors, assets
+ * under several paths) share one web object instead of a copy each.
+ *
+ * A body is named by the 128-bit MurmurHash3 (x64_128) of its bytes,
+ * computed by dedup_digest() as it is stored. Before a new body goes
+ * into the cache dedup_find() looks for one stored under the same
+ * digest; a match is compared byte for byte, the hash is fast but not
+ * collision resistant, and the line gets the stored object instead:
+ *
+ *   key A ---\
+ *   key B ----+--> digest 9f3c..e1 --> webobj (one copy, refcounted)
+ *   key C ---/
+ *
+ * The store holds no reference of its own, an entry counts the cache
+ * lines using its object (dedup_add() and dedup_remove(), from
+ * cache.c) and goes when the last of them does. A compressed object
+ * carries the digest of the body it encodes, so identical bodies are
+ * compressed once.
+ */
+
+#ifndef __DEDUP_H__
+#define __DEDUP_H__
+
+#include "csapp.h"
+#include "webobj.h"
+
+#define DEDUP_BUCKETS 4096
+#define DEDUP_MIN_SIZE 256          /* smaller bodies are not shared */
+
+typedef struct dedup_stats
+{
+    size_t entries;          // distinct bodies in the store
+    size_t bytes;            // bytes they take up
+    size_t shared_bytes;     // bytes more the lines sharing them refer to
+    size_t hits;             // new bodies found stored already
+    size_t mismatches;       // digest matches with other bytes
+}dedup_stats_t;
+
+/*
+ * dedup_digest() names the body of obj, which is not compressed, by
+ * its MurmurHash3
+ */
+void dedup_digest(webobj_t *obj);
+
+/*
+ * dedup_find() returns a reference to the stored object holding the
+ * same body as obj, or NULL if there is none. A compressed one is only
+ * returned if encoded is set
+ */
+webobj_t *dedup_find(webobj_t *obj, bool encoded);
+
+/*
+ * dedup_add() records that a cache line uses obj, storing it if no
+ * object with its digest is stored; called under the shard lock
+ */
+void dedup_add(webobj_t *obj);
+
+/* dedup_remove() records that a cache line no longer uses obj */
+void dedup_remove(webobj_t *obj);
+
+/* dedup_get_stats() fills in the counters */
+void dedup_get_stats(dedup_stats_t *stats);
+
+#endif /* __DEDUP_H__ */
@@ -0,0 +1,235 @@
+/* DNS cache file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+#include "csapp.h"
+#include "cache.h"
+#include "config.h"
+#include "dns.h"
+
+//#define DEBUG // uncomment this line to enable debugging
+
+#ifdef DEBUG
+/* When debugging is enabled, these form aliases to useful functions */
+#define dbg_printf(...) printf(__VA_ARGS__)
+#else
+/* When debugging is disabled, no code gets generated for these */
+#define dbg_printf(...)
+#endif
+
+typedef struct dnsentry
+{
+    char *host;             // both follow the entry in its allocation
+    char *port;
+    dnsaddr_t *addrs;       // NULL for a cached failure
+    int naddrs;
+    time_t expires;
+    int refreshing;         // a background refresh is running
+    struct dnsentry *next;
+}dnsentry_t;
+
+static dnsentry_t *buckets[DNS_BUCKETS];
+static sem_t dns_mutex;
+static pthread_once_t dns_once = PTHREAD_ONCE_INIT;
+static dns_stats_t dns_stats;
+
+static void dns_init(void)
+{
+    Sem_init(&dns_mutex, 0, 1);
+}
+
+/*
+ * lookup() calls the resolver. returns the number of addresses and a
+ * new array in *addrs, or -1 on failure
+ */
+static int lookup(char *host, char *port, dnsaddr_t **addrs)
+{
+    struct addrinfo hints, *list, *p;
+    int n = 0, rc;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICSERV | AI_ADDRCONFIG;
+    if((rc = getaddrinfo(host, port, &hints, &list)) != 0)
+    {
+        dbg_printf("dns: %s: %s\n", host, gai_strerror(rc));
+        __sync_fetch_and_add(&dns_stats.failures, 1);
+        return -1;
+    }
+
+    for(p = list; p != NULL; p = p->ai_next)
+        n++;
+    if((*addrs = malloc(n * sizeof(dnsaddr_t))) == NULL)
+    {
+        freeaddrinfo(list);
+        return -1;
+    }
+    for(n = 0, p = list; p != NULL; p = p->ai_next, n++)
+    {
+        (*addrs)[n].family = p->ai_family;
+        (*addrs)[n].socktype = p->ai_socktype;
+        (*addrs)[n].protocol = p->ai_protocol;
+        (*addrs)[n].addrlen = p->ai_addrlen;
+        memcpy(&(*addrs)[n].addr, p->ai_addr, p->ai_addrlen);
+    }
+    freeaddrinfo(list);
+    return n;
+}
+
+/* finds the entry of host:port, called with dns_mutex held */
+static dnsentry_t *find(char *host, char *port, unsigned long b)
+{
+    dnsentry_t *e;
+
+    for(e = buckets[b]; e != NULL; e = e->next)
+        if(!strcmp(e->host, host) && !strcmp(e->port, port))
+            return e;
+    return NULL;
+}
+
+/*
+ * store() records the outcome of a lookup, called with dns_mutex held.
+ * A failure keeps the last good addresses of the entry, if any, for
+ * another negative TTL. Takes over addrs.
+ */
+static void store(dnsentry_t *e, dnsaddr_t *addrs, int n, time_t now)
+{
+    if(n < 0)
+    {
+        if(e->addrs != NULL)
+            dns_stats.stale++;
+        e->expires = now + config.dns_negative_ttl;
+        return;
+    }
+    free(e->addrs);
+    e->addrs = addrs;
+    e->naddrs = n;
+    e->expires = now + config.dns_ttl;
+}
+
+/* copies the addresses of e, called with dns_mutex held */
+static int copy_out(dnsentry_t *e, dnsaddr_t **addrs)
+{
+    if(e->addrs == NULL)
+        return -1;
+    if((*addrs = malloc(e->naddrs * sizeof(dnsaddr_t))) == NULL)
+        return -1;
+    memcpy(*addrs, e->addrs, e->naddrs * sizeof(dnsaddr_t));
+    return e->naddrs;
+}
+
+/* refreshes one entry in the background */
+static void *refresh_thread(void *vargp)
+{
+    dnsentry_t *e = vargp;
+    dnsaddr_t *addrs = NULL;
+    int n;
+
+    Pthread_detach(pthread_self());
+    // entries are never freed, e stays valid
+    n = lookup(e->host, e->port, &addrs);
+    P(&dns_mutex);
+    store(e, addrs, n, time(NULL));
+    e->refreshing = 0;
+    V(&dns_mutex);
+    return NULL;
+}
+
+/*
+ * dns_resolve() looks up host and port. On success *addrs points to a
+ * new array the caller frees and the number of addresses is returned;
+ * returns -1 if the name does not resolve
+ */
+int dns_resolve(char *host, char *port, dnsaddr_t **addrs)
+{
+    unsigned long b = (hash_key(host) ^ hash_key(port)) % DNS_BUCKETS;
+    time_t now = time(NULL);
+    dnsaddr_t *fresh = NULL;
+    dnsentry_t *e;
+    pthread_t tid;
+    int n;
+
+    pthread_once(&dns_once, dns_init);
+    if(config.dns_ttl <= 0)
+        return lookup(host, port, addrs);
+
+    P(&dns_mutex);
+    if((e = find(host, port, b)) != NULL && e->expires > now)
+    {
+        if(e->addrs == NULL)
+        {
+            dns_stats.negative_hits++;
+            V(&dns_mutex);
+            return -1;
+        }
+        dns_stats.hits++;
+        // close to expiry: one hit starts a refresh, the rest go on
+        // using the current addresses
+        if(!e->refreshing && (e->expires - now) * 5 <= config.dns_ttl)
+        {
+            e->refreshing = 1;
+            if(pthread_create(&tid, NULL, refresh_thread, e) == 0)
+                dns_stats.refreshes++;
+            else
+                e->refreshing = 0;
+        }
+        n = copy_out(e, addrs);
+        V(&dns_mutex);
+        return n;
+    }
+    dns_stats.misses++;
+    V(&dns_mutex);
+
+    // resolve without holding the lock
+    n = lookup(host, port, &fresh);
+
+    P(&dns_mutex);
+    if((e = find(host, port, b)) == NULL &&
+       dns_stats.entries < DNS_MAX_ENTRIES &&
+       (e = calloc(1, sizeof(dnsentry_t) + strlen(host) + 1 + 
+                      strlen(port) + 1)) != NULL)
+    {
+        e->host = (char *)(e + 1);
+        strcpy(e->host, host);
+        e->port = e->host + strlen(host) + 1;
+        strcpy(e->port, port);
+        e->next = buckets[b];
+        buckets[b] = e;
+        dns_stats.entries++;
+    }
+    if(e == NULL)
+    {
+        V(&dns_mutex);
+        *addrs = fresh;
+        return n;
+    }
+    store(e, fresh, n, now);
+    n = copy_out(e, addrs);
+    V(&dns_mutex);
+    return n;
+}
+
+/*
+ * dns_forget_failure() drops a cached failure of host and port, so the
+ * next dns_resolve() asks the resolver again
+ */
+void dns_forget_failure(char *host, char *port)
+{
+    unsigned long b = (hash_key(host) ^ hash_key(port)) % DNS_BUCKETS;
+    dnsentry_t *e;
+
+    pthread_once(&dns_once, dns_init);
+    P(&dns_mutex);
+    if((e = find(host, port, b)) != NULL && e->addrs == NULL)
+        e->expires = 0;
+    V(&dns_mutex);
+}
+
+/* dns_get_stats() fills in the counters */
+void dns_get_stats(dns_stats_t *stats)
+{
+    pthread_once(&dns_once, dns_init);
+    P(&dns_mutex);
+    *stats = dns_stats;
+    V(&dns_mutex);
+}
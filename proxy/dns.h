@@ -0,0 +1,67 @@
+/* DNS cache header file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+
+/*
+ * Cache of resolved upstream addresses, so that connecting to an origin
+ * does not call getaddrinfo() every time. Entries map "host:port" to the
+ * list of addresses getaddrinfo() returned, in its order.
+ *
+ * getaddrinfo() does not report the TTL of the records, so entries live
+ * for dns_ttl seconds. Failed lookups are cached too, for
+ * dns_negative_ttl seconds, so a dead name does not make every request
+ * wait on the resolver. A hit in the last fifth of an entry's lifetime
+ * starts one background lookup that refreshes it before it expires.
+ * When a refresh or a lookup of an expired entry fails, the last good
+ * addresses are kept for another dns_negative_ttl seconds.
+ */
+
+#ifndef __DNS_H__
+#define __DNS_H__
+
+#include "csapp.h"
+
+#define DNS_BUCKETS 256
+#define DNS_MAX_ENTRIES 4096
+#define DNS_TTL 60              /* default seconds an entry is used */
+#define DNS_NEGATIVE_TTL 5      /* default seconds a failure is cached */
+
+/* one resolved address */
+typedef struct dnsaddr
+{
+    int family;
+    int socktype;
+    int protocol;
+    socklen_t addrlen;
+    struct sockaddr_storage addr;
+}dnsaddr_t;
+
+typedef struct dns_stats
+{
+    size_t entries;          // names in the cache
+    size_t hits;             // lookups answered from the cache
+    size_t misses;           // lookups that went to the resolver
+    size_t negative_hits;    // lookups answered by a cached failure
+    size_t refreshes;        // background refreshes started
+    size_t failures;         // resolver failures
+    size_t stale;            // failures covered by the last good addresses
+}dns_stats_t;
+
+/*
+ * dns_resolve() looks up host and port. On success *addrs points to a
+ * new array the caller frees and the number of addresses is returned;
+ * returns -1 if the name does not resolve
+ */
+int dns_resolve(char *host, char *port, dnsaddr_t **addrs);
+
+/*
+ * dns_forget_failure() drops a cached failure of host and port, so the
+ * next dns_resolve() asks the resolver again
+ */
+void dns_forget_failure(char *host, char *port);
+
+/* dns_get_stats() fills in the counters */
+void dns_get_stats(dns_stats_t *stats);
+
+#endif /* __DNS_H__ */
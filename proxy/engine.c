@@ -0,0 +1,476 @@
+/* Event engine file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+#include "csapp.h"
+#include "webobj.h"
+#include "engine.h"
+#include "memfd.h"
+#include <sys/epoll.h>
+#include <sys/uio.h>
+
+//#define DEBUG // uncomment this line to enable debugging
+
+#ifdef DEBUG
+/* When debugging is enabled, these form aliases to useful functions */
+#define dbg_printf(...) printf(__VA_ARGS__)
+#else
+/* When debugging is disabled, no code gets generated for these */
+#define dbg_printf(...)
+#endif
+
+/* states of a connection */
+#define CONN_READ 0         /* reading the request head */
+#define CONN_WRITE 1        /* writing a cached response */
+#define CONN_DRAIN 2        /* written from the memory file, waiting */
+                            /* for the socket to let go of its pages */
+
+typedef struct conn
+{
+    int fd;
+    int state;
+    size_t len;             // head bytes read into rio
+    webhdr_t *hdr;          // the response being written
+    webobj_t *obj;
+    size_t sent;            // bytes of hdr and obj written
+    segment_t *seg;         // segment of the next body byte
+    size_t off;             // offset of that byte in seg
+    bool sent_file;         // some of obj went out with sendfile()
+    time_t drain_until;     // reset if the socket has not drained then
+    struct conn *next;      // in the drain list of the loop
+    rio_t rio;              // holds the request head for route
+}conn_t;
+
+/* a request handed off to a thread */
+typedef struct handoff
+{
+    int fd;
+    void *arg;
+}handoff_t;
+
+static int listen_fd;
+static engine_route_t route_fn;
+static engine_handler_t handler_fn;
+static engine_stats_t en_stats;
+
+/* handoffs waiting for a thread of the pool, a ring */
+static handoff_t queue[ENGINE_HANDOFF_QUEUE];
+static int queue_head;
+static sem_t queue_mutex;       // protects queue_head and en_stats.waiting
+static sem_t queue_items;       // counts the handoffs in the queue
+
+/* sets or clears O_NONBLOCK on fd */
+static int set_nonblock(int fd, bool on)
+{
+    int flags = fcntl(fd, F_GETFL);
+
+    if(flags < 0)
+        return -1;
+    return fcntl(fd, F_SETFL, on ? flags | O_NONBLOCK : flags & ~O_NONBLOCK);
+}
+
+/* closes c and drops the response it holds */
+static void conn_close(conn_t *c)
+{
+    close(c->fd);
+    webhdr_put(c->hdr);
+    webobj_put(c->obj);
+    free(c);
+    __sync_fetch_and_sub(&en_stats.conns, 1);
+}
+
+/* accepts every pending connection into the loop of epfd */
+static void accept_all(int epfd)
+{
+    struct epoll_event ev;
+    conn_t *c;
+    int fd;
+
+    while((fd = accept(listen_fd, NULL, NULL)) >= 0)
+    {
+        if(set_nonblock(fd, true) < 0 ||
+           (c = calloc(1, sizeof(conn_t))) == NULL)
+        {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->state = CONN_READ;
+        ev.events = EPOLLIN;
+        ev.data.ptr = c;
+        __sync_fetch_and_add(&en_stats.conns, 1);
+        __sync_fetch_and_add(&en_stats.accepted, 1);
+        if(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+            conn_close(c);
+    }
+}
+
+/*
+ * read_head() reads what the client sent. returns 1 once the head is
+ * complete, 0 if more is to come and -1 if the connection is done for
+ */
+static int read_head(conn_t *c)
+{
+    char *buf = c->rio.rio_buf;
+    size_t from;
+    ssize_t n;
+
+    while(c->len < RIO_BUFSIZE)
+    {
+        if((n = read(c->fd, buf + c->len, RIO_BUFSIZE - c->len)) == 0)
+            return -1;
+        if(n < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        // the blank line may straddle two reads
+        from = c->len > 3 ? c->len - 3 : 0;
+        c->len += n;
+        for(; from + 4 <= c->len; from++)
+            if(!memcmp(buf + from, "\r\n\r\n", 4))
+                return 1;
+    }
+    // a head that does not fit the rio buffer
+    return -1;
+}
+
+/* moves the write position of c on by n bytes */
+static void advance(conn_t *c, size_t n)
+{
+    size_t k;
+
+    c->sent += n;
+    if(c->sent <= c->hdr->len)
+        return;
+    n = c->sent - c->hdr->len < n ? c->sent - c->hdr->len : n;
+    while(n > 0 && c->seg != NULL)
+    {
+        k = c->seg->len - c->off;
+        if(n < k)
+        {
+            c->off += n;
+            return;
+        }
+        n -= k;
+        c->seg = c->seg->next;
+        c->off = 0;
+    }
+}
+
+/*
+ * write_some() writes as much of the response as the client takes.
+ * returns 1 when all of it is written, 0 if the socket is full and -1
+ * on an error
+ */
+static int write_some(conn_t *c)
+{
+    struct iovec iov[ENGINE_IOVECS];
+    size_t total = c->hdr->len + c->obj->size, off;
+    segment_t *seg;
+    ssize_t n;
+    int i;
+
+    while(c->sent < total)
+    {
+        if(c->sent >= c->hdr->len && c->off == c->seg->len)
+        {
+            c->seg = c->seg->next;
+            c->off = 0;
+            continue;
+        }
+        // a segment in the memory file goes out with sendfile(), its 
+        // bytes never pass through user space
+        if(c->sent >= c->hdr->len && memfd_contains(c->seg->data))
+        {
+            n = memfd_send(c->fd, c->seg->data + c->off, 
+                           c->seg->len - c->off);
+            c->sent_file |= n > 0;
+        }
+        else
+        {
+            i = 0;
+            if(c->sent < c->hdr->len)
+            {
+                iov[i].iov_base = c->hdr->data + c->sent;
+                iov[i++].iov_len = c->hdr->len - c->sent;
+            }
+            for(seg = c->seg, off = c->off; 
+                seg != NULL && i < ENGINE_IOVECS && 
+                !memfd_contains(seg->data); seg = seg->next, off = 0)
+            {
+                if(seg->len == off)
+                    continue;
+                iov[i].iov_base = seg->data + off;
+                iov[i++].iov_len = seg->len - off;
+            }
+            n = writev(c->fd, iov, i);
+        }
+        if(n < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        advance(c, n);
+    }
+    return 1;
+}
+
+/*
+ * handoff_push() queues a request for the pool. returns false if the
+ * queue is full
+ */
+static bool handoff_push(int fd, void *arg)
+{
+    handoff_t *h;
+
+    P(&queue_mutex);
+    if(en_stats.waiting == ENGINE_HANDOFF_QUEUE)
+    {
+        V(&queue_mutex);
+        return false;
+    }
+    h = &queue[(queue_head + en_stats.waiting) % ENGINE_HANDOFF_QUEUE];
+    h->fd = fd;
+    h->arg = arg;
+    en_stats.waiting++;
+    V(&queue_mutex);
+    V(&queue_items);
+    return true;
+}
+
+/* a thread of the pool, runs handed off requests */
+static void *handoff_thread(void *vargp)
+{
+    handoff_t h;
+
+    while(1)
+    {
+        P(&queue_items);
+        P(&queue_mutex);
+        h = queue[queue_head];
+        queue_head = (queue_head + 1) % ENGINE_HANDOFF_QUEUE;
+        en_stats.waiting--;
+        V(&queue_mutex);
+        handler_fn(h.fd, h.arg);
+        close(h.fd);
+    }
+    return NULL;
+}
+
+/*
+ * route() passes a complete head to the route callback and acts on its
+ * answer. returns false once c is gone
+ */
+static bool route(int epfd, conn_t *c)
+{
+    void *arg = NULL;
+
+    rio_readinitb(&c->rio, c->fd);
+    c->rio.rio_cnt = c->len;
+    switch(route_fn(c->fd, &c->rio, &c->hdr, &c->obj, &arg))
+    {
+        case ENGINE_SEND:
+            c->state = CONN_WRITE;
+            c->seg = c->obj->head;
+            return true;
+
+        case ENGINE_HANDOFF:
+            epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+            if(set_nonblock(c->fd, false) < 0)
+                break;
+            if(!handoff_push(c->fd, arg))
+            {
+                __sync_fetch_and_add(&en_stats.dropped, 1);
+                break;
+            }
+            __sync_fetch_and_add(&en_stats.handoffs, 1);
+            __sync_fetch_and_sub(&en_stats.conns, 1);
+            free(c);
+            return false;
+    }
+    // the request is dropped, handler_fn only releases arg
+    if(arg != NULL)
+        handler_fn(-1, arg);
+    conn_close(c);
+    return false;
+}
+
+/*
+ * drain_check() closes the connections of the drain list whose sockets
+ * have let go of the memory file pages, resetting those out of time
+ */
+static void drain_check(conn_t **draining)
+{
+    time_t now = time(NULL);
+    conn_t **pp = draining, *c;
+
+    while((c = *pp) != NULL)
+    {
+        if(!memfd_drained(c->fd))
+        {
+            if(now < c->drain_until)
+            {
+                pp = &c->next;
+                continue;
+            }
+            memfd_abort(c->fd);
+        }
+        *pp = c->next;
+        __sync_fetch_and_sub(&en_stats.draining, 1);
+        conn_close(c);
+    }
+}
+
+/*
+ * finish() ends the response of c. One sent from the memory file keeps 
+ * its object on the drain list until the socket has sent it
+ */
+static void finish(int epfd, conn_t *c, conn_t **draining)
+{
+    if(!c->sent_file || memfd_drained(c->fd))
+    {
+        conn_close(c);
+        return;
+    }
+    epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    c->state = CONN_DRAIN;
+    c->drain_until = time(NULL) + MEMFD_DRAIN_TIMEOUT;
+    c->next = *draining;
+    *draining = c;
+    __sync_fetch_and_add(&en_stats.draining, 1);
+}
+
+/* advances the state machine of c on an event */
+static void handle(int epfd, conn_t *c, conn_t **draining)
+{
+    struct epoll_event ev;
+    int rc;
+
+    if(c->state == CONN_READ)
+    {
+        if((rc = read_head(c)) < 0)
+        {
+            conn_close(c);
+            return;
+        }
+        if(rc == 0 || !route(epfd, c))
+            return;
+    }
+
+    if((rc = write_some(c)) == 0)
+    {
+        // wait until the client takes more
+        ev.events = EPOLLOUT;
+        ev.data.ptr = c;
+        if(epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev) < 0)
+            finish(epfd, c, draining);
+        return;
+    }
+    if(rc > 0)
+        __sync_fetch_and_add(&en_stats.served, 1);
+    finish(epfd, c, draining);
+}
+
+/* the event loop behind epfd */
+static void *loop_thread(void *vargp)
+{
+    struct epoll_event events[ENGINE_EVENTS];
+    int epfd = (int)(long)vargp;
+    int i, n;
+    conn_t *draining = NULL;
+
+    while(1)
+    {
+        // no event tells when a socket has drained, the list is polled
+        if((n = epoll_wait(epfd, events, ENGINE_EVENTS, 
+                           draining ? MEMFD_DRAIN_POLL : -1)) < 0)
+        {
+            if(errno != EINTR)
+                unix_error("epoll_wait error");
+            continue;
+        }
+        for(i = 0; i < n; i++)
+        {
+            if(events[i].data.ptr == NULL)
+                accept_all(epfd);
+            else
+                handle(epfd, events[i].data.ptr, &draining);
+        }
+        if(draining)
+            drain_check(&draining);
+    }
+    return NULL;
+}
+
+/* creates the epoll instance of one loop, watching the listener */
+static int loop_create(void)
+{
+    struct epoll_event ev;
+    int epfd;
+
+    if((epfd = epoll_create1(0)) < 0)
+        return -1;
+    // only one loop is woken per new connection
+    ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+    ev.data.ptr = NULL;
+    if(epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &ev) < 0)
+    {
+        ev.events = EPOLLIN;
+        if(epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &ev) < 0)
+        {
+            close(epfd);
+            return -1;
+        }
+    }
+    return epfd;
+}
+
+/*
+ * engine_run() serves the clients of listenfd with nloops event loops,
+ * the caller running the first, and nthreads threads for handoffs.
+ * returns only if they could not be set up
+ */
+int engine_run(int listenfd, int nloops, int nthreads, engine_route_t route,
+               engine_handler_t handler)
+{
+    pthread_t tid;
+    int i, epfd = -1;
+
+    listen_fd = listenfd;
+    route_fn = route;
+    handler_fn = handler;
+    if(set_nonblock(listenfd, true) < 0)
+        return -1;
+
+    Sem_init(&queue_mutex, 0, 1);
+    Sem_init(&queue_items, 0, 0);
+    for(i = 0; i < nthreads; i++)
+    {
+        if(pthread_create(&tid, NULL, handoff_thread, NULL) != 0)
+            return -1;
+        Pthread_detach(tid);
+    }
+
+    for(i = 0; i < nloops; i++)
+    {
+        if((epfd = loop_create()) < 0)
+            return -1;
+        en_stats.loops++;
+        // the caller runs the last loop itself
+        if(i == nloops - 1)
+            break;
+        Pthread_create(&tid, NULL, loop_thread, (void *)(long)epfd);
+        Pthread_detach(tid);
+    }
+    loop_thread((void *)(long)epfd);
+    return -1;
+}
+
+/* engine_get_stats() fills in the counters */
+void engine_get_stats(engine_stats_t *stats)
+{
+    *stats = en_stats;
+}
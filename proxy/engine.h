@@ -0,0 +1,88 @@
+/* Event engine header file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+
+/*
+ * Event-driven front end of the proxy. A few epoll loops, one per core
+ * by default, share the listening socket and own the client connections
+ * instead of a thread per client. Every connection is a small state
+ * machine run by its loop with non-blocking calls:
+ *
+ *   accept -> READ request head -> route -> WRITE response -> close
+ *                                        \-> hand off to a thread
+ *
+ * Once the head is read the route callback looks the request up. A
+ * response it hands back (a cache hit) is written by the loop from the
+ * cached segments as the client takes it, so slow downloads of cached
+ * objects cost no thread. Anything else, a miss that has to go to the
+ * origin, is handed off with the connection in blocking mode to a pool
+ * of threads that run the handler callback.
+ *
+ * The pool has handoff_threads threads, started with the loops, and a
+ * thread is held for as long as the origin and the client take. So at
+ * most that many handed off requests are served at once; the next
+ * ENGINE_HANDOFF_QUEUE wait for a thread in a queue, and connections
+ * handed off while the queue is full are closed unanswered.
+ *
+ * A response sent from the memory file (memfd.h) is only closed and
+ * dropped once the socket has sent it; until then the connection waits
+ * on a drain list its loop checks every MEMFD_DRAIN_POLL ms.
+ */
+
+#ifndef __ENGINE_H__
+#define __ENGINE_H__
+
+#include "csapp.h"
+#include "webobj.h"
+
+#define ENGINE_EVENTS 256       /* events taken per epoll_wait() */
+#define ENGINE_IOVECS 16        /* segments written per writev() */
+#define ENGINE_HANDOFF_THREADS 128  /* default threads of the pool */
+#define ENGINE_MAX_HANDOFF_THREADS 4096
+#define ENGINE_HANDOFF_QUEUE 4096   /* handoffs waiting for a thread */
+
+/* what the loop does with a request, returned by the route callback */
+#define ENGINE_SEND 0           /* write hdr and obj, then close */
+#define ENGINE_HANDOFF 1        /* run the handler in a thread */
+#define ENGINE_DONE 2           /* answered already, close */
+
+/*
+ * route callback: the request head is in rio. Returns ENGINE_SEND with
+ * references in *hdr and *obj that the engine drops once written, or
+ * ENGINE_HANDOFF with *arg for the handler, or ENGINE_DONE
+ */
+typedef int (*engine_route_t)(int fd, rio_t *rio, webhdr_t **hdr,
+                              webobj_t **obj, void **arg);
+
+/*
+ * handler callback: serves fd in a thread, the engine closes fd after.
+ * fd is -1 if the request is dropped, only arg is released
+ */
+typedef void (*engine_handler_t)(int fd, void *arg);
+
+typedef struct engine_stats
+{
+    size_t loops;            // event loops running
+    size_t conns;            // connections the loops hold now
+    size_t accepted;         // connections accepted
+    size_t served;           // responses written by the loops
+    size_t handoffs;         // requests handed off to a thread
+    size_t waiting;          // handoffs queued for a thread now
+    size_t dropped;          // handoffs dropped, the queue was full
+    size_t draining;         // written ones waiting for the socket to
+                             // send what came from the memory file
+}engine_stats_t;
+
+/*
+ * engine_run() serves the clients of listenfd with nloops event loops,
+ * the caller running the first, and nthreads threads for handoffs.
+ * returns only if they could not be set up
+ */
+int engine_run(int listenfd, int nloops, int nthreads, engine_route_t route,
+               engine_handler_t handler);
+
+/* engine_get_stats() fills in the counters */
+void engine_get_stats(engine_stats_t *stats);
+
+#endif /* __ENGINE_H__ */
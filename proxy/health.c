@@ -0,0 +1,283 @@
+/* Upstream health file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+#include "csapp.h"
+#include "cache.h"
+#include "config.h"
+#include "upstream.h"
+#include "health.h"
+
+//#define DEBUG // uncomment this line to enable debugging
+
+#ifdef DEBUG
+/* When debugging is enabled, these form aliases to useful functions */
+#define dbg_printf(...) printf(__VA_ARGS__)
+#else
+/* When debugging is disabled, no code gets generated for these */
+#define dbg_printf(...)
+#endif
+
+static char *state_names[] = {"closed", "open", "half-open"};
+
+static health_t *buckets[HEALTH_BUCKETS];
+static sem_t health_mutex;
+static pthread_once_t health_once = PTHREAD_ONCE_INIT;
+static health_stats_t h_stats;
+
+static void health_init(void)
+{
+    Sem_init(&health_mutex, 0, 1);
+}
+
+/* health_state_name() names a breaker state */
+char *health_state_name(int state)
+{
+    return state_names[state];
+}
+
+/*
+ * health_get() returns the entry of host:port, adding it if needed.
+ * probe marks it for checks while healthy. returns NULL if the table
+ * is full
+ */
+health_t *health_get(char *host, char *port, bool probe)
+{
+    unsigned long b = (hash_key(host) ^ hash_key(port)) % HEALTH_BUCKETS;
+    health_t *h;
+
+    pthread_once(&health_once, health_init);
+    P(&health_mutex);
+    for(h = buckets[b]; h != NULL; h = h->next)
+        if(!strcmp(h->host, host) && !strcmp(h->port, port))
+            break;
+    if(h == NULL && h_stats.entries < HEALTH_MAX_ENTRIES &&
+       (h = calloc(1, sizeof(health_t))) != NULL)
+    {
+        strncpy(h->host, host, HEALTH_NAME_LEN - 1);
+        strncpy(h->port, port, HEALTH_NAME_LEN - 1);
+        h->state = HEALTH_CLOSED;
+        h->next = buckets[b];
+        buckets[b] = h;
+        h_stats.entries++;
+    }
+    if(h != NULL && probe)
+        h->probe = true;
+    V(&health_mutex);
+    return h;
+}
+
+/*
+ * health_usable() tells whether a request to h could go through now,
+ * without claiming a half-open trial
+ */
+bool health_usable(health_t *h)
+{
+    return h->state == HEALTH_CLOSED ||
+           (h->state == HEALTH_OPEN && time(NULL) >= h->open_until);
+}
+
+/*
+ * health_allow() decides whether a request may be sent to h. Claims the
+ * trial if the breaker is due for one; the caller must then report
+ */
+bool health_allow(health_t *h)
+{
+    bool ok = true;
+
+    P(&health_mutex);
+    if(h->state == HEALTH_OPEN && time(NULL) >= h->open_until)
+    {
+        dbg_printf("health: %s:%s half-open\n", h->host, h->port);
+        h->state = HEALTH_HALF_OPEN;
+        h_stats.trials++;
+    }
+    // while half-open only the trial goes through
+    else if(h->state != HEALTH_CLOSED)
+    {
+        h_stats.rejected++;
+        ok = false;
+    }
+    V(&health_mutex);
+    return ok;
+}
+
+/* opens the breaker of h, called with health_mutex held */
+static void trip(health_t *h)
+{
+    if(h->state != HEALTH_OPEN)
+    {
+        dbg_printf("health: %s:%s open\n", h->host, h->port);
+        h_stats.trips++;
+    }
+    h->state = HEALTH_OPEN;
+    h->open_until = time(NULL) + config.breaker_open_time;
+}
+
+/* health_report() records whether a request sent to h succeeded */
+void health_report(health_t *h, bool ok)
+{
+    P(&health_mutex);
+    if(ok)
+    {
+        h->failures = 0;
+        h->state = HEALTH_CLOSED;
+        h->connect_failed_until = 0;
+    }
+    else
+    {
+        h->failures++;
+        // failed probes keep an open breaker open
+        if(h->state != HEALTH_CLOSED ||
+           (config.breaker_failures > 0 &&
+            h->failures >= config.breaker_failures))
+            trip(h);
+    }
+    V(&health_mutex);
+}
+
+/*
+ * health_cancel() is for a request health_allow() let through that was
+ * given up before it had an outcome: a trial it claimed is due again
+ */
+void health_cancel(health_t *h)
+{
+    P(&health_mutex);
+    if(h->state == HEALTH_HALF_OPEN)
+    {
+        h->state = HEALTH_OPEN;
+        h->open_until = time(NULL);
+    }
+    V(&health_mutex);
+}
+
+/*
+ * health_connect_failed() records a failed connect to h: for the next
+ * negative_connect_ttl seconds requests to it fail without connecting
+ */
+void health_connect_failed(health_t *h)
+{
+    P(&health_mutex);
+    h->connect_failed_until = time(NULL) + config.negative_connect_ttl;
+    V(&health_mutex);
+}
+
+/*
+ * health_connect_cached() tells whether a connect to h failed within
+ * negative_connect_ttl seconds, counting the request that then fails
+ */
+bool health_connect_cached(health_t *h)
+{
+    bool cached;
+
+    P(&health_mutex);
+    if((cached = time(NULL) < h->connect_failed_until))
+        h_stats.connects_cached++;
+    V(&health_mutex);
+    return cached;
+}
+
+/* health_count_stale() counts a stale copy served for a failed server */
+void health_count_stale(void)
+{
+    __sync_fetch_and_add(&h_stats.stale_served, 1);
+}
+
+/*
+ * probe() checks one server: it has to accept a connection and, if
+ * health_path is set, answer a GET of it with a 2xx or 3xx status
+ */
+static bool probe(char *host, char *port)
+{
+    struct timeval tv = {HEALTH_PROBE_TIMEOUT, 0};
+    char buf[MAXLINE];
+    rio_t rio;
+    int fd, status;
+    bool ok;
+
+    if((fd = upstream_connect(host, port)) < 0)
+        return false;
+    if(config.health_path[0] == '\0')
+    {
+        close(fd);
+        return true;
+    }
+
+    // cannot happen with health_path and the host bounded, but check
+    if(snprintf(buf, MAXLINE, "GET %s HTTP/1.1\r\nHost: %s\r\n"
+                              "Connection: close\r\n\r\n",
+                              config.health_path, host) >= MAXLINE)
+    {
+        close(fd);
+        return false;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    rio_readinitb(&rio, fd);
+    ok = rio_writen(fd, buf, strlen(buf)) >= 0 &&
+         rio_readlineb(&rio, buf, MAXLINE) > 0 &&
+         sscanf(buf, "HTTP/%*s %d", &status) == 1 &&
+         status >= 200 && status < 400;
+    close(fd);
+    return ok;
+}
+
+/* probes the servers that need it every health_interval seconds */
+static void *probe_thread(void *vargp)
+{
+    health_t *h, **due = NULL;
+    int b, i, n, max = 0;
+    bool ok;
+
+    Pthread_detach(pthread_self());
+    while(1)
+    {
+        sleep(config.health_interval > 0 ? config.health_interval : 1);
+        if(config.health_interval <= 0)
+            continue;
+
+        // entries are never freed, probe them without the lock
+        P(&health_mutex);
+        if(max < h_stats.entries)
+        {
+            max = h_stats.entries;
+            free(due);
+            due = malloc(max * sizeof(health_t *));
+        }
+        for(n = 0, b = 0; due != NULL && b < HEALTH_BUCKETS; b++)
+            for(h = buckets[b]; h != NULL; h = h->next)
+                if(h->probe || h->state != HEALTH_CLOSED)
+                    due[n++] = h;
+        V(&health_mutex);
+
+        for(i = 0; i < n; i++)
+        {
+            ok = probe(due[i]->host, due[i]->port);
+            __sync_fetch_and_add(&h_stats.probes, 1);
+            if(!ok)
+                __sync_fetch_and_add(&h_stats.probe_failures, 1);
+            // a half-open breaker waits for its trial request
+            if(ok || due[i]->state != HEALTH_HALF_OPEN)
+                health_report(due[i], ok);
+        }
+    }
+    return NULL;
+}
+
+/* health_start() starts the probe thread */
+void health_start(void)
+{
+    pthread_t tid;
+
+    pthread_once(&health_once, health_init);
+    Pthread_create(&tid, NULL, probe_thread, NULL);
+}
+
+/* health_get_stats() fills in the counters */
+void health_get_stats(health_stats_t *stats)
+{
+    pthread_once(&health_once, health_init);
+    P(&health_mutex);
+    *stats = h_stats;
+    V(&health_mutex);
+}
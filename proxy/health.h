@@ -0,0 +1,135 @@
+/* Upstream health header file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+
+/*
+ * Health of the upstream servers, one entry per host:port, with a
+ * circuit breaker in front of each:
+ *
+ *   CLOSED --breaker_failures in a row--> OPEN --breaker_open_time-->
+ *   HALF_OPEN --trial succeeds--> CLOSED
+ *             --trial fails-----> OPEN
+ *
+ * Fetches report whether the server answered; connect and read errors
+ * and 502/503/504 responses count as failures. While the breaker is
+ * open requests are refused at once, so the client gets a stale copy
+ * or an error instead of waiting on a dead server. Once the open time
+ * is over a single trial request is let through (half-open) and its
+ * outcome closes or reopens the breaker.
+ *
+ * A probe thread checks the backends of the upstream groups, and any
+ * server whose breaker is open, every health_interval seconds: by
+ * connecting, and by requesting health_path if one is set. A passing
+ * probe closes the breaker, a failing one keeps it open.
+ *
+ * A failed connect is also remembered for negative_connect_ttl seconds,
+ * during which requests to the server fail at once (or get a stale
+ * copy) instead of each trying to connect again. Requests with
+ * Cache-Control: no-cache try anyway.
+ */
+
+#ifndef __HEALTH_H__
+#define __HEALTH_H__
+
+#include "csapp.h"
+
+#define HEALTH_BUCKETS 256
+#define HEALTH_MAX_ENTRIES 4096
+#define HEALTH_NAME_LEN 256
+#define HEALTH_PATH_MAX 1024        /* longest health_path */
+#define HEALTH_INTERVAL 5           /* default seconds between probes */
+#define HEALTH_PROBE_TIMEOUT 2      /* seconds a probe may take */
+#define BREAKER_FAILURES 5          /* default failures that open it */
+#define BREAKER_OPEN_TIME 10        /* default seconds it stays open */
+#define NEGATIVE_CONNECT_TTL 2      /* default seconds a failed connect */
+                                    /* is remembered */
+
+/* breaker states */
+#define HEALTH_CLOSED 0
+#define HEALTH_OPEN 1
+#define HEALTH_HALF_OPEN 2
+
+/* responses that mean the server is in trouble */
+#define HEALTH_FAILURE(status) \
+    ((status) == 502 || (status) == 503 || (status) == 504)
+
+typedef struct health health_t;
+
+typedef struct health
+{
+    char host[HEALTH_NAME_LEN];
+    char port[HEALTH_NAME_LEN];
+    int state;              // HEALTH_*
+    int failures;           // in a row
+    time_t open_until;      // end of the open time
+    time_t connect_failed_until; // connects fail at once until then
+    bool probe;             // checked even while healthy
+    health_t *next;
+}health_t;
+
+typedef struct health_stats
+{
+    size_t entries;          // servers tracked
+    size_t trips;            // breakers opened
+    size_t rejected;         // requests refused by an open breaker
+    size_t trials;           // half-open trial requests
+    size_t probes;           // probes sent
+    size_t probe_failures;   // probes that failed
+    size_t stale_served;     // stale copies served for a failed server
+    size_t connects_cached;  // requests failed by a cached connect failure
+}health_stats_t;
+
+/*
+ * health_get() returns the entry of host:port, adding it if needed.
+ * probe marks it for checks while healthy. returns NULL if the table
+ * is full
+ */
+health_t *health_get(char *host, char *port, bool probe);
+
+/*
+ * health_usable() tells whether a request to h could go through now,
+ * without claiming a half-open trial
+ */
+bool health_usable(health_t *h);
+
+/*
+ * health_allow() decides whether a request may be sent to h. Claims the
+ * trial if the breaker is due for one; the caller must then report
+ */
+bool health_allow(health_t *h);
+
+/* health_report() records whether a request sent to h succeeded */
+void health_report(health_t *h, bool ok);
+
+/*
+ * health_cancel() is for a request health_allow() let through that was
+ * given up before it had an outcome: a trial it claimed is due again
+ */
+void health_cancel(health_t *h);
+
+/*
+ * health_connect_failed() records a failed connect to h: for the next
+ * negative_connect_ttl seconds requests to it fail without connecting
+ */
+void health_connect_failed(health_t *h);
+
+/*
+ * health_connect_cached() tells whether a connect to h failed within
+ * negative_connect_ttl seconds, counting the request that then fails
+ */
+bool health_connect_cached(health_t *h);
+
+/* health_count_stale() counts a stale copy served for a failed server */
+void health_count_stale(void);
+
+/* health_start() starts the probe thread */
+void health_start(void);
+
+/* health_state_name() names a breaker state */
+char *health_state_name(int state);
+
+/* health_get_stats() fills in the counters */
+void health_get_stats(health_stats_t *stats);
+
+#endif /* __HEALTH_H__ */
@@ -0,0 +1,171 @@
+/* Hedged request file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+#include "csapp.h"
+#include "config.h"
+#include "hedge.h"
+#include <poll.h>
+
+//#define DEBUG // uncomment this line to enable debugging
+
+#ifdef DEBUG
+/* When debugging is enabled, these form aliases to useful functions */
+#define dbg_printf(...) printf(__VA_ARGS__)
+#else
+/* When debugging is disabled, no code gets generated for these */
+#define dbg_printf(...)
+#endif
+
+static long bounds[HEDGE_BUCKETS];      // upper end of each bucket in ms
+static unsigned long counts[HEDGE_BUCKETS];
+static unsigned long samples;           // in counts
+static unsigned long recorded;          // since the last halving
+static long tokens;                     // budget in hundredths of a hedge
+static sem_t hedge_mutex;
+static pthread_once_t hedge_once = PTHREAD_ONCE_INIT;
+static hedge_stats_t hedge_stats;
+
+/* buckets grow by a quarter each, from 1 ms to several seconds */
+static void hedge_init(void)
+{
+    int i;
+
+    Sem_init(&hedge_mutex, 0, 1);
+    bounds[0] = 1;
+    for(i = 1; i < HEDGE_BUCKETS; i++)
+    {
+        bounds[i] = bounds[i - 1] + bounds[i - 1] / 4;
+        if(bounds[i] == bounds[i - 1])
+            bounds[i]++;
+    }
+}
+
+/* hedge_clock() returns a monotonic time in ms */
+long hedge_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+/* the delay the recorded times give, called with hedge_mutex held */
+static long current_delay(void)
+{
+    unsigned long want, seen = 0;
+    int i;
+
+    if(config.hedge_percentile <= 0 || samples < HEDGE_MIN_SAMPLES)
+        return -1;
+    want = (samples * config.hedge_percentile + 99) / 100;
+    for(i = 0; i < HEDGE_BUCKETS - 1; i++)
+        if((seen += counts[i]) >= want)
+            break;
+    return bounds[i] > config.hedge_min_delay ? bounds[i] :
+                                                config.hedge_min_delay;
+}
+
+/*
+ * hedge_begin() counts a request that may be hedged and returns how
+ * many ms to wait for its first byte before hedging it, or -1 if it
+ * must not be hedged
+ */
+long hedge_begin(void)
+{
+    long delay;
+
+    pthread_once(&hedge_once, hedge_init);
+    P(&hedge_mutex);
+    hedge_stats.requests++;
+    tokens += config.hedge_budget;
+    if(tokens > HEDGE_BURST * 100)
+        tokens = HEDGE_BURST * 100;
+    delay = current_delay();
+    V(&hedge_mutex);
+    return delay;
+}
+
+/* hedge_record() adds the ms a request took to its first byte */
+void hedge_record(long ms)
+{
+    int i;
+
+    pthread_once(&hedge_once, hedge_init);
+    for(i = 0; i < HEDGE_BUCKETS - 1 && bounds[i] < ms; i++)
+        ;
+    P(&hedge_mutex);
+    counts[i]++;
+    samples++;
+    // older times count half as much every window, so the delay
+    // follows the backends as they speed up or slow down
+    if(++recorded >= HEDGE_WINDOW)
+    {
+        recorded = 0;
+        for(samples = 0, i = 0; i < HEDGE_BUCKETS; i++)
+            samples += (counts[i] /= 2);
+    }
+    V(&hedge_mutex);
+}
+
+/* hedge_admit() takes a hedge from the budget. returns false if empty */
+bool hedge_admit(void)
+{
+    bool ok;
+
+    pthread_once(&hedge_once, hedge_init);
+    P(&hedge_mutex);
+    if((ok = tokens >= 100))
+    {
+        tokens -= 100;
+        hedge_stats.hedged++;
+    }
+    else
+        hedge_stats.denied++;
+    V(&hedge_mutex);
+    return ok;
+}
+
+/* hedge_count_won() counts a second request that answered first */
+void hedge_count_won(void)
+{
+    __sync_fetch_and_add(&hedge_stats.won, 1);
+}
+
+/*
+ * hedge_wait() waits up to timeout ms (-1 = no limit) until one of the
+ * n (at most 2) sockets in fds has something to read. returns the index
+ * of the first one that has, or -1 on timeout
+ */
+int hedge_wait(int *fds, int n, long timeout)
+{
+    struct pollfd pfd[2];
+    long deadline = hedge_clock() + timeout, left = timeout;
+    int i, rc;
+
+    for(i = 0; i < n && i < 2; i++)
+    {
+        pfd[i].fd = fds[i];
+        pfd[i].events = POLLIN;
+    }
+    while((rc = poll(pfd, i, left)) < 0 && errno == EINTR)
+        if(timeout >= 0 && (left = deadline - hedge_clock()) < 0)
+            left = 0;
+    if(rc == 0)
+        return -1;
+    // on an error the read that follows reports it
+    for(i = 0; rc > 0 && i < n; i++)
+        if(pfd[i].revents)
+            return i;
+    return 0;
+}
+
+/* hedge_get_stats() fills in the counters */
+void hedge_get_stats(hedge_stats_t *stats)
+{
+    pthread_once(&hedge_once, hedge_init);
+    P(&hedge_mutex);
+    *stats = hedge_stats;
+    stats->delay = current_delay();
+    V(&hedge_mutex);
+}
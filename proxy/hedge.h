@@ -0,0 +1,75 @@
+/* Hedged request header file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+
+/*
+ * Hedged requests against slow backends. A GET sent to a backend of an
+ * upstream group that has not answered with its first byte within the
+ * hedge delay is sent to a second backend of the group as well; the
+ * first to answer serves the client and the other connection is closed.
+ * One slow replica then costs the request the hedge delay instead of
+ * its whole latency.
+ *
+ * The delay is the hedge_percentile of the recent times to first byte,
+ * kept in a histogram of HEDGE_BUCKETS log-spaced buckets whose counts
+ * are halved every HEDGE_WINDOW samples, and at least hedge_min_delay
+ * ms. No hedges are sent until HEDGE_MIN_SAMPLES times are known.
+ *
+ * The extra load is capped by a token budget: every request earns
+ * hedge_budget percent of a hedge, at most HEDGE_BURST hedges are saved
+ * up, and a hedge is only sent if a whole one is available.
+ */
+
+#ifndef __HEDGE_H__
+#define __HEDGE_H__
+
+#include "csapp.h"
+
+#define HEDGE_BUCKETS 40
+#define HEDGE_WINDOW 1000           /* samples between halvings */
+#define HEDGE_MIN_SAMPLES 20        /* samples before the first hedge */
+#define HEDGE_BURST 10              /* hedges the budget saves up */
+#define HEDGE_PERCENTILE 95         /* default percentile of the delay */
+#define HEDGE_MIN_DELAY 10          /* default lowest delay in ms */
+#define HEDGE_BUDGET 5              /* default hedges per 100 requests */
+
+typedef struct hedge_stats
+{
+    size_t requests;         // requests that could have been hedged
+    size_t hedged;           // second requests sent
+    size_t won;              // second requests that answered first
+    size_t denied;           // hedges the budget did not allow
+    long delay;              // current hedge delay in ms, -1 if unknown
+}hedge_stats_t;
+
+/* hedge_clock() returns a monotonic time in ms */
+long hedge_clock(void);
+
+/*
+ * hedge_begin() counts a request that may be hedged and returns how
+ * many ms to wait for its first byte before hedging it, or -1 if it
+ * must not be hedged
+ */
+long hedge_begin(void);
+
+/* hedge_record() adds the ms a request took to its first byte */
+void hedge_record(long ms);
+
+/* hedge_admit() takes a hedge from the budget. returns false if empty */
+bool hedge_admit(void);
+
+/* hedge_count_won() counts a second request that answered first */
+void hedge_count_won(void);
+
+/*
+ * hedge_wait() waits up to timeout ms (-1 = no limit) until one of the
+ * n (at most 2) sockets in fds has something to read. returns the index
+ * of the first one that has, or -1 on timeout
+ */
+int hedge_wait(int *fds, int n, long timeout);
+
+/* hedge_get_stats() fills in the counters */
+void hedge_get_stats(hedge_stats_t *stats);
+
+#endif /* __HEDGE_H__ */
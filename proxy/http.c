@@ -0,0 +1,874 @@
+/* HTTP helper file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+#define _DEFAULT_SOURCE     /* timegm() */
+#include "csapp.h"
+#include "http.h"
+#include "relay.h"
+#include <strings.h>
+#include <ctype.h>
+
+//#define DEBUG // uncomment this line to enable debugging
+
+#ifdef DEBUG
+/* When debugging is enabled, these form aliases to useful functions */
+#define dbg_printf(...) printf(__VA_ARGS__)
+#else
+/* When debugging is disabled, no code gets generated for these */
+#define dbg_printf(...)
+#endif
+
+http_stats_t http_stats;
+
+/*
+ * http_read_head() reads a header block from rp into buf.
+ * returns its length, or -1 on EOF, a read error or when the block
+ * does not fit in max bytes
+ */
+ssize_t http_read_head(rio_t *rp, char *buf, size_t max)
+{
+    size_t len = 0;
+    ssize_t n;
+
+    while(1)
+    {
+        if(max - len < 2)
+            return -1;
+        if((n = rio_readlineb(rp, buf + len, max - len)) <= 0)
+            return -1;
+        // a line filling the buffer without a newline is too long
+        if(buf[len + n - 1] != '\n')
+            return -1;
+        len += n;
+        if(!strcmp(buf + len - n, "\r\n") || !strcmp(buf + len - n, "\n"))
+            return len;
+    }
+}
+
+/*
+ * next_line() returns the start of the line after p in the block,
+ * or NULL at the end of the block
+ */
+static char *next_line(char *p, char *end)
+{
+    while(p < end && *p != '\n')
+        p++;
+    return (p + 1 < end) ? p + 1 : NULL;
+}
+
+/*
+ * header_match() returns the value of the header line at p if it is
+ * called name, NULL otherwise. *vlen gets the length of the value
+ * without the line ending and surrounding blanks
+ */
+static char *header_match(char *p, char *end, char *name, size_t *vlen)
+{
+    size_t nlen = strlen(name);
+    char *v, *e;
+
+    if(end - p <= nlen || strncasecmp(p, name, nlen) || p[nlen] != ':')
+        return NULL;
+    v = p + nlen + 1;
+    while(v < end && (*v == ' ' || *v == '\t'))
+        v++;
+    e = v;
+    while(e < end && *e != '\r' && *e != '\n')
+        e++;
+    while(e > v && (e[-1] == ' ' || e[-1] == '\t'))
+        e--;
+    *vlen = e - v;
+    return v;
+}
+
+/* find_value() looks for header name in the lines from p to end */
+static bool find_value(char *p, char *end, char *name,
+                       char *out, size_t outlen)
+{
+    char *v;
+    size_t vlen;
+
+    for(; p != NULL; p = next_line(p, end))
+    {
+        if((v = header_match(p, end, name, &vlen)) != NULL)
+        {
+            if(vlen >= outlen)
+                vlen = outlen - 1;
+            memcpy(out, v, vlen);
+            out[vlen] = '\0';
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * http_header_value() copies the value of the first header called name
+ * (without the colon) into out. returns false if there is none
+ */
+bool http_header_value(char *hdr, size_t len, char *name,
+                       char *out, size_t outlen)
+{
+    // skip the status line
+    return find_value(next_line(hdr, hdr + len), hdr + len, name,
+                      out, outlen);
+}
+
+/*
+ * http_request_value() is http_header_value() for the header lines of a
+ * request, which come without a request line
+ */
+bool http_request_value(char *hdrs, char *name, char *out, size_t outlen)
+{
+    return find_value(hdrs, hdrs + strlen(hdrs), name, out, outlen);
+}
+
+/* http_status() returns the status code of a header block, 0 if none */
+int http_status(char *hdr, size_t len)
+{
+    int major, minor, status;
+
+    if(len < 12 || 
+       sscanf(hdr, "HTTP/%d.%d %d", &major, &minor, &status) != 3)
+        return 0;
+    return status;
+}
+
+static int token_cmp(const void *a, const void *b)
+{
+    return strcmp(*(char **)a, *(char **)b);
+}
+
+/*
+ * normalize_list() copies the comma separated list in value to out,
+ * of size max, without blanks and with its elements sorted; names are
+ * lowercased too
+ */
+static void normalize_list(char *value, char *out, size_t max, bool names)
+{
+    char buf[MAXLINE], *tokens[HTTP_MAX_TOKENS], *p, *q;
+    size_t n = 0, len = 0, i;
+
+    // drop the blanks, split at the commas
+    for(p = value, q = buf; *p != '\0' && q < buf + MAXLINE - 1; p++)
+    {
+        if(*p == ' ' || *p == '\t')
+            continue;
+        *q++ = names ? tolower((unsigned char)*p) : *p;
+    }
+    *q = '\0';
+    for(p = strtok_r(buf, ",", &q); p != NULL && n < HTTP_MAX_TOKENS;
+        p = strtok_r(NULL, ",", &q))
+        tokens[n++] = p;
+    qsort(tokens, n, sizeof(char *), token_cmp);
+
+    out[0] = '\0';
+    for(i = 0; i < n && len < max; i++)
+        len += snprintf(out + len, max - len, i ? ",%s" : "%s", tokens[i]);
+}
+
+/*
+ * build_variant() writes a "name:value\n" line for each header in the
+ * list names with its normalized value in the request headers reqhdrs,
+ * empty if the request has none
+ */
+static void build_variant(char *names, char *reqhdrs, char *variant,
+                          size_t max)
+{
+    char list[MAXLINE], value[MAXLINE], norm[MAXLINE], *name, *save;
+    size_t len = 0;
+
+    strcpy(list, names);
+    variant[0] = '\0';
+    for(name = strtok_r(list, ",", &save); name != NULL && len < max;
+        name = strtok_r(NULL, ",", &save))
+    {
+        if(reqhdrs == NULL || 
+           !http_request_value(reqhdrs, name, value, MAXLINE))
+            value[0] = '\0';
+        normalize_list(value, norm, MAXLINE, false);
+        len += snprintf(variant + len, max - len, "%s:%s\n", name, norm);
+    }
+}
+
+/*
+ * http_variant() writes the secondary cache key of a response with a
+ * Vary header into variant, of size max: the headers it names with
+ * their values in the request headers reqhdrs. returns false, with an
+ * empty key, if the response does not vary
+ */
+bool http_variant(char *hdr, size_t len, char *reqhdrs, char *variant,
+                  size_t max)
+{
+    char vary[MAXLINE] = "", names[MAXLINE], *p, *v, *end = hdr + len;
+    size_t vlen, n = 0;
+
+    // the names of every Vary header, as one list
+    for(p = next_line(hdr, end); p != NULL; p = next_line(p, end))
+    {
+        if((v = header_match(p, end, "Vary", &vlen)) == NULL ||
+           n + vlen + 2 > MAXLINE)
+            continue;
+        if(n > 0)
+            vary[n++] = ',';
+        memcpy(vary + n, v, vlen);
+        vary[n += vlen] = '\0';
+    }
+    normalize_list(vary, names, MAXLINE, true);
+    variant[0] = '\0';
+    if(names[0] == '\0' || strchr(names, '*'))
+        return false;
+    build_variant(names, reqhdrs, variant, max);
+    return true;
+}
+
+/*
+ * http_variant_match() tells whether a request with the headers reqhdrs
+ * selects the stored variant made by http_variant()
+ */
+bool http_variant_match(char *variant, char *reqhdrs)
+{
+    char names[MAXLINE], mine[MAXLINE], *p, *q = names;
+
+    // the names are the start of each line
+    for(p = variant; *p != '\0' && q < names + MAXLINE - 1; p++)
+    {
+        if(*p == ':')
+        {
+            if(q > names && q < names + MAXLINE - 1)
+                *q++ = ',';
+            while(*p != '\0' && *p != '\n')
+                p++;
+            if(*p == '\0')
+                break;
+            continue;
+        }
+        *q++ = *p;
+    }
+    *q = '\0';
+    build_variant(names, reqhdrs, mine, MAXLINE);
+    return !strcmp(mine, variant);
+}
+
+/* http_parse_date() parses an HTTP-date, returns 0 if it is invalid */
+time_t http_parse_date(char *str)
+{
+    struct tm tm;
+    char *formats[] = {
+        "%a, %d %b %Y %H:%M:%S GMT",    // IMF-fixdate
+        "%A, %d-%b-%y %H:%M:%S GMT",    // obsolete RFC 850
+        "%a %b %d %H:%M:%S %Y",         // obsolete asctime
+    };
+    int i;
+
+    for(i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+    {
+        memset(&tm, 0, sizeof(tm));
+        if(strptime(str, formats[i], &tm) != NULL)
+            return timegm(&tm);
+    }
+    return 0;
+}
+
+/*
+ * parse_seconds() parses a delta-seconds value,
+ * returns -1 if there is none
+ */
+static long parse_seconds(char *p)
+{
+    if(*p == '"')
+        p++;
+    if(!isdigit((unsigned char)*p))
+        return -1;
+    return strtol(p, NULL, 10);
+}
+
+/* parse_cache_control() adds the directives in value to meta */
+static void parse_cache_control(char *value, httpmeta_t *meta)
+{
+    char *tok, *save, *arg;
+
+    for(tok = strtok_r(value, ",", &save); tok != NULL;
+            tok = strtok_r(NULL, ",", &save))
+    {
+        while(*tok == ' ' || *tok == '\t')
+            tok++;
+        if((arg = strchr(tok, '=')) != NULL)
+            *arg++ = '\0';
+
+        if(!strcasecmp(tok, "no-store"))
+            meta->cc |= CC_NO_STORE;
+        else if(!strcasecmp(tok, "no-cache"))
+            meta->cc |= CC_NO_CACHE;
+        else if(!strcasecmp(tok, "private"))
+            meta->cc |= CC_PRIVATE;
+        else if(!strcasecmp(tok, "public"))
+            meta->cc |= CC_PUBLIC;
+        else if(!strcasecmp(tok, "must-revalidate") ||
+                !strcasecmp(tok, "proxy-revalidate"))
+            meta->cc |= CC_MUST_REVALIDATE;
+        else if(!strcasecmp(tok, "max-age") && arg)
+            meta->max_age = parse_seconds(arg);
+        else if(!strcasecmp(tok, "s-maxage") && arg)
+            meta->s_maxage = parse_seconds(arg);
+        else if(!strcasecmp(tok, "stale-while-revalidate") && arg)
+            meta->swr = parse_seconds(arg);
+    }
+}
+
+/* has_token() tells whether the comma separated list has token */
+static bool has_token(char *list, char *token)
+{
+    size_t n = strlen(token);
+    char *p = list;
+
+    while(*p != '\0')
+    {
+        while(*p == ' ' || *p == '\t' || *p == ',')
+            p++;
+        if(!strncasecmp(p, token, n) &&
+           (p[n] == '\0' || p[n] == ',' || p[n] == ' ' || p[n] == ';'))
+            return true;
+        while(*p != '\0' && *p != ',')
+            p++;
+    }
+    return false;
+}
+
+/*
+ * http_request_no_cache() tells whether the request headers hdrs ask
+ * for a response from the server, with Cache-Control: no-cache or
+ * Pragma: no-cache
+ */
+bool http_request_no_cache(char *hdrs)
+{
+    char value[MAXLINE];
+
+    return (http_request_value(hdrs, "Cache-Control", value, MAXLINE) &&
+            has_token(value, "no-cache")) ||
+           (http_request_value(hdrs, "Pragma", value, MAXLINE) &&
+            has_token(value, "no-cache"));
+}
+
+/* http_parse_response() fills meta from a response header block */
+void http_parse_response(char *hdr, size_t len, httpmeta_t *meta)
+{
+    char *end = hdr + len, *p, *v, *colon;
+    char name[MAXLINE], value[MAXLINE];
+    size_t vlen;
+
+    int major = 0, minor = 0;
+
+    memset(meta, 0, sizeof(*meta));
+    meta->max_age = meta->s_maxage = meta->swr = -1;
+    meta->date = meta->expires = meta->last_modified = -1;
+    meta->content_length = -1;
+
+    if(sscanf(hdr, "HTTP/%d.%d %d", &major, &minor, &meta->status) != 3)
+        meta->status = 0;
+    // HTTP/1.0 connections close unless kept alive explicitly
+    meta->close = (major == 1 && minor == 0);
+
+    for(p = next_line(hdr, end); p != NULL; p = next_line(p, end))
+    {
+        if((colon = memchr(p, ':', end - p)) == NULL ||
+                colon - p >= sizeof(name) || memchr(p, '\n', colon - p))
+            continue;
+        memcpy(name, p, colon - p);
+        name[colon - p] = '\0';
+        v = header_match(p, end, name, &vlen);
+        if(vlen >= sizeof(value))
+            vlen = sizeof(value) - 1;
+        memcpy(value, v, vlen);
+        value[vlen] = '\0';
+
+        if(!strcasecmp(name, "Cache-Control"))
+            parse_cache_control(value, meta);
+        else if(!strcasecmp(name, "Pragma"))
+        {
+            // HTTP/1.0 servers may only send Pragma
+            for(v = value; *v != '\0'; v++)
+                if(!strncasecmp(v, "no-cache", 8))
+                    meta->cc |= CC_NO_CACHE;
+        }
+        else if(!strcasecmp(name, "Expires"))
+            meta->expires = http_parse_date(value);
+        else if(!strcasecmp(name, "Date"))
+            meta->date = http_parse_date(value);
+        else if(!strcasecmp(name, "Age"))
+            meta->age = parse_seconds(value) > 0 ? parse_seconds(value) : 0;
+        else if(!strcasecmp(name, "Last-Modified"))
+            meta->last_modified = http_parse_date(value);
+        else if(!strcasecmp(name, "ETag"))
+            meta->has_etag = true;
+        else if(!strcasecmp(name, "Vary") && strchr(value, '*'))
+            meta->has_vary_star = true;
+        else if(!strcasecmp(name, "Content-Length"))
+            meta->content_length = strtoll(value, NULL, 10);
+        else if(!strcasecmp(name, "Transfer-Encoding"))
+            meta->chunked = has_token(value, "chunked");
+        else if(!strcasecmp(name, "Connection"))
+        {
+            if(has_token(value, "close"))
+                meta->close = true;
+            else if(has_token(value, "keep-alive"))
+                meta->close = false;
+        }
+    }
+}
+
+/* is_hop_header() tells whether the header line at p is hop-by-hop */
+static bool is_hop_header(char *p)
+{
+    char *hop[] = { "Connection:", "Keep-Alive:", "Proxy-Connection:",
+                    "Transfer-Encoding:", "TE:", "Trailer:", "Upgrade:",
+                    "Proxy-Authenticate:" };
+    int i;
+
+    for(i = 0; i < sizeof(hop) / sizeof(hop[0]); i++)
+        if(!strncasecmp(p, hop[i], strlen(hop[i])))
+            return true;
+    return false;
+}
+
+/*
+ * http_clean_head() copies a response header block to out without the
+ * hop-by-hop headers of the server connection (Connection, Keep-Alive,
+ * Transfer-Encoding and the like) and with "Connection: close" for the
+ * client. returns the new length, or -1 if it does not fit in max
+ */
+ssize_t http_clean_head(char *hdr, size_t len, char *out, size_t max)
+{
+    char *end = hdr + len, *p, *next, *close = "Connection: close\r\n";
+    size_t olen = 0, n;
+
+    for(p = hdr; p != NULL; p = next)
+    {
+        next = next_line(p, end);
+        n = (next ? next : end) - p;
+        if(!strncmp(p, "\r\n", 2) || *p == '\n')
+            break;
+        if(p != hdr && is_hop_header(p))
+            continue;
+        if(olen + n > max)
+            return -1;
+        memcpy(out + olen, p, n);
+        olen += n;
+    }
+
+    if(olen + strlen(close) + 2 > max)
+        return -1;
+    memcpy(out + olen, close, strlen(close));
+    olen += strlen(close);
+    memcpy(out + olen, "\r\n", 2);
+    return olen + 2;
+}
+
+/*
+ * http_body_init() prepares to read the body of the response described
+ * by meta from rp
+ */
+void http_body_init(httpbody_t *body, rio_t *rp, httpmeta_t *meta)
+{
+    body->rp = rp;
+    body->remaining = 0;
+    body->done = false;
+
+    // no body: 1xx, 204 and 304 (RFC 9112, 6.3)
+    if(meta->status / 100 == 1 || meta->status == 204 ||
+       meta->status == 304)
+        body->mode = BODY_NONE;
+    else if(meta->chunked)
+        body->mode = BODY_CHUNKED;
+    else if(meta->content_length >= 0)
+    {
+        body->mode = BODY_LENGTH;
+        body->remaining = meta->content_length;
+    }
+    else
+        body->mode = BODY_CLOSE;
+
+    if(body->mode == BODY_NONE ||
+       (body->mode == BODY_LENGTH && body->remaining == 0))
+        body->done = true;
+}
+
+/* reads the size line of the next chunk, and the trailers after the
+ * last one. returns -1 on a malformed chunk */
+static int next_chunk(httpbody_t *body)
+{
+    char line[MAXLINE];
+
+    if(rio_readlineb(body->rp, line, MAXLINE) <= 0 ||
+       !isxdigit((unsigned char)line[0]))
+        return -1;
+    body->remaining = strtoll(line, NULL, 16);
+    if(body->remaining < 0)
+        return -1;
+    if(body->remaining > 0)
+        return 0;
+
+    // last chunk: skip the trailer section up to the blank line
+    do
+    {
+        if(rio_readlineb(body->rp, line, MAXLINE) <= 0)
+            return -1;
+    }while(strcmp(line, "\r\n") && strcmp(line, "\n"));
+    body->done = true;
+    return 0;
+}
+
+/*
+ * http_body_read() reads up to n decoded body bytes into buf.
+ * returns the bytes read, 0 at the end of the body, -1 on an error
+ */
+ssize_t http_body_read(httpbody_t *body, char *buf, size_t n)
+{
+    char crlf[2];
+    ssize_t rc;
+
+    if(body->done)
+        return 0;
+
+    if(body->mode == BODY_CLOSE)
+    {
+        if((rc = rio_readnb(body->rp, buf, n)) == 0)
+            body->done = true;
+        return rc;
+    }
+
+    if(body->mode == BODY_CHUNKED && body->remaining == 0)
+    {
+        if(next_chunk(body) < 0)
+            return -1;
+        if(body->done)
+            return 0;
+    }
+
+    // never ask for more than is left, the server will not send it
+    if(n > body->remaining)
+        n = body->remaining;
+    if((rc = rio_readnb(body->rp, buf, n)) <= 0)
+        return -1;
+    body->remaining -= rc;
+
+    if(body->remaining == 0)
+    {
+        if(body->mode == BODY_LENGTH)
+            body->done = true;
+        else if(rio_readnb(body->rp, crlf, 2) != 2)
+            return -1;
+    }
+    return rc;
+}
+
+/*
+ * http_body_relay() forwards the rest of a Content-Length or
+ * close-delimited body to fd with splice(), without copying it through
+ * a user space buffer; chunked bodies have to be decoded and are not
+ * relayed. returns the bytes forwarded, or -1 on an error
+ */
+ssize_t http_body_relay(httpbody_t *body, int fd)
+{
+    rio_t *rp = body->rp;
+    ssize_t n, rc, total = 0;
+    bool eof;
+
+    if(body->done)
+        return 0;
+    if(body->mode != BODY_LENGTH && body->mode != BODY_CLOSE)
+        return -1;
+
+    // what the head read left in the rio buffer goes out first
+    if(rp->rio_cnt > 0)
+    {
+        n = rp->rio_cnt;
+        if(body->mode == BODY_LENGTH && n > body->remaining)
+            n = body->remaining;
+        if(rio_writen(fd, rp->rio_bufptr, n) < 0)
+            return -1;
+        rp->rio_bufptr += n;
+        rp->rio_cnt -= n;
+        if(body->mode == BODY_LENGTH)
+            body->remaining -= n;
+        total = n;
+    }
+
+    rc = relay_splice(rp->rio_fd, fd, body->mode == BODY_LENGTH ?
+                                      body->remaining : -1, &eof);
+    if(rc < 0)
+        return -1;
+    total += rc;
+    __sync_fetch_and_add(&http_stats.relayed, 1);
+    __sync_fetch_and_add(&http_stats.relayed_bytes, total);
+
+    if(body->mode == BODY_LENGTH)
+    {
+        body->remaining -= rc;
+        if(body->remaining > 0)
+            return -1;
+    }
+    body->done = true;
+    return total;
+}
+
+/*
+ * http_cacheable() tells whether a shared cache may store the response.
+ * authorized is set when the request carried an Authorization header.
+ */
+bool http_cacheable(httpmeta_t *meta, bool authorized)
+{
+    switch(meta->status)
+    {
+        // cacheable by default; errors are not kept
+        case 200: case 203: case 204: case 300: case 301: case 308:
+            break;
+        default:
+            // errors are only kept as short lived negative entries
+            if(!HTTP_NEGATIVE(meta->status))
+                return false;
+            break;
+    }
+
+    if(meta->cc & (CC_NO_STORE | CC_PRIVATE))
+        return false;
+    if(meta->has_vary_star)
+        return false;
+    // a shared cache must not reuse authorized responses unless told so
+    if(authorized && !(meta->cc & (CC_PUBLIC | CC_MUST_REVALIDATE)) &&
+            meta->s_maxage < 0)
+        return false;
+    return true;
+}
+
+/*
+ * http_expires() returns the time until which the response is fresh,
+ * from the request and response times of the exchange. default_ttl is
+ * used when the response has neither explicit freshness nor a
+ * Last-Modified date to derive one from.
+ */
+time_t http_expires(httpmeta_t *meta, time_t request_time,
+                    time_t response_time, long default_ttl)
+{
+    long lifetime, apparent_age, initial_age;
+    time_t date = meta->date > 0 ? meta->date : response_time;
+
+    // no-cache: store, but check with the server before every use
+    if(meta->cc & CC_NO_CACHE)
+        return 0;
+
+    if(meta->s_maxage >= 0)
+        lifetime = meta->s_maxage;
+    else if(meta->max_age >= 0)
+        lifetime = meta->max_age;
+    else if(meta->expires >= 0)
+        lifetime = meta->expires > date ? meta->expires - date : 0;
+    else if(meta->last_modified > 0 && meta->last_modified < date &&
+            !HTTP_NEGATIVE(meta->status))
+    {
+        lifetime = (date - meta->last_modified) * HEURISTIC_FRACTION;
+        if(lifetime > HEURISTIC_MAX)
+            lifetime = HEURISTIC_MAX;
+    }
+    else
+        lifetime = default_ttl;
+
+    // age the response had when we got it (RFC 9111, 4.2.3)
+    apparent_age = response_time - date > 0 ? response_time - date : 0;
+    initial_age = meta->age + (response_time - request_time);
+    if(apparent_age > initial_age)
+        initial_age = apparent_age;
+
+    if(lifetime <= initial_age)
+        return 0;
+    return response_time + lifetime - initial_age;
+}
+
+/*
+ * http_stale_grace() returns how many seconds past its expiry the
+ * response may still be served while it is refreshed: its own
+ * stale-while-revalidate, none if it must be revalidated, else
+ * default_grace
+ */
+long http_stale_grace(httpmeta_t *meta, long default_grace)
+{
+    if(meta->cc & (CC_MUST_REVALIDATE | CC_NO_CACHE) ||
+       HTTP_NEGATIVE(meta->status))
+        return 0;
+    if(meta->swr >= 0)
+        return meta->swr;
+    return default_grace;
+}
+
+/*
+ * http_merge_304() builds the header block of a stored response
+ * refreshed by a 304: every header in the 304 replaces the stored
+ * header of the same name, the rest of the stored block is kept.
+ * returns the new length, or -1 if it does not fit in max
+ */
+ssize_t http_merge_304(char *stored, size_t stored_len, char *update,
+                       size_t update_len, char *out, size_t max)
+{
+    char *send = stored + stored_len, *uend = update + update_len;
+    char *p, *q, *next, *colon, name[MAXLINE];
+    size_t len = 0, n;
+    bool replaced;
+
+    // stored lines (including the status line) not named in the update;
+    // the blank line at the end is added back last
+    for(p = stored; p != NULL; p = next)
+    {
+        next = next_line(p, send);
+        n = (next ? next : send) - p;
+        if(!strncmp(p, "\r\n", 2) || *p == '\n')
+            break;
+
+        replaced = false;
+        if(p != stored && (colon = memchr(p, ':', n)) != NULL &&
+                colon - p < sizeof(name))
+        {
+            memcpy(name, p, colon - p);
+            name[colon - p] = '\0';
+            // the body is unchanged, keep describing it
+            if(strcasecmp(name, "Content-Length") &&
+               strcasecmp(name, "Transfer-Encoding"))
+            {
+                for(q = next_line(update, uend); q && !replaced;
+                        q = next_line(q, uend))
+                    replaced = !strncasecmp(q, name, colon - p) &&
+                                    q[colon - p] == ':';
+            }
+        }
+        if(replaced)
+            continue;
+        if(len + n > max)
+            return -1;
+        memcpy(out + len, p, n);
+        len += n;
+    }
+
+    // then every header of the update
+    for(q = next_line(update, uend); q != NULL; q = next)
+    {
+        next = next_line(q, uend);
+        n = (next ? next : uend) - q;
+        if(!strncmp(q, "\r\n", 2) || *q == '\n')
+            break;
+        if(!strncasecmp(q, "Content-Length:", 15) ||
+           !strncasecmp(q, "Transfer-Encoding:", 18))
+            continue;
+        if(len + n > max)
+            return -1;
+        memcpy(out + len, q, n);
+        len += n;
+    }
+
+    if(len + 2 > max)
+        return -1;
+    memcpy(out + len, "\r\n", 2);
+    return len + 2;
+}
+
+/*
+ * http_accepts() tells whether a request with the headers reqhdrs takes
+ * a response in the content coding named coding: Accept-Encoding lists
+ * it, or "*", with a q value other than 0
+ */
+bool http_accepts(char *reqhdrs, char *coding)
+{
+    char value[MAXLINE], *tok, *save, *q;
+    size_t n;
+    int any = -1;
+
+    if(!http_request_value(reqhdrs, "Accept-Encoding", value, MAXLINE))
+        return false;
+    for(tok = strtok_r(value, ",", &save); tok != NULL;
+            tok = strtok_r(NULL, ",", &save))
+    {
+        while(*tok == ' ' || *tok == '\t')
+            tok++;
+        n = strcspn(tok, " \t;");
+        // q=0, q=0.0 and the like refuse the coding
+        q = strstr(tok + n, "q=");
+        if(n == strlen(coding) && !strncasecmp(tok, coding, n))
+            return q == NULL || strtod(q + 2, NULL) > 0;
+        if(n == 1 && *tok == '*')
+            any = q == NULL || strtod(q + 2, NULL) > 0;
+    }
+    return any == 1;
+}
+
+/*
+ * http_compressible() tells whether the body of the response with the
+ * header block hdr may be stored in another coding: it has none yet
+ * and Cache-Control: no-transform does not forbid it
+ */
+bool http_compressible(char *hdr, size_t len)
+{
+    char value[MAXLINE];
+
+    if(http_header_value(hdr, len, "Content-Encoding", value, MAXLINE) &&
+       strcasecmp(value, "identity"))
+        return false;
+    return !(http_header_value(hdr, len, "Cache-Control", value, MAXLINE) &&
+             has_token(value, "no-transform"));
+}
+
+/*
+ * http_encode_head() builds the header block of the response hdr with
+ * its body sent in the content coding named coding, clen bytes long:
+ * Content-Encoding and Content-Length are set, a strong ETag is made
+ * weak and Vary gets Accept-Encoding. returns the new length, or -1 if
+ * it does not fit in max
+ */
+ssize_t http_encode_head(char *hdr, size_t len, char *coding, size_t clen,
+                         char *out, size_t max)
+{
+    char *end = hdr + len, *p, *next, *v, line[MAXLINE];
+    size_t olen = 0, n, vlen;
+    bool vary = false;
+
+    for(p = hdr; p != NULL; p = next)
+    {
+        next = next_line(p, end);
+        n = (next ? next : end) - p;
+        if(!strncmp(p, "\r\n", 2) || *p == '\n')
+            break;
+        line[0] = '\0';
+        if(p == hdr)
+            ;
+        else if(!strncasecmp(p, "Content-Length:", 15) ||
+                !strncasecmp(p, "Content-Encoding:", 17))
+            continue;
+        else if((v = header_match(p, end, "ETag", &vlen)) != NULL &&
+                vlen < MAXLINE - 16 && *v == '"')
+            sprintf(line, "ETag: W/%.*s\r\n", (int)vlen, v);
+        else if((v = header_match(p, end, "Vary", &vlen)) != NULL &&
+                vlen < MAXLINE - 32)
+        {
+            vary = true;
+            sprintf(line, "Vary: %.*s\r\n", (int)vlen, v);
+            if(!strchr(line, '*') && !has_token(line + 6, "Accept-Encoding"))
+                sprintf(line, "Vary: %.*s, Accept-Encoding\r\n", 
+                              (int)vlen, v);
+        }
+
+        if(line[0] != '\0')
+        {
+            p = line;
+            n = strlen(line);
+        }
+        if(olen + n > max)
+            return -1;
+        memcpy(out + olen, p, n);
+        olen += n;
+    }
+
+    n = snprintf(line, MAXLINE, "%sContent-Encoding: %s\r\n"
+                                "Content-Length: %lu\r\n\r\n",
+                 vary ? "" : "Vary: Accept-Encoding\r\n", coding, clen);
+    if(olen + n > max)
+        return -1;
+    memcpy(out + olen, line, n);
+    return olen + n;
+}
@@ -0,0 +1,247 @@
+/* HTTP helper header file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+
+/*
+ * Parsing of response header blocks and the caching rules of a shared
+ * cache (RFC 9111): which responses may be stored, how long they stay
+ * fresh, and how a 304 Not Modified refreshes a stored header block.
+ *
+ * A header block is the status line plus the header lines including
+ * the terminating blank line, exactly as read from the server.
+ *
+ * A response with a Vary header is stored as one of several variants of
+ * its URI. Its secondary key is a "name:value" line for each header
+ * Vary names, sorted, with the value the request had, without blanks
+ * and with its comma separated elements sorted:
+ *
+ *   Vary: Accept-Language, accept-encoding
+ *   -> "accept-encoding:br,gzip\naccept-language:en\n"
+ *
+ * Error responses (HTTP_NEGATIVE) are negative entries: cached for a
+ * short time per status class so a burst of requests for a broken URI
+ * does not reach the server every time, never served stale, and
+ * skipped by requests with Cache-Control: no-cache.
+ *
+ * Bodies from the server are framed by Content-Length, by chunked
+ * transfer coding or by the end of the connection; httpbody_t reads
+ * exactly one body, decoded, so the connection can be used again.
+ */
+
+#ifndef __HTTP_H__
+#define __HTTP_H__
+
+#include "csapp.h"
+
+/* Cache-Control directives we act on */
+#define CC_NO_STORE         0x01
+#define CC_NO_CACHE         0x02
+#define CC_PRIVATE          0x04
+#define CC_PUBLIC           0x08
+#define CC_MUST_REVALIDATE  0x10
+
+/* heuristic freshness is this fraction of (Date - Last-Modified) */
+#define HEURISTIC_FRACTION 0.1
+#define HEURISTIC_MAX (24*60*60)
+
+/*
+ * error statuses kept as negative entries, for negative_ttl_4xx and
+ * negative_ttl_5xx seconds unless the server says how long
+ */
+#define HTTP_NEGATIVE(status) \
+    ((status) == 404 || (status) == 405 || (status) == 410 || \
+     (status) == 414 || ((status) >= 500 && (status) <= 504))
+
+/* elements of a header list that are sorted to normalize it */
+#define HTTP_MAX_TOKENS 64
+
+typedef struct httpmeta
+{
+    int status;
+    int cc;                 // CC_* flags
+    long max_age;           // -1 when absent
+    long s_maxage;          // -1 when absent
+    long swr;               // stale-while-revalidate, -1 when absent
+    long age;               // Age header, 0 when absent
+    time_t date;            // -1 when absent
+    time_t expires;         // -1 when absent, 0 when invalid (= expired)
+    time_t last_modified;   // -1 when absent
+    bool has_etag;
+    bool has_vary_star;     // "Vary: *" can never be matched
+    long long content_length;   // -1 when absent
+    bool chunked;           // Transfer-Encoding: chunked
+    bool close;             // the server closes the connection after it
+}httpmeta_t;
+
+/* how a body is delimited */
+#define BODY_NONE 0
+#define BODY_LENGTH 1
+#define BODY_CHUNKED 2
+#define BODY_CLOSE 3
+
+/* reader of one response body */
+typedef struct httpbody
+{
+    rio_t *rp;
+    int mode;               // BODY_*
+    long long remaining;    // of the body or the current chunk
+    bool done;              // the whole body was read
+}httpbody_t;
+
+/* caching decisions of the proxy, bumped with __sync builtins */
+typedef struct http_stats
+{
+    size_t stored;           // responses inserted into the cache
+    size_t uncacheable;      // responses the rules kept out
+    size_t revalidated;      // conditional requests for stale entries
+    size_t not_modified;     // of those, answered with 304
+    size_t stale_served;     // stale entries served within their grace
+    size_t refreshes;        // background refreshes started
+    size_t relayed;          // bodies forwarded with splice()
+    size_t relayed_bytes;    // bytes of those bodies
+    size_t variants;         // responses stored as a variant of a key
+    size_t variant_evictions;// variants dropped over max_variants
+    size_t negative_stored;  // error responses stored as negative entries
+    size_t negative_hits;    // requests answered by a negative entry
+    size_t negative_bypassed;// negative entries skipped for no-cache
+}http_stats_t;
+
+extern http_stats_t http_stats;
+
+/*
+ * http_read_head() reads a header block from rp into buf.
+ * returns its length, or -1 on EOF, a read error or when the block
+ * does not fit in max bytes
+ */
+ssize_t http_read_head(rio_t *rp, char *buf, size_t max);
+
+/* http_parse_response() fills meta from a response header block */
+void http_parse_response(char *hdr, size_t len, httpmeta_t *meta);
+
+/*
+ * http_header_value() copies the value of the first header called name
+ * (without the colon) into out. returns false if there is none
+ */
+bool http_header_value(char *hdr, size_t len, char *name,
+                       char *out, size_t outlen);
+
+/*
+ * http_request_value() is http_header_value() for the header lines of a
+ * request, which come without a request line
+ */
+bool http_request_value(char *hdrs, char *name, char *out, size_t outlen);
+
+/*
+ * http_variant() writes the secondary cache key of a response with a
+ * Vary header into variant, of size max: the headers it names with
+ * their values in the request headers reqhdrs. returns false, with an
+ * empty key, if the response does not vary
+ */
+bool http_variant(char *hdr, size_t len, char *reqhdrs, char *variant,
+                  size_t max);
+
+/*
+ * http_variant_match() tells whether a request with the headers reqhdrs
+ * selects the stored variant made by http_variant()
+ */
+bool http_variant_match(char *variant, char *reqhdrs);
+
+/* http_status() returns the status code of a header block, 0 if none */
+int http_status(char *hdr, size_t len);
+
+/*
+ * http_request_no_cache() tells whether the request headers hdrs ask
+ * for a response from the server, with Cache-Control: no-cache or
+ * Pragma: no-cache
+ */
+bool http_request_no_cache(char *hdrs);
+
+/* http_parse_date() parses an HTTP-date, returns 0 if it is invalid */
+time_t http_parse_date(char *str);
+
+/*
+ * http_clean_head() copies a response header block to out without the
+ * hop-by-hop headers of the server connection (Connection, Keep-Alive,
+ * Transfer-Encoding and the like) and with "Connection: close" for the
+ * client. returns the new length, or -1 if it does not fit in max
+ */
+ssize_t http_clean_head(char *hdr, size_t len, char *out, size_t max);
+
+/*
+ * http_body_init() prepares to read the body of the response described
+ * by meta from rp
+ */
+void http_body_init(httpbody_t *body, rio_t *rp, httpmeta_t *meta);
+
+/*
+ * http_body_read() reads up to n decoded body bytes into buf.
+ * returns the bytes read, 0 at the end of the body, -1 on an error
+ */
+ssize_t http_body_read(httpbody_t *body, char *buf, size_t n);
+
+/*
+ * http_body_relay() forwards the rest of a Content-Length or
+ * close-delimited body to fd with splice(), without copying it through
+ * a user space buffer; chunked bodies have to be decoded and are not
+ * relayed. returns the bytes forwarded, or -1 on an error
+ */
+ssize_t http_body_relay(httpbody_t *body, int fd);
+
+/*
+ * http_cacheable() tells whether a shared cache may store the response.
+ * authorized is set when the request carried an Authorization header.
+ */
+bool http_cacheable(httpmeta_t *meta, bool authorized);
+
+/*
+ * http_expires() returns the time until which the response is fresh,
+ * from the request and response times of the exchange. default_ttl is
+ * used when the response has neither explicit freshness nor a
+ * Last-Modified date to derive one from.
+ */
+time_t http_expires(httpmeta_t *meta, time_t request_time,
+                    time_t response_time, long default_ttl);
+
+/*
+ * http_stale_grace() returns how many seconds past its expiry the
+ * response may still be served while it is refreshed: its own
+ * stale-while-revalidate, none if it must be revalidated, else
+ * default_grace
+ */
+long http_stale_grace(httpmeta_t *meta, long default_grace);
+
+/*
+ * http_merge_304() builds the header block of a stored response
+ * refreshed by a 304: every header in the 304 replaces the stored
+ * header of the same name, the rest of the stored block is kept.
+ * returns the new length, or -1 if it does not fit in max
+ */
+ssize_t http_merge_304(char *stored, size_t stored_len, char *update,
+                       size_t update_len, char *out, size_t max);
+
+/*
+ * http_accepts() tells whether a request with the headers reqhdrs takes
+ * a response in the content coding named coding: Accept-Encoding lists
+ * it, or "*", with a q value other than 0
+ */
+bool http_accepts(char *reqhdrs, char *coding);
+
+/*
+ * http_compressible() tells whether the body of the response with the
+ * header block hdr may be stored in another coding: it has none yet
+ * and Cache-Control: no-transform does not forbid it
+ */
+bool http_compressible(char *hdr, size_t len);
+
+/*
+ * http_encode_head() builds the header block of the response hdr with
+ * its body sent in the content coding named coding, clen bytes long:
+ * Content-Encoding and Content-Length are set, a strong ETag is made
+ * weak and Vary gets Accept-Encoding. returns the new length, or -1 if
+ * it does not fit in max
+ */
+ssize_t http_encode_head(char *hdr, size_t len, char *coding, size_t clen,
+                         char *out, size_t max);
+
+#endif /* __HTTP_H__ */
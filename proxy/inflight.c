@@ -0,0 +1,331 @@
+/* In-flight fetch file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+#include "csapp.h"
+#include "cache.h"
+#include "http.h"
+#include "inflight.h"
+
+//#define DEBUG // uncomment this line to enable debugging
+
+#ifdef DEBUG
+/* When debugging is enabled, these form aliases to useful functions */
+#define dbg_printf(...) printf(__VA_ARGS__)
+#else
+/* When debugging is disabled, no code gets generated for these */
+#define dbg_printf(...)
+#endif
+
+/* states of a fetch */
+#define INFLIGHT_HEAD 0     /* waiting for the response head */
+#define INFLIGHT_BODY 1     /* body bytes are being published */
+#define INFLIGHT_DONE 2     /* the whole response is published */
+#define INFLIGHT_ABORT 3    /* nothing to share, fetch on your own */
+
+typedef struct inflight
+{
+    char *key;
+    webhdr_t *hdr;
+    webobj_t *obj;
+    char *variant;          // of a response with Vary, NULL otherwise
+    size_t published;       // body bytes followers may send
+    int state;
+    int followers;          // still following, by table_mutex
+    int refcnt;             // leader plus followers
+    bool linked;            // still in the table, by table_mutex
+    pthread_mutex_t lock;   // state and published
+    pthread_cond_t cond;    // signalled when either changes
+    struct inflight *next;
+}inflight_t;
+
+static inflight_t *table[INFLIGHT_BUCKETS];
+static sem_t table_mutex;
+static pthread_once_t table_once = PTHREAD_ONCE_INIT;
+static inflight_stats_t if_stats;
+
+static void table_init(void)
+{
+    Sem_init(&table_mutex, 0, 1);
+}
+
+/* drops a reference, the last one frees the entry */
+static void inflight_put(inflight_t *f)
+{
+    if(__sync_sub_and_fetch(&f->refcnt, 1) > 0)
+        return;
+    webhdr_put(f->hdr);
+    webobj_put(f->obj);
+    free(f->variant);
+    pthread_mutex_destroy(&f->lock);
+    pthread_cond_destroy(&f->cond);
+    free(f->key);
+    free(f);
+}
+
+/* takes f out of the table, called with table_mutex held */
+static void unlink_entry(inflight_t *f)
+{
+    inflight_t **pp = &table[hash_key(f->key) % INFLIGHT_BUCKETS];
+
+    if(!f->linked)
+        return;
+    while(*pp != f)
+        pp = &(*pp)->next;
+    *pp = f->next;
+    f->linked = false;
+    if_stats.active--;
+}
+
+/* a follower is done with f */
+static void leave(inflight_t *f)
+{
+    P(&table_mutex);
+    f->followers--;
+    V(&table_mutex);
+    inflight_put(f);
+}
+
+/* sets the state and wakes the followers */
+static void set_state(inflight_t *f, int state)
+{
+    pthread_mutex_lock(&f->lock);
+    f->state = state;
+    pthread_cond_broadcast(&f->cond);
+    pthread_mutex_unlock(&f->lock);
+}
+
+/*
+ * inflight_join() looks up the fetch of key. If there is none the
+ * caller becomes its leader, *leader is set and the new fetch returned;
+ * otherwise the caller follows the returned fetch. Returns NULL if no
+ * entry could be allocated, the caller then fetches on its own.
+ */
+inflight_t *inflight_join(char *key, bool *leader)
+{
+    unsigned long b = hash_key(key) % INFLIGHT_BUCKETS;
+    inflight_t *f;
+
+    pthread_once(&table_once, table_init);
+    P(&table_mutex);
+    for(f = table[b]; f != NULL; f = f->next)
+    {
+        if(!strcmp(f->key, key))
+        {
+            f->followers++;
+            __sync_add_and_fetch(&f->refcnt, 1);
+            V(&table_mutex);
+            *leader = false;
+            return f;
+        }
+    }
+
+    if((f = calloc(1, sizeof(inflight_t))) == NULL ||
+       (f->key = strdup(key)) == NULL)
+    {
+        free(f);
+        V(&table_mutex);
+        return NULL;
+    }
+    f->state = INFLIGHT_HEAD;
+    f->refcnt = 1;
+    f->linked = true;
+    pthread_mutex_init(&f->lock, NULL);
+    pthread_cond_init(&f->cond, NULL);
+    f->next = table[b];
+    table[b] = f;
+    if_stats.active++;
+    if_stats.led++;
+    V(&table_mutex);
+    *leader = true;
+    return f;
+}
+
+/*
+ * inflight_head() publishes the header block of the response and the
+ * object the body is read into. Both get their own references. reqhdrs
+ * are the headers of the leader's request, which pick the variant of a
+ * response with Vary.
+ */
+void inflight_head(inflight_t *f, webhdr_t *hdr, webobj_t *obj,
+                   char *reqhdrs)
+{
+    char variant[MAXLINE];
+
+    if(http_variant(hdr->data, hdr->len, reqhdrs, variant, MAXLINE))
+        f->variant = strdup(variant);
+    webhdr_get(hdr);
+    webobj_get(obj);
+    pthread_mutex_lock(&f->lock);
+    f->hdr = hdr;
+    f->obj = obj;
+    f->published = obj->size;
+    f->state = INFLIGHT_BODY;
+    pthread_cond_broadcast(&f->cond);
+    pthread_mutex_unlock(&f->lock);
+}
+
+/* inflight_publish() makes the first size body bytes visible */
+void inflight_publish(inflight_t *f, size_t size)
+{
+    pthread_mutex_lock(&f->lock);
+    f->published = size;
+    pthread_cond_broadcast(&f->cond);
+    pthread_mutex_unlock(&f->lock);
+}
+
+/*
+ * inflight_detach() ends the fetch led by the caller before the body is
+ * whole, so the leader may stop buffering it. Followers fetch what they
+ * have not sent on their own. Drops the leader's reference.
+ */
+void inflight_detach(inflight_t *f)
+{
+    int followers;
+
+    P(&table_mutex);
+    unlink_entry(f);
+    followers = f->followers;
+    V(&table_mutex);
+    dbg_printf("inflight: %s detached from %d followers\n", f->key,
+               followers);
+    if(followers > 0)
+        set_state(f, INFLIGHT_ABORT);
+    inflight_put(f);
+}
+
+/*
+ * inflight_finish() ends the fetch led by the caller. complete tells
+ * whether the published response is whole; otherwise followers that
+ * have not started are sent to fetch on their own. Drops the leader's
+ * reference.
+ */
+void inflight_finish(inflight_t *f, bool complete)
+{
+    P(&table_mutex);
+    unlink_entry(f);
+    V(&table_mutex);
+
+    pthread_mutex_lock(&f->lock);
+    if(f->state != INFLIGHT_ABORT)
+        f->state = (complete || f->state == INFLIGHT_BODY) ?
+                        INFLIGHT_DONE : INFLIGHT_ABORT;
+    pthread_cond_broadcast(&f->cond);
+    pthread_mutex_unlock(&f->lock);
+    inflight_put(f);
+}
+
+/*
+ * send_range() writes body bytes [from, to) of obj to fd. *seg and *off
+ * track the position; every segment before the tail is full, so the
+ * walk never reads a length the leader is still changing.
+ */
+static bool send_range(int fd, webobj_t *obj, segment_t **seg, size_t *off,
+                       size_t from, size_t to)
+{
+    size_t n;
+
+    while(from < to)
+    {
+        if(*seg == NULL)
+            *seg = obj->head;
+        else if(*off == SEGMENT_DATA_SIZE)
+        {
+            *seg = (*seg)->next;
+            *off = 0;
+        }
+        n = SEGMENT_DATA_SIZE - *off;
+        if(n > to - from)
+            n = to - from;
+        if(rio_writen(fd, (*seg)->data + *off, n) < 0)
+            return false;
+        *off += n;
+        from += n;
+    }
+    return true;
+}
+
+/*
+ * inflight_follow() waits for the response of the fetch and writes it
+ * to fd as it comes in, then drops the follower's reference. returns
+ * false if the fetch was aborted before anything was written, or the
+ * response varies on a request header the follower's reqhdrs have
+ * another value of; the caller should then fetch on its own.
+ * It also returns false when the fetch is detached after the head was
+ * written; *hdr is then a reference to that head and *sent the body
+ * bytes written after it, the caller fetches the rest. Otherwise *hdr
+ * is NULL.
+ */
+bool inflight_follow(inflight_t *f, int fd, char *reqhdrs, webhdr_t **hdr,
+                     size_t *sent)
+{
+    segment_t *seg = NULL;
+    size_t off = 0, avail;
+    int state;
+
+    *hdr = NULL;
+    *sent = 0;
+    pthread_mutex_lock(&f->lock);
+    while(f->state == INFLIGHT_HEAD)
+        pthread_cond_wait(&f->cond, &f->lock);
+    state = f->state;
+    pthread_mutex_unlock(&f->lock);
+
+    if(state == INFLIGHT_ABORT || f->hdr == NULL ||
+       (f->variant != NULL && !http_variant_match(f->variant, reqhdrs)))
+    {
+        dbg_printf("inflight: %s aborted, fetching alone\n", f->key);
+        __sync_fetch_and_add(&if_stats.aborted, 1);
+        leave(f);
+        return false;
+    }
+
+    __sync_fetch_and_add(&if_stats.followed, 1);
+    if(rio_writen(fd, f->hdr->data, f->hdr->len) < 0)
+    {
+        leave(f);
+        return true;
+    }
+
+    while(1)
+    {
+        pthread_mutex_lock(&f->lock);
+        while(f->published == *sent && f->state == INFLIGHT_BODY)
+            pthread_cond_wait(&f->cond, &f->lock);
+        avail = f->published;
+        state = f->state;
+        pthread_mutex_unlock(&f->lock);
+
+        if(!send_range(fd, f->obj, &seg, &off, *sent, avail))
+        {
+            leave(f);
+            return true;
+        }
+        *sent = avail;
+        if(state != INFLIGHT_BODY)
+            break;
+    }
+
+    // the leader stopped buffering midway: the rest is ours to fetch
+    if(state == INFLIGHT_ABORT)
+    {
+        dbg_printf("inflight: %s detached at %lu, resuming\n", f->key,
+                   *sent);
+        __sync_fetch_and_add(&if_stats.resumed, 1);
+        webhdr_get(f->hdr);
+        *hdr = f->hdr;
+        leave(f);
+        return false;
+    }
+    leave(f);
+    return true;
+}
+
+/* inflight_get_stats() fills in the counters */
+void inflight_get_stats(inflight_stats_t *stats)
+{
+    pthread_once(&table_once, table_init);
+    P(&table_mutex);
+    *stats = if_stats;
+    V(&table_mutex);
+}
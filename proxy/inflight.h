@@ -0,0 +1,109 @@
+/* In-flight fetch header file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+
+/*
+ * Collapsed forwarding of cache misses. The first request missing a key
+ * becomes the leader and fetches it from the server; requests for the
+ * same key arriving meanwhile become followers of the leader's fetch
+ * instead of sending their own request.
+ *
+ * The leader publishes the header block of the response and the web
+ * object it is reading the body into, then the number of body bytes
+ * read so far. Followers write those bytes to their clients straight
+ * from the segments of the object as they come in:
+ *
+ *   leader   server --> [seg][seg][seg..   ] --> client
+ *                         |    |    |
+ *   follower              +----+----+--------> client
+ *   follower              +----+----+--------> client
+ *
+ * A response with Vary is only shared with the followers whose request
+ * selects the same variant as the leader's; the others fetch on their
+ * own.
+ *
+ * Only responses that may be cached are shared. When the leader finds
+ * the response cannot be shared (not cacheable, or it failed before a
+ * head came in), the fetch is aborted and each waiting follower fetches
+ * the key on its own.
+ *
+ * The leader buffers no more of the body than the object limit. A body
+ * growing past it is detached: the leader relays the rest without
+ * keeping it, and every follower that had the head written fetches the
+ * response once more on its own, skipping the body bytes its client
+ * has already got.
+ */
+
+#ifndef __INFLIGHT_H__
+#define __INFLIGHT_H__
+
+#include "csapp.h"
+#include "webobj.h"
+
+#define INFLIGHT_BUCKETS 1024
+
+typedef struct inflight inflight_t;
+
+typedef struct inflight_stats
+{
+    size_t active;           // fetches in progress
+    size_t led;              // fetches led
+    size_t followed;         // requests served by following a fetch
+    size_t aborted;          // followers sent to fetch on their own
+    size_t resumed;          // followers left midway by a detached fetch
+}inflight_stats_t;
+
+/*
+ * inflight_join() looks up the fetch of key. If there is none the
+ * caller becomes its leader, *leader is set and the new fetch returned;
+ * otherwise the caller follows the returned fetch. Returns NULL if no
+ * entry could be allocated, the caller then fetches on its own.
+ */
+inflight_t *inflight_join(char *key, bool *leader);
+
+/*
+ * inflight_head() publishes the header block of the response and the
+ * object the body is read into. Both get their own references. reqhdrs
+ * are the headers of the leader's request, which pick the variant of a
+ * response with Vary.
+ */
+void inflight_head(inflight_t *f, webhdr_t *hdr, webobj_t *obj,
+                   char *reqhdrs);
+
+/* inflight_publish() makes the first size body bytes visible */
+void inflight_publish(inflight_t *f, size_t size);
+
+/*
+ * inflight_detach() ends the fetch led by the caller before the body is
+ * whole, so the leader may stop buffering it. Followers fetch what they
+ * have not sent on their own. Drops the leader's reference.
+ */
+void inflight_detach(inflight_t *f);
+
+/*
+ * inflight_finish() ends the fetch led by the caller. complete tells
+ * whether the published response is whole; otherwise followers that
+ * have not started are sent to fetch on their own. Drops the leader's
+ * reference.
+ */
+void inflight_finish(inflight_t *f, bool complete);
+
+/*
+ * inflight_follow() waits for the response of the fetch and writes it
+ * to fd as it comes in, then drops the follower's reference. returns
+ * false if the fetch was aborted before anything was written, or the
+ * response varies on a request header the follower's reqhdrs have
+ * another value of; the caller should then fetch on its own.
+ * It also returns false when the fetch is detached after the head was
+ * written; *hdr is then a reference to that head and *sent the body
+ * bytes written after it, the caller fetches the rest. Otherwise *hdr
+ * is NULL.
+ */
+bool inflight_follow(inflight_t *f, int fd, char *reqhdrs, webhdr_t **hdr,
+                     size_t *sent);
+
+/* inflight_get_stats() fills in the counters */
+void inflight_get_stats(inflight_stats_t *stats);
+
+#endif /* __INFLIGHT_H__ */
@@ -0,0 +1,359 @@
+/* Upstream group file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+#include "csapp.h"
+#include "cache.h"
+#include "health.h"
+#include "lb.h"
+#include <strings.h>
+
+//#define DEBUG // uncomment this line to enable debugging
+
+#ifdef DEBUG
+/* When debugging is enabled, these form aliases to useful functions */
+#define dbg_printf(...) printf(__VA_ARGS__)
+#else
+/* When debugging is disabled, no code gets generated for these */
+#define dbg_printf(...)
+#endif
+
+static char *policy_names[] = {"round_robin", "least_conn", "p2c", "uri_hash"};
+
+static group_t *groups;         // set up once at startup, then read only
+static unsigned long draws;     // random draws of p2c
+
+/* lb_policy_name() names a policy */
+char *lb_policy_name(int policy)
+{
+    return policy_names[policy];
+}
+
+/* lb_groups() returns the first group, for reporting */
+group_t *lb_groups(void)
+{
+    return groups;
+}
+
+/*
+ * mix() finishes a hash (the MurmurHash3 fmix64 step), so the points of
+ * similar keys spread over the whole ring
+ */
+static unsigned long mix(unsigned long h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdUL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53UL;
+    h ^= h >> 33;
+    return h;
+}
+
+static int ring_cmp(const void *a, const void *b)
+{
+    unsigned long x = ((ringpoint_t *)a)->hash;
+    unsigned long y = ((ringpoint_t *)b)->hash;
+
+    return x < y ? -1 : x > y;
+}
+
+/* places the points of every backend of g on its ring */
+static int build_ring(group_t *g)
+{
+    char key[2 * LB_NAME_LEN + 16];
+    int i, v;
+
+    g->nring = g->nbackends * LB_VNODES;
+    if((g->ring = malloc(g->nring * sizeof(ringpoint_t))) == NULL)
+        return -1;
+    for(i = 0; i < g->nbackends; i++)
+    {
+        for(v = 0; v < LB_VNODES; v++)
+        {
+            snprintf(key, sizeof(key), "%s:%s#%d", g->backends[i].host,
+                                       g->backends[i].port, v);
+            g->ring[i * LB_VNODES + v].hash = mix(hash_key(key));
+            g->ring[i * LB_VNODES + v].backend = i;
+        }
+    }
+    qsort(g->ring, g->nring, sizeof(ringpoint_t), ring_cmp);
+    return 0;
+}
+
+/*
+ * parse_line() applies one line of the groups file, *cur is the group
+ * being read. returns -1 on a bad line
+ */
+static int parse_line(char *line, group_t **cur)
+{
+    char *save, *word, *colon;
+    group_t *g = *cur;
+    backend_t *b;
+    int i;
+
+    if((word = strtok_r(line, " \t\r\n", &save)) == NULL)
+        return 0;
+
+    if(!strcmp(word, "group"))
+    {
+        if((g = calloc(1, sizeof(group_t))) == NULL ||
+           (word = strtok_r(NULL, " \t\r\n", &save)) == NULL)
+        {
+            free(g);
+            return -1;
+        }
+        strncpy(g->name, word, LB_NAME_LEN - 1);
+        g->policy = LB_ROUND_ROBIN;
+        if((word = strtok_r(NULL, " \t\r\n", &save)) != NULL)
+        {
+            for(i = 0; i <= LB_URI_HASH; i++)
+                if(!strcmp(word, policy_names[i]))
+                    break;
+            if(i > LB_URI_HASH)
+            {
+                free(g);
+                return -1;
+            }
+            g->policy = i;
+        }
+        g->next_group = groups;
+        groups = *cur = g;
+        return 0;
+    }
+
+    if(g == NULL)
+        return -1;
+    if(!strcmp(word, "hosts"))
+    {
+        while((word = strtok_r(NULL, " \t\r\n", &save)) != NULL)
+        {
+            if(g->nhosts == LB_MAX_HOSTS)
+                return -1;
+            strncpy(g->hosts[g->nhosts++], word, LB_NAME_LEN - 1);
+        }
+        return 0;
+    }
+    if(!strcmp(word, "server"))
+    {
+        while((word = strtok_r(NULL, " \t\r\n", &save)) != NULL)
+        {
+            if(g->nbackends == LB_MAX_BACKENDS)
+                return -1;
+            b = &g->backends[g->nbackends++];
+            if((colon = strrchr(word, ':')) != NULL)
+            {
+                *colon = '\0';
+                strncpy(b->port, colon + 1, LB_NAME_LEN - 1);
+            }
+            else
+                strcpy(b->port, "80");
+            strncpy(b->host, word, LB_NAME_LEN - 1);
+        }
+        return 0;
+    }
+    return -1;
+}
+
+/*
+ * lb_load() reads the groups in path. returns the number of groups, or
+ * -1 if the file cannot be read or has bad lines
+ */
+int lb_load(char *path)
+{
+    FILE *fp;
+    char line[MAXLINE], *hash;
+    group_t *g = NULL;
+    int lineno = 0, status = 0, n = 0, i;
+
+    if((fp = fopen(path, "r")) == NULL)
+    {
+        fprintf(stderr, "lb: cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    while(fgets(line, MAXLINE, fp) != NULL)
+    {
+        lineno++;
+        if((hash = strchr(line, '#')) != NULL)
+            *hash = '\0';
+        if(parse_line(line, &g) < 0)
+        {
+            fprintf(stderr, "lb: %s:%d: bad line\n", path, lineno);
+            status = -1;
+        }
+    }
+    fclose(fp);
+
+    for(g = groups; g != NULL; g = g->next_group, n++)
+    {
+        if(g->nbackends == 0)
+        {
+            fprintf(stderr, "lb: group %s has no server\n", g->name);
+            status = -1;
+        }
+        else if(g->policy == LB_URI_HASH && build_ring(g) < 0)
+            status = -1;
+        for(i = 0; i < g->nbackends; i++)
+            g->backends[i].health = health_get(g->backends[i].host,
+                                               g->backends[i].port, true);
+    }
+    return status < 0 ? -1 : n;
+}
+
+/* finds the group serving host */
+static group_t *find_group(char *host)
+{
+    group_t *g;
+    int i;
+
+    for(g = groups; g != NULL; g = g->next_group)
+    {
+        if(!strcasecmp(g->name, host))
+            return g;
+        for(i = 0; i < g->nhosts; i++)
+            if(!strcasecmp(g->hosts[i], host))
+                return g;
+    }
+    return NULL;
+}
+
+/* whether b can take a request, backends without a breaker always can */
+static bool usable(backend_t *b)
+{
+    return b->health == NULL || health_usable(b->health);
+}
+
+/*
+ * the backend owning the first ring point at or after the hash of uri,
+ * or of the points after it if that one is down
+ */
+static int ring_lookup(group_t *g, char *uri)
+{
+    unsigned long h = mix(hash_key(uri));
+    int lo = 0, hi = g->nring, mid, k, i;
+
+    while(lo < hi)
+    {
+        mid = (lo + hi) / 2;
+        if(g->ring[mid].hash < h)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    for(k = 0; k < g->nring; k++)
+    {
+        i = g->ring[(lo + k) % g->nring].backend;
+        if(usable(&g->backends[i]))
+            return i;
+    }
+    return -1;
+}
+
+/*
+ * the usable backend with the fewest outstanding requests from start
+ * on, other than skip
+ */
+static int least_loaded(group_t *g, int start, int skip)
+{
+    backend_t *b = g->backends;
+    int n = g->nbackends, i = -1, j, k;
+
+    for(k = 0; k < n; k++)
+    {
+        j = (start + k) % n;
+        if(j != skip && usable(&b[j]) && 
+           (i < 0 || b[j].outstanding < b[i].outstanding))
+            i = j;
+    }
+    return i;
+}
+
+/*
+ * lb_pick() chooses the backend for uri if a group serves host and
+ * counts the request as outstanding on it. *grouped tells whether a
+ * group does; returns NULL if none does, the request then goes to host
+ * itself, or if every backend of the group is down
+ */
+backend_t *lb_pick(char *host, char *uri, bool *grouped)
+{
+    group_t *g;
+    backend_t *b;
+    unsigned long r;
+    int n, i, j, k;
+
+    *grouped = false;
+    if(groups == NULL || (g = find_group(host)) == NULL)
+        return NULL;
+    *grouped = true;
+    n = g->nbackends;
+    b = g->backends;
+
+    switch(g->policy)
+    {
+        case LB_LEAST_CONN:
+            // start the scan in turn so ties are spread out
+            i = least_loaded(g, __sync_fetch_and_add(&g->next, 1) % n, -1);
+            break;
+
+        case LB_P2C:
+            r = mix(__sync_add_and_fetch(&draws, 1));
+            i = r % n;
+            j = n > 1 ? (i + 1 + (r >> 32) % (n - 1)) % n : i;
+            if(!usable(&b[i]) || 
+               (usable(&b[j]) && b[j].outstanding < b[i].outstanding))
+                i = j;
+            if(!usable(&b[i]))
+                i = least_loaded(g, i, -1);
+            break;
+
+        case LB_URI_HASH:
+            i = ring_lookup(g, uri);
+            break;
+
+        default:
+            i = __sync_fetch_and_add(&g->next, 1) % n;
+            for(k = 0; k < n && !usable(&b[i]); k++)
+                i = (i + 1) % n;
+            if(k == n)
+                i = -1;
+            break;
+    }
+    if(i < 0)
+        return NULL;
+
+    dbg_printf("lb: %s -> %s:%s\n", uri, b[i].host, b[i].port);
+    __sync_fetch_and_add(&b[i].outstanding, 1);
+    __sync_fetch_and_add(&b[i].requests, 1);
+    return &b[i];
+}
+
+/*
+ * lb_pick_other() chooses a second backend for a request of host that
+ * went to b: the least loaded of the others. returns NULL if there is
+ * none that is up
+ */
+backend_t *lb_pick_other(char *host, backend_t *b)
+{
+    group_t *g;
+    int i;
+
+    if(groups == NULL || (g = find_group(host)) == NULL || 
+       g->nbackends < 2 || b < g->backends || 
+       b >= g->backends + g->nbackends)
+        return NULL;
+    i = b - g->backends;
+    if((i = least_loaded(g, (i + 1) % g->nbackends, i)) < 0)
+        return NULL;
+
+    b = &g->backends[i];
+    __sync_fetch_and_add(&b->outstanding, 1);
+    __sync_fetch_and_add(&b->requests, 1);
+    return b;
+}
+
+/* lb_release() ends a request lb_pick() sent to b, b may be NULL */
+void lb_release(backend_t *b)
+{
+    if(b != NULL)
+        __sync_fetch_and_sub(&b->outstanding, 1);
+}
@@ -0,0 +1,120 @@
+/* Upstream group header file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+
+/*
+ * Named groups of identical origin backends, for running the proxy in
+ * front of a pool of servers. Requests for a host a group serves go to
+ * one of its backends instead of the host named in the URI; the Host
+ * header sent is still the requested one.
+ *
+ * The groups are read at startup from the file named by the
+ * upstream_groups setting. A "group" line starts a group, the lines
+ * after it add to it; '#' starts a comment:
+ *
+ *   group www.example.com uri_hash
+ *       hosts example.com static.example.com
+ *       server 10.0.0.1:8080
+ *       server 10.0.0.2:8080
+ *
+ * A group serves the host it is named after and any listed in "hosts".
+ * Policies pick the backend of a request:
+ *
+ *   round_robin   each backend in turn
+ *   least_conn    the backend with the fewest outstanding requests
+ *   p2c           the less loaded of two backends drawn at random
+ *   uri_hash      consistent hash of the URI, so each backend keeps
+ *                 seeing the same objects and its cache stays warm
+ *
+ * uri_hash places LB_VNODES points per backend on a hash ring, adding
+ * or removing a backend moves only the URIs of its own points.
+ *
+ * Backends whose breaker is open (health.c) are passed over: the next
+ * one in turn, the least loaded of the others, or the owner of the next
+ * point on the ring, so only the URIs of a down backend move.
+ *
+ * A request hedged against a slow backend (hedge.c) goes to the least
+ * loaded of the other backends, whatever the policy.
+ */
+
+#ifndef __LB_H__
+#define __LB_H__
+
+#include "csapp.h"
+#include "health.h"
+
+#define LB_NAME_LEN 256
+#define LB_MAX_HOSTS 16         /* hosts served by one group */
+#define LB_MAX_BACKENDS 64      /* servers in one group */
+#define LB_VNODES 160           /* ring points per uri_hash backend */
+
+/* policies */
+#define LB_ROUND_ROBIN 0
+#define LB_LEAST_CONN 1
+#define LB_P2C 2
+#define LB_URI_HASH 3
+
+typedef struct backend
+{
+    char host[LB_NAME_LEN];
+    char port[LB_NAME_LEN];
+    int outstanding;        // requests being served now
+    size_t requests;        // requests sent to it
+    health_t *health;       // its breaker
+}backend_t;
+
+/* a point of the uri_hash ring */
+typedef struct ringpoint
+{
+    unsigned long hash;
+    int backend;
+}ringpoint_t;
+
+typedef struct group group_t;
+
+typedef struct group
+{
+    char name[LB_NAME_LEN];
+    int policy;
+    char hosts[LB_MAX_HOSTS][LB_NAME_LEN];
+    int nhosts;
+    backend_t backends[LB_MAX_BACKENDS];
+    int nbackends;
+    unsigned long next;     // round robin position
+    ringpoint_t *ring;      // sorted, uri_hash only
+    int nring;
+    group_t *next_group;
+}group_t;
+
+/*
+ * lb_load() reads the groups in path. returns the number of groups, or
+ * -1 if the file cannot be read or has bad lines
+ */
+int lb_load(char *path);
+
+/*
+ * lb_pick() chooses the backend for uri if a group serves host and
+ * counts the request as outstanding on it. *grouped tells whether a
+ * group does; returns NULL if none does, the request then goes to host
+ * itself, or if every backend of the group is down
+ */
+backend_t *lb_pick(char *host, char *uri, bool *grouped);
+
+/*
+ * lb_pick_other() chooses a second backend for a request of host that
+ * went to b: the least loaded of the others. returns NULL if there is
+ * none that is up
+ */
+backend_t *lb_pick_other(char *host, backend_t *b);
+
+/* lb_release() ends a request lb_pick() sent to b, b may be NULL */
+void lb_release(backend_t *b);
+
+/* lb_groups() returns the first group, for reporting */
+group_t *lb_groups(void);
+
+/* lb_policy_name() names a policy */
+char *lb_policy_name(int policy);
+
+#endif /* __LB_H__ */
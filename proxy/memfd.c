@@ -0,0 +1,153 @@
+/* Memory file arena file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+#define _GNU_SOURCE         /* memfd_create() */
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/sockios.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include "memfd.h"
+
+//#define DEBUG // uncomment this line to enable debugging
+
+#ifdef DEBUG
+/* When debugging is enabled, these form aliases to useful functions */
+#define dbg_printf(...) printf(__VA_ARGS__)
+#else
+/* When debugging is disabled, no code gets generated for these */
+#define dbg_printf(...)
+#endif
+
+static int arena_fd = -1;
+static char *base;          // start of the reservation, offset 0
+static size_t mapped;       // bytes of the file mapped so far
+static memfd_stats_t mf_stats;
+
+/*
+ * memfd_init() creates the arena file and reserves its address space.
+ * returns -1 if memory files are not available
+ */
+int memfd_init(void)
+{
+    if((arena_fd = memfd_create("proxy-cache", MFD_CLOEXEC)) < 0)
+        return -1;
+    // only address space: nothing is backed until it is mapped again
+    base = mmap(NULL, MEMFD_RESERVE, PROT_NONE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(base == MAP_FAILED)
+    {
+        close(arena_fd);
+        arena_fd = -1;
+        base = NULL;
+        return -1;
+    }
+    mapped = 0;
+    return 0;
+}
+
+/*
+ * memfd_grow() grows the file by len bytes and returns where they are
+ * mapped, or NULL once the reservation is used up. The caller keeps
+ * calls apart, the slab allocator holds its arena lock
+ */
+void *memfd_grow(size_t len)
+{
+    char *p;
+
+    if(arena_fd < 0 || mapped + len > MEMFD_RESERVE ||
+       ftruncate(arena_fd, mapped + len) < 0)
+        return NULL;
+    p = mmap(base + mapped, len, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_FIXED, arena_fd, mapped);
+    if(p == MAP_FAILED)
+    {
+        dbg_printf("memfd: could not map %lu bytes\n", len);
+        return NULL;
+    }
+    mapped += len;
+    mf_stats.mapped = mapped;
+    return p;
+}
+
+/* memfd_contains() tells whether p lies in the arena */
+bool memfd_contains(const void *p)
+{
+    return base != NULL && (const char *)p >= base &&
+           (const char *)p < base + MEMFD_RESERVE;
+}
+
+/*
+ * memfd_send() sends len bytes at p, which lies in the arena, to the
+ * socket out with sendfile(). returns the bytes sent or -1, like write()
+ */
+ssize_t memfd_send(int out, const void *p, size_t len)
+{
+    off_t off = (const char *)p - base;
+    ssize_t n;
+
+    if((n = sendfile(out, arena_fd, &off, len)) > 0)
+    {
+        __sync_fetch_and_add(&mf_stats.sends, 1);
+        __sync_fetch_and_add(&mf_stats.sent_bytes, n);
+    }
+    return n;
+}
+
+/*
+ * memfd_drained() tells whether everything written to the socket fd has
+ * left it, so the arena pages sent to it may be reused
+ */
+bool memfd_drained(int fd)
+{
+    int queued;
+
+    // for TCP the queue holds the bytes not yet acknowledged
+    if(ioctl(fd, SIOCOUTQ, &queued) < 0)
+        return true;
+    return queued == 0;
+}
+
+/*
+ * memfd_abort() resets the connection of the socket fd, which drops
+ * its send queue; fd stays open
+ */
+void memfd_abort(int fd)
+{
+    struct sockaddr sa = {.sa_family = AF_UNSPEC};
+
+    dbg_printf("memfd: fd %d did not drain, resetting\n", fd);
+    __sync_fetch_and_add(&mf_stats.drain_aborts, 1);
+    connect(fd, &sa, sizeof(sa));
+}
+
+/*
+ * memfd_drain() waits until memfd_drained(fd), or aborts the connection
+ * after MEMFD_DRAIN_TIMEOUT seconds
+ */
+void memfd_drain(int fd)
+{
+    time_t deadline = time(NULL) + MEMFD_DRAIN_TIMEOUT;
+
+    while(!memfd_drained(fd))
+    {
+        if(time(NULL) >= deadline)
+        {
+            memfd_abort(fd);
+            return;
+        }
+        poll(NULL, 0, MEMFD_DRAIN_POLL);
+    }
+}
+
+/* memfd_get_stats() fills in the counters */
+void memfd_get_stats(memfd_stats_t *stats)
+{
+    *stats = mf_stats;
+}
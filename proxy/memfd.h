@@ -0,0 +1,93 @@
+/* Memory file arena header file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+
+/*
+ * One large anonymous memory file (memfd_create()) that the slab
+ * allocator can carve its arenas from instead of anonymous mappings.
+ * The file is mapped into one reserved stretch of address space, so
+ * the file offset of any cached byte is its distance from the start:
+ *
+ *   reserved  |arena 0|arena 1|arena 2|...... PROT_NONE ......|
+ *   memfd     |0      |2M     |4M     |
+ *
+ * A cache hit whose segments live in the arena is then sent with
+ * sendfile() from the file at those offsets, and the body never passes
+ * through a user space buffer on its way to the client socket.
+ *
+ * The socket is only handed references to the pages of the file, which
+ * it holds until the client has acknowledged the bytes. Until then the
+ * object must not be dropped: its segments would go back to the slab
+ * and be filled with another object while a slow client is still being
+ * sent the old bytes from them. So a response sent from the file keeps
+ * its object until memfd_drained() finds the send queue of the socket
+ * empty; a client that does not take it within MEMFD_DRAIN_TIMEOUT
+ * seconds has its connection reset, which drops the queue.
+ *
+ * Kept apart from the rest of the proxy because memfd_create() needs
+ * _GNU_SOURCE, which csapp.h does not build with.
+ */
+
+#ifndef __MEMFD_H__
+#define __MEMFD_H__
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define MEMFD_RESERVE (64UL << 30)  /* address space reserved, 64 GiB */
+#define MEMFD_DRAIN_POLL 10         /* ms between send queue checks */
+#define MEMFD_DRAIN_TIMEOUT 60      /* seconds a client has to drain it */
+
+typedef struct memfd_stats
+{
+    size_t mapped;           // bytes of the file mapped as arenas
+    size_t sends;            // sendfile() calls
+    size_t sent_bytes;       // bytes sent by them
+    size_t drain_aborts;     // connections reset before they drained
+}memfd_stats_t;
+
+/*
+ * memfd_init() creates the arena file and reserves its address space.
+ * returns -1 if memory files are not available
+ */
+int memfd_init(void);
+
+/*
+ * memfd_grow() grows the file by len bytes and returns where they are
+ * mapped, or NULL once the reservation is used up. The caller keeps
+ * calls apart, the slab allocator holds its arena lock
+ */
+void *memfd_grow(size_t len);
+
+/* memfd_contains() tells whether p lies in the arena */
+bool memfd_contains(const void *p);
+
+/*
+ * memfd_send() sends len bytes at p, which lies in the arena, to the
+ * socket out with sendfile(). returns the bytes sent or -1, like write()
+ */
+ssize_t memfd_send(int out, const void *p, size_t len);
+
+/*
+ * memfd_drained() tells whether everything written to the socket fd has
+ * left it, so the arena pages sent to it may be reused
+ */
+bool memfd_drained(int fd);
+
+/*
+ * memfd_abort() resets the connection of the socket fd, which drops
+ * its send queue; fd stays open
+ */
+void memfd_abort(int fd);
+
+/*
+ * memfd_drain() waits until memfd_drained(fd), or aborts the connection
+ * after MEMFD_DRAIN_TIMEOUT seconds
+ */
+void memfd_drain(int fd);
+
+/* memfd_get_stats() fills in the counters */
+void memfd_get_stats(memfd_stats_t *stats);
+
+#endif /* __MEMFD_H__ */
@@ -0,0 +1,194 @@
+/* Memory pressure file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+#include "csapp.h"
+#include "pressure.h"
+#include "config.h"
+#include "slab.h"
+
+//#define DEBUG // uncomment this line to enable debugging
+
+#ifdef DEBUG
+/* When debugging is enabled, these form aliases to useful functions */
+#define dbg_printf(...) printf(__VA_ARGS__)
+#else
+/* When debugging is disabled, no code gets generated for these */
+#define dbg_printf(...)
+#endif
+
+#define CGROUP_ROOT "/sys/fs/cgroup"
+#define SYSTEM_PSI "/proc/pressure/memory"
+
+static cache_t *pr_cache;
+static pressure_stats_t pr_stats;
+
+/* cgroup_dir() writes the directory of the cgroup of the proxy to dir */
+static void cgroup_dir(char *dir)
+{
+    char line[MAXLINE];
+    FILE *fp;
+
+    if(config.mem_cgroup[0] != '\0')
+    {
+        snprintf(dir, MAXLINE, "%s", config.mem_cgroup);
+        return;
+    }
+    // the cgroup v2 entry is "0::/path"
+    snprintf(dir, MAXLINE, "%s", CGROUP_ROOT);
+    if((fp = fopen("/proc/self/cgroup", "r")) == NULL)
+        return;
+    while(fgets(line, MAXLINE, fp) != NULL)
+    {
+        if(strncmp(line, "0::", 3))
+            continue;
+        line[strcspn(line, "\n")] = '\0';
+        // a path too long to read from stays the root
+        if(strcmp(line + 3, "/") &&
+           snprintf(dir, MAXLINE, "%s%s", CGROUP_ROOT, line + 3) >= MAXLINE)
+            snprintf(dir, MAXLINE, "%s", CGROUP_ROOT);
+        break;
+    }
+    fclose(fp);
+}
+
+/*
+ * read_value() reads the number in the file name of dir into value,
+ * 0 for "max". returns false if there is no such file
+ */
+static bool read_value(char *dir, char *name, size_t *value)
+{
+    char path[MAXLINE], line[MAXLINE];
+    FILE *fp;
+    bool ok;
+
+    if(snprintf(path, MAXLINE, "%s/%s", dir, name) >= MAXLINE ||
+       (fp = fopen(path, "r")) == NULL)
+        return false;
+    if((ok = fgets(line, MAXLINE, fp) != NULL))
+        *value = strncmp(line, "max", 3) ? strtoull(line, NULL, 10) : 0;
+    fclose(fp);
+    return ok;
+}
+
+/* read_psi() reads "some avg10" from the PSI file path */
+static bool read_psi(char *path, double *avg10)
+{
+    char line[MAXLINE];
+    FILE *fp;
+    bool ok = false;
+
+    if((fp = fopen(path, "r")) == NULL)
+        return false;
+    while(!ok && fgets(line, MAXLINE, fp) != NULL)
+        ok = sscanf(line, "some avg10=%lf", avg10) == 1;
+    fclose(fp);
+    return ok;
+}
+
+/*
+ * next_budget() returns the budget for the cache from one reading: the
+ * limit and the usage of the cgroup and PSI. calm counts the seconds
+ * without pressure
+ */
+static size_t next_budget(size_t budget, size_t limit, size_t current,
+                          double psi, int *calm)
+{
+    size_t ceiling = config.cache_size, floor, mark, cut, step;
+
+    floor = config.mem_min_cache < ceiling ? config.mem_min_cache : ceiling;
+    mark = limit / 100 * config.mem_high_water;
+    if(budget > ceiling)
+        budget = ceiling;
+
+    // pressure: cut hard, by as much as the cgroup is over if that is more
+    if((mark > 0 && current > mark) || psi >= config.mem_pressure)
+    {
+        *calm = 0;
+        cut = budget / MEM_SHRINK_DIV;
+        if(mark > 0 && current > mark && current - mark > cut)
+            cut = current - mark;
+        return budget > floor + cut ? budget - cut : floor;
+    }
+
+    // calm for a while: creep back up, within the room that is left
+    if(++*calm < MEM_GROW_HOLD || budget >= ceiling)
+        return budget;
+    step = ceiling / MEM_GROW_DIV;
+    if(mark > 0 && mark - current < step)
+        step = mark - current;
+    return budget + step < ceiling ? budget + step : ceiling;
+}
+
+/*
+ * pressure_thread() is the thread routine that reads the cgroup once a
+ * second and moves the budget of the cache with it
+ */
+static void *pressure_thread(void *vargp)
+{
+    char dir[MAXLINE], path[MAXLINE];
+    size_t limit, high, current, budget, next;
+    double psi;
+    int calm = MEM_GROW_HOLD;
+
+    Pthread_detach(pthread_self());
+    while(1)
+    {
+        sleep(1);
+        budget = pr_cache->max_cache_size;
+        if(!config.mem_adaptive)
+        {
+            // turned off: back to the fixed size
+            if(budget != config.cache_size)
+                cache_set_limits(pr_cache, config.cache_size,
+                                 config.max_object_size);
+            calm = MEM_GROW_HOLD;
+            continue;
+        }
+
+        cgroup_dir(dir);
+        limit = high = current = 0;
+        psi = 0;
+        read_value(dir, "memory.max", &limit);
+        if(read_value(dir, "memory.high", &high) && high > 0 &&
+           (limit == 0 || high < limit))
+            limit = high;
+        read_value(dir, "memory.current", &current);
+        if(snprintf(path, MAXLINE, "%s/memory.pressure", dir) >= MAXLINE ||
+           !read_psi(path, &psi))
+            read_psi(SYSTEM_PSI, &psi);
+        pr_stats.limit = limit;
+        pr_stats.current = current;
+        pr_stats.psi = psi;
+
+        next = next_budget(budget, limit, current, psi, &calm);
+        if(next < budget)
+            pr_stats.shrinks++;
+        else if(next > budget)
+            pr_stats.grows++;
+        if(next != budget)
+        {
+            dbg_printf("pressure: cache budget %lu -> %lu\n", budget, next);
+            cache_set_limits(pr_cache, next, config.max_object_size);
+        }
+        // what the trimmer evicted is of no use to anybody meanwhile
+        if(calm == 0)
+            slab_release(MEM_RELEASE_BATCH);
+    }
+    return NULL;
+}
+
+/* pressure_start() starts the thread that sizes cache */
+void pressure_start(cache_t *cache)
+{
+    pthread_t tid;
+
+    pr_cache = cache;
+    Pthread_create(&tid, NULL, pressure_thread, NULL);
+}
+
+/* pressure_get_stats() fills in the last readings and the counters */
+void pressure_get_stats(pressure_stats_t *stats)
+{
+    *stats = pr_stats;
+}
@@ -0,0 +1,63 @@
+/* Memory pressure header file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+
+/*
+ * Adaptive sizing of the cache for a proxy running in a cgroup next to
+ * other services. With mem_adaptive on, cache_size is a ceiling rather
+ * than a fixed budget: once a second the pressure thread reads the
+ * cgroup v2 files of the proxy
+ *
+ *   memory.max, memory.high   the limit, the lower of the two
+ *   memory.current            what the cgroup uses now
+ *   memory.pressure           PSI, the share of the last 10 s in which
+ *                             some task stalled waiting for memory
+ *
+ * and moves the budget of the cache between mem_min_cache and
+ * cache_size:
+ *
+ *   - down by a quarter (or by as much as the cgroup is over) every
+ *     second the cgroup is past mem_high_water percent of its limit or
+ *     PSI is at mem_pressure percent or more; the trimmer evicts in
+ *     batches down to the new budget, and the freed body segments are
+ *     given back to the kernel (slab_release())
+ *   - up by 1/64 of the ceiling a second once pressure has been gone
+ *     for MEM_GROW_HOLD seconds, never past the room left under the
+ *     high water mark
+ *
+ * The cgroup is the one /proc/self/cgroup names under /sys/fs/cgroup,
+ * or the directory mem_cgroup names. Without a limit only PSI counts,
+ * taken from /proc/pressure/memory if the cgroup has no memory.pressure.
+ */
+
+#ifndef __PRESSURE_H__
+#define __PRESSURE_H__
+
+#include "csapp.h"
+#include "cache.h"
+
+#define MEM_HIGH_WATER 90           /* default percent of the limit used */
+#define MEM_PRESSURE 10             /* default PSI some avg10 that shrinks */
+#define MEM_MIN_CACHE (4*1024*1024) /* default smallest budget */
+#define MEM_SHRINK_DIV 4            /* a shrink takes this part off */
+#define MEM_GROW_DIV 64             /* a grow adds this part of the ceiling */
+#define MEM_GROW_HOLD 10            /* calm seconds before growing again */
+#define MEM_RELEASE_BATCH 1024      /* free segments checked per second */
+
+typedef struct pressure_stats
+{
+    size_t limit;            // cgroup limit, 0 if none was found
+    size_t current;          // cgroup usage
+    double psi;              // some avg10, percent
+    size_t shrinks;          // budget cuts
+    size_t grows;            // budget raises
+}pressure_stats_t;
+
+/* pressure_start() starts the thread that sizes cache */
+void pressure_start(cache_t *cache);
+
+/* pressure_get_stats() fills in the last readings and the counters */
+void pressure_get_stats(pressure_stats_t *stats);
+
+#endif /* __PRESSURE_H__ */
@@ -7,13 +7,54 @@
  * This is a concurrent proxy with cache mechanism + LRU eviction policy. 
  * The proxy will run indefinitely till user hits ctrl+c and serve the 
  * web client(browser). The proxy will forward this request to the server 
- * by calling open_clientfd and retrieve the response by rio_readnb function.
+ * over a pooled keep-alive connection (upstream.c), whose address 
+ * comes from a cache of resolved names (dns.c), and read the response 
+ * to the end of its body, as framed by Content-Length or chunked coding.
+ * Bodies that are not cached are relayed socket to socket with splice() 
+ * (relay.c) rather than copied through a buffer.
+ * With memfd_arena the cache lives in a memory file (memfd.c) and hits 
+ * are sent from it with sendfile(). 
+ * With cache_compress text bodies are stored gzipped (compress.c); 
+ * clients that accept gzip are sent them as stored, others inflated. 
+ * Lines whose bodies are the same bytes share one copy (dedup.c). 
  * The proxy will then serve this same response to the web client on the 
  * open file descriptor. 
  * If the response is found in the cache, the proxy will retrieve that 
  * element from the cache and serve it to the web client. If the response 
  * is not found in the cache I am adding it to the cache using the 
- * URI as the key and the web object as the data.
+ * URI as the key and the web object as the data. The key is the URI 
+ * normalized (urlkey.c), so that spellings of one URI that differ in 
+ * case, default port, escapes or the order of the query share a line.
+ * 
+ * HTTP caching: only responses a shared cache may store are cached 
+ * (Cache-Control no-store/private and uncacheable statuses are not), 
+ * and each is kept with the time until which it is fresh, from 
+ * s-maxage, max-age, Expires or Last-Modified. Stale entries with an 
+ * ETag or a Last-Modified date are revalidated with a conditional 
+ * request; a 304 refreshes the headers and keeps the cached body. 
+ * Within a grace window after expiry the stale copy is served at once 
+ * and refreshed by a background thread, and hot entries are refreshed 
+ * before they expire. 
+ * 
+ * Negative caching: 404, 410 and 5xx answers are kept for a few 
+ * seconds (negative_ttl_4xx/5xx) unless the server says otherwise, and 
+ * a refused connect for negative_connect_ttl, so a missing page or a 
+ * dead server does not cost every request a round trip. A request 
+ * with Cache-Control: no-cache goes past them. 
+ * 
+ * Expiry: every line is filed in a timer wheel by the time it can 
+ * neither be served stale nor revalidated any more, and a sweeper 
+ * thread reclaims those lines in small batches instead of leaving 
+ * them to take up room until the LRU gets to them. The same thread 
+ * closes pooled upstream connections that idled too long. 
+ * 
+ * Memory pressure: with mem_adaptive the cache budget follows the 
+ * cgroup of the proxy (pressure.c), shrinking fast when it nears its 
+ * limit or stalls on memory and growing back slowly to cache_size. 
+ * 
+ * Purging: the control port drops, or marks stale, the responses of a 
+ * key, of every key under a prefix or of a surrogate tag the origin 
+ * sent (purge.c), in memory, on disk and in the snapshot. 
  * 
  * Eviction Policy: I am maintaining a global LRU counter which holds the 
  * age of the cache block. During the eviction, I am checking the age of 
@@ -21,6 +62,25 @@
  * become necessary if the size of the incoming block does not match the 
  * available space in the cache. 
  * 
+ * Upstream groups: hosts listed in the upstream_groups file are served 
+ * by a group of backends, each request going to the one the policy of 
+ * the group picks (lb.c). Origin-form requests ("GET /path" with a Host 
+ * header), as a reverse proxy gets them, are taken as well. 
+ * 
+ * Hedging: a GET that a backend of a group is slow to answer is sent 
+ * to a second backend after a delay taken from the recent times to 
+ * first byte, within a budget, and the first answer wins (hedge.c). 
+ * 
+ * Health: every upstream server has a circuit breaker fed by the 
+ * outcome of its requests and by periodic probes (health.c). While it 
+ * is open clients get a stale copy or a 503 at once, and a server that 
+ * fails a request gets the stale copy served or a 502. 
+ * 
+ * Event engine: by default one epoll loop per core accepts the clients 
+ * and reads their requests without blocking (engine.c). Cache hits are 
+ * written from the loop as the client takes them; misses are handed to 
+ * a thread of their own that fetches from the origin. 
+ * 
  * Synchronization: The synchronization of the cache buffer is done using 
  * mutex in the pthread library. I am using reader-preffered policies, 
  * and acquiring write locks during the cache search and increasing the 
@@ -31,9 +91,28 @@
 
 #include "csapp.h"
 #include "cache.h"
+#include "config.h"
+#include "control.h"
+#include "slab.h"
+#include "dcache.h"
+#include "snapshot.h"
+#include "http.h"
+#include "inflight.h"
+#include "upstream.h"
+#include "engine.h"
+#include "lb.h"
+#include "health.h"
+#include "hedge.h"
+#include "urlkey.h"
+#include "dns.h"
+#include "compress.h"
+#include "dedup.h"
+#include "pressure.h"
+#include "purge.h"
 #include <stdio.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/resource.h>
 
 //#define DEBUG // uncomment this line to enable debugging
 
@@ -51,28 +130,100 @@
 #define dbg_ensures(...)
 #endif
 
+/* 
+ * A cached response taken out of the cache with its own references, 
+ * used to serve it or to revalidate it without holding the shard lock 
+ */
+typedef struct cached
+{
+  webhdr_t *hdr;
+  webobj_t *obj;
+}cached_t;
+
+/* 
+ * A request to the origin: the URI split up, the client headers passed 
+ * on with it and the normalized URI it is cached under 
+ */
+typedef struct request
+{
+  char uri[MAXLINE], host[MAXLINE], port[MAXLINE], filename[MAXLINE];
+  char key[MAXLINE];
+  char hdrs[MAXBUF];
+  bool authorized;
+  bool no_cache;        // the client asked past cached errors
+}request_t;
+
+/* a background refresh of a cache entry */
+typedef struct refresh
+{
+  request_t req;
+  cached_t stale;
+  webobj_t *key_obj;    // identifies the line, never dereferenced
+}refresh_t;
+
+/* a request the event engine handed off to serve_pending() */
+typedef struct pending
+{
+  request_t req;
+  cached_t hit;         // a hit whose body is to be inflated first
+  cached_t stale;
+}pending_t;
+
+/* at most this many background refreshes run at once */
+#define MAX_REFRESHES 64
+
 /*
  * Internal helper routines
  */
 void doit(int fd);
-void parse_requesthdrs(rio_t *rp, char *addn_hdrs);
+bool read_request(int fd, rio_t *rio, request_t *req);
+void serve_miss(int fd, request_t *req, cached_t *stale);
+int route_request(int fd, rio_t *rio, webhdr_t **hdr, webobj_t **obj, 
+                  void **arg);
+void serve_pending(int fd, void *arg);
+void parse_requesthdrs(rio_t *rp, char *addn_hdrs, char *host);
 int parse_uri(char *uri, char *host, char *port, char *filename);
 void clienterror(int fd, char *cause, char *errnum, char *sms, char *lngmsg);
 void post_request(int clientfd, rio_t *rp);
 void *thread(void *vargp);
-void build_headers(rio_t *rio, char *host, char *filename, 
-                              char *clientbuf, char *buf, char *addn_hdrs);
-void write_to_cache(char *server_response, size_t write_len, char *uri);
-bool read_from_cache(char *uri, int fd);
+bool build_headers(char *host, char *port, char *filename, char *clientbuf, 
+                   char *addn_hdrs, char *cond_hdrs);
+void fetch_origin(request_t *req, cached_t *stale, int fd);
+bool same_response(webhdr_t *sent, char *hdr, size_t len);
+upconn_t *hedge_request(request_t *req, upconn_t *conn, backend_t **backend, 
+                        health_t **health, char *clientbuf);
+void origin_down(request_t *req, cached_t *stale, int fd, 
+                 inflight_t *flight, char *errnum, char *shortmsg);
+void start_refresh(request_t *req, webhdr_t *header, webobj_t *web_object);
+void *refresh_thread(void *vargp);
+void *sweeper(void *vargp);
+time_t line_deadline(cacheline_t *line);
+void unclaim_refresh(char *uri, webobj_t *web_object);
+cacheline_t *find_variant(cacheq_t *shard, request_t *req);
+cacheline_t *find_object(cacheq_t *shard, char *uri, webobj_t *web_object);
+void write_to_cache(webhdr_t *header, webobj_t *server_response, 
+                              request_t *req, time_t expires);
+bool read_from_cache(request_t *req, cached_t *hit, cached_t *stale);
+void refresh_cache(request_t *req, cached_t *stale, char *update, 
+                   size_t update_len, time_t request_time, 
+                   time_t response_time);
+void serve_cached(int fd, webhdr_t *header, webobj_t *web_object);
+void serve_hit(int fd, request_t *req, cached_t *hit);
+bool encode_cached(request_t *req, cached_t *entry);
+webobj_t *store_body(webhdr_t *header, webobj_t *body);
+void publish_cached(request_t *req, cached_t *entry, inflight_t *flight, 
+                    int fd);
+void release_cached(cached_t *entry);
+long response_ttl(int status);
+void usage(char *prog);
 
 /* End internal helper routines */ 
 
 /* Global variables */ 
 
-cacheq_t *cache; 
+cache_t *cache; 
 extern int lru;
-static int readcnt = 0; // variable for maintaining the reader count 
-sem_t mutex, w;
+static int refreshes;       // background refreshes running
 
 /* End global variables */
 
@@ -83,42 +234,138 @@ sem_t mutex, w;
 static char *hdr_useragent_value = "User-Agent: Mozilla/5.0"
                                     " (X11; Linux x86_64; rv:3.10.0)"
                                     " Gecko/20181101 Firefox/61.0.1\r\n";
-static char *hdr_connection_value = "Connection: close\r\n";
-static char *hdr_proxyconn_value = "Proxy-Connection: close\r\n";
+static char *hdr_connection_value = "Connection: keep-alive\r\n";
 
 static char *hdr_useragent_key = "User-Agent:";
 static char *hdr_connection_key = "Connection:";
 static char *hdr_proxyconn_key = "Proxy-Connection";
+static char *hdr_host_key = "Host:";
+static char *hdr_inm_key = "If-None-Match:";
+static char *hdr_ims_key = "If-Modified-Since:";
+
+/* 
+ * prints the command line usage and exits 
+ */
+void usage(char *prog)
+{
+  fprintf(stderr, "usage: %s [-f config] [-c cache_size] [-o max_object_size]"
+                  " [-s shards] [-a control_port] <port>\n", prog);
+  exit(1);
+}
 
 /* 
  * inputs the argument for the proxy server and gets the port on which 
  * to listen. It will then open the port on that port number
  * and wait for a connection from its web client 
+ * The config file is applied first so that the other flags override it. 
  */
 int main(int argc, char** argv) 
 {
-  int listenfd, *connfdp; 
+  int listenfd, *connfdp, opt; 
   char hostname[MAXLINE], port[MAXLINE];
+  char *cache_size = NULL, *object_size = NULL, *shards = NULL;
+  char *control_port = NULL;
   socklen_t clientlen;
   struct sockaddr_storage clientaddr;
-  Sem_init(&mutex, 0, 1);
-  Sem_init(&w, 0, 1);
   pthread_t tid;
 
-  if(argc != 2)
+  config_defaults(&config);
+  while((opt = getopt(argc, argv, "f:c:o:s:a:")) != -1)
   {
-    fprintf(stderr, "usage: %s <port>\n", argv[0]);
-    exit(1);
+    switch(opt)
+    {
+      case 'f':
+        strncpy(config.config_file, optarg, MAXLINE - 1);
+        break;
+      case 'c':
+        cache_size = optarg;
+        break;
+      case 'o':
+        object_size = optarg;
+        break;
+      case 's':
+        shards = optarg;
+        break;
+      case 'a':
+        control_port = optarg;
+        break;
+      default:
+        usage(argv[0]);
+    }
   }
+
+  if(optind != argc - 1)
+    usage(argv[0]);
+
+  if(config.config_file[0] != '\0' && 
+          config_load_file(&config, config.config_file) < 0)
+    exit(1);
+
+  if((cache_size && config_set(&config, "cache_size", cache_size) < 0) ||
+     (object_size && 
+          config_set(&config, "max_object_size", object_size) < 0) ||
+     (shards && config_set(&config, "shards", shards) < 0) ||
+     (control_port && config_set(&config, "control_port", control_port) < 0))
+    usage(argv[0]);
   
-  // initializing the cache
-  cache = create_cache();
+  // initializing the cache and the allocator behind it
+  slab_init(config.hugepages, config.memfd_arena);
+  cache = create_cache(config.cache_size, config.max_object_size, 
+                          config.shards);
+  cache->deadline = line_deadline;
+
+  // warm restart: map the last snapshot, entries are promoted lazily. 
+  // This blocks SIGTERM/SIGINT, so it has to come before any thread
+  if(config.snapshot_path[0] != '\0')
+  {
+    printf("snapshot: %lu entries\n", snapshot_load(config.snapshot_path));
+    snapshot_start(cache, config.snapshot_path, config.snapshot_interval);
+  }
+
+  Pthread_create(&tid, NULL, cache_trimmer, cache);
+  Pthread_create(&tid, NULL, sweeper, NULL);
+  pressure_start(cache);
+
+  // the disk tier catches whatever the memory cache evicts
+  if(config.disk_dir[0] != '\0')
+  {
+    if(dcache_init(config.disk_dir, config.disk_size, 
+                      config.disk_segment_size) < 0)
+      exit(1);
+    cache->demote = dcache_demote;
+  }
+
+  if(config.control_port[0] != '\0' && 
+          control_start(cache, config.control_port) < 0)
+  {
+    fprintf(stderr, "Could not open control port %s\n", config.control_port);
+    exit(1);
+  }
 
   // handler for SIGPIPE signals 
   Signal(SIGPIPE, SIG_IGN);
 
   /* listen as a proxy server and use the connfd for each connection */
-  listenfd = Open_listenfd(argv[1]);
+  listenfd = Open_listenfd(argv[optind]);
+
+  if(config.upstream_groups[0] != '\0' && 
+          lb_load(config.upstream_groups) < 0)
+    exit(1);
+  health_start();
+
+  // event loops own the clients, misses are handed off to a pool of 
+  // threads
+  if(config.event_loops < 0)
+    config.event_loops = sysconf(_SC_NPROCESSORS_ONLN);
+  if(config.event_loops > 0 && 
+      engine_run(listenfd, config.event_loops, config.handoff_threads, 
+                  route_request, serve_pending) < 0)
+  {
+    fprintf(stderr, "Could not start the event loops\n");
+    exit(1);
+  }
+
+  // or one thread per client
   while(1)
   {
     clientlen = sizeof(struct sockaddr_storage);
@@ -158,96 +405,810 @@ void *thread(void *vargp)
  */
 void doit(int fd)
 {
-  char buf[MAXBUF], method[MAXLINE], uri[MAXLINE], version[MAXLINE];
-  char filename[MAXLINE], host[MAXLINE], port[MAXLINE], clientbuf[MAXBUF];
-  char addn_hdrs[MAXBUF];
-  char server_response[MAX_OBJECT_SIZE] = "";
-  rio_t rio, clientrio;
-  int valid_uri, offset = 0;
-  int clientfd;
-  size_t n, response_length = 0;
-  bool is_in_cache;
+  cached_t hit, stale = {NULL, NULL};
+  request_t req;
+  rio_t rio;
 
   /* Read request line and headers */
   rio_readinitb(&rio, fd);
+  if(!read_request(fd, &rio, &req))
+    return;
+  
+  // search the uri in the cache, serve it if a copy was found; 
+  // a stale copy is handed back in stale to be revalidated
+  if(read_from_cache(&req, &hit, &stale))
+  {
+    serve_hit(fd, &req, &hit);
+    return;
+  }
 
-  if(rio_readlineb(&rio, buf, MAXLINE)<=0)
-    return; 
+  serve_miss(fd, &req, &stale);
+  dbg_printf("Exiting doit()\n");
+}
+
+/* 
+ * read_request() reads the request line and headers from rio into req. 
+ * It will only accept GET requests for a valid uri and answers anything 
+ * else with an error. returns false if there is nothing to serve. 
+ */
+bool read_request(int fd, rio_t *rio, request_t *req)
+{
+  char buf[MAXBUF], method[MAXLINE], version[MAXLINE], host[MAXLINE];
+
+  if(rio_readlineb(rio, buf, MAXLINE)<=0)
+    return false; 
 
-  sscanf(buf, "%s %s %s", method, uri, version);
+  sscanf(buf, "%s %s %s", method, req->uri, version);
 
   if(strncasecmp(method, "GET", MAXLINE))
   {
     clienterror(fd, method, "501", "Not Implemented",
                     "Proxy server does not implement this method");
-    return;
+    return false;
+  }
+
+  req->hdrs[0] = '\0';
+  parse_requesthdrs(rio, req->hdrs, host);
+  req->authorized = http_request_value(req->hdrs, "Authorization", 
+                                        buf, MAXLINE);
+  req->no_cache = http_request_no_cache(req->hdrs);
+
+  // in front of a group of backends the proxy gets origin-form 
+  // requests, the host is in the Host header
+  if(req->uri[0] == '/' && host[0] != '\0')
+  {
+    strcpy(buf, req->uri);
+    if(snprintf(req->uri, MAXLINE, "http://%s%s", host, buf) >= MAXLINE)
+    {
+      clienterror(fd, "URI", "414", "URI Too Long", 
+                      "the request target with its host is too long");
+      return false;
+    }
+  }
+
+  if(!parse_uri(req->uri, req->host, req->port, req->filename))
+  {
+    clienterror(fd, req->uri, "400", "Bad request", 
+                      "request could not be understood by the server");
+    return false;
   }
+
+  // spellings of one URI share its cache line
+  urlkey_make(req->uri, req->key, MAXLINE);
   
-  // search the uri in the cache, return if true;
-  is_in_cache = read_from_cache(uri, fd);
+  dbg_printf("Host : %s, Port : %s, Filename : %s\n", 
+                        req->host, req->port, req->filename);
+  return true;
+}
+
+/* 
+ * serve_miss() serves a request the memory cache could not answer: 
+ * from the snapshot or the disk tier, or else from the origin. A stale 
+ * copy in stale is revalidated, its references are dropped. 
+ */
+void serve_miss(int fd, request_t *req, cached_t *stale)
+{
+  webobj_t *server_response, *stored;
+  webhdr_t *header;
+  time_t expires;
 
-  if(is_in_cache)
+  // entries of the snapshot we started from are moved into the 
+  // memory cache on first touch
+  if(stale->obj == NULL && config.snapshot_path[0] != '\0' && 
+        (server_response = snapshot_lookup(req->key, &header, &expires)))
+  {
+    stored = store_body(header, server_response);
+    write_to_cache(header, stored, req, expires);
+    webobj_put(stored);
+    if(expires > time(NULL))
+    {
+      serve_cached(fd, header, server_response);
+      webhdr_put(header);
+      webobj_put(server_response);
+      return;
+    }
+    stale->hdr = header;
+    stale->obj = server_response;
+  }
+
+  // second chance: objects demoted to the disk tier
+  if(stale->obj == NULL && config.disk_dir[0] != '\0' && 
+        dcache_serve(req->key, fd))
     return;
 
   // continue normal workflow of serving response from server;
   // add it to the cache at the end 
-  if(!(valid_uri = parse_uri(uri, host, port, filename)))
+  fetch_origin(req, stale, fd);
+}
+
+/* 
+ * route_request() is called by the event engine once it has read a 
+ * request head into rio. Cache hits are handed back in hdr and obj for 
+ * the engine to write; anything else goes on to serve_pending() in a 
+ * thread of its own. So does a hit stored compressed for a client that 
+ * does not take gzip: inflating it would hold up the whole loop. 
+ */
+int route_request(int fd, rio_t *rio, webhdr_t **hdr, webobj_t **obj, 
+                  void **arg)
+{
+  pending_t *p;
+  cached_t hit;
+
+  if((p = malloc(sizeof(pending_t))) == NULL)
+    return ENGINE_DONE;
+  p->hit.hdr = NULL;
+  p->hit.obj = NULL;
+  p->stale.hdr = NULL;
+  p->stale.obj = NULL;
+  if(!read_request(fd, rio, &p->req))
   {
-    clienterror(fd, uri, "400", "Bad request", 
-                      "request could not be understood by the server");
-    
+    free(p);
+    return ENGINE_DONE;
+  }
+
+  if(read_from_cache(&p->req, &hit, &p->stale))
+  {
+    if(hit.obj->encoding != WEBOBJ_IDENTITY && 
+       !http_accepts(p->req.hdrs, "gzip"))
+    {
+      p->hit = hit;
+      *arg = p;
+      return ENGINE_HANDOFF;
+    }
+    if(!encode_cached(&p->req, &hit))
+    {
+      release_cached(&hit);
+      *arg = p;
+      return ENGINE_HANDOFF;
+    }
+    *hdr = hit.hdr;
+    *obj = hit.obj;
+    free(p);
+    return ENGINE_SEND;
+  }
+  *arg = p;
+  return ENGINE_HANDOFF;
+}
+
+/* 
+ * serve_pending() serves a request route_request() handed off, fd is 
+ * -1 if it is dropped 
+ */
+void serve_pending(int fd, void *arg)
+{
+  pending_t *p = arg;
+
+  if(fd >= 0 && p->hit.obj != NULL)
+    serve_hit(fd, &p->req, &p->hit);
+  else if(fd >= 0)
+    serve_miss(fd, &p->req, &p->stale);
+  else
+  {
+    release_cached(&p->hit);
+    release_cached(&p->stale);
+  }
+  free(p);
+}
+
+/* 
+ * fetch_origin() gets req from the server, relays the response to fd 
+ * and caches it if it may be cached. fd is -1 for background refreshes, 
+ * which only update the cache. 
+ * A stale copy in stale with an ETag or a Last-Modified date turns the 
+ * request into a conditional one, and a 304 answer refreshes it without 
+ * fetching the body again. The stale copy is also what the client gets 
+ * when the server is down or fails (origin_down()). The references in 
+ * stale are dropped. 
+ * Concurrent fetches of one uri are collapsed: the first leads, the 
+ * others follow it and get its response as it streams in. A follower 
+ * left midway, when the body grows past the object limit, fetches the 
+ * response again and sends its client only the part it is missing. 
+ */
+void fetch_origin(request_t *req, cached_t *stale, int fd)
+{
+  char buf[MAXLINE], clientbuf[MAXBUF], cond_hdrs[MAXBUF] = "";
+  char raw_hdr[MAXBUF], response_hdr[MAXBUF];
+  size_t cond_len = 0;
+  webobj_t *server_response, *stored;
+  webhdr_t *header = NULL;
+  httpmeta_t meta;
+  httpbody_t body;
+  upconn_t *conn;
+  int attempt;
+  ssize_t n, hdr_len;
+  size_t avail, object_limit, skip = 0;
+  char *readbuf;
+  webhdr_t *sent_hdr = NULL;
+  int errfd = fd;
+  time_t request_time, response_time, expires;
+  inflight_t *flight;
+  backend_t *backend;
+  health_t *health;
+  bool leader, reused, grouped;
+
+  // somebody is fetching this uri already: take its response, a 
+  // refresh has nothing left to do. If it cannot be shared we fetch 
+  // on our own
+  if((flight = inflight_join(req->key, &leader)) != NULL && !leader)
+  {
+    if(fd < 0 || inflight_follow(flight, fd, req->hdrs, &sent_hdr, &skip))
+    {
+      release_cached(stale);
+      return;
+    }
+    flight = NULL;
+  }
+
+  // the client of a follower left midway has the head and part of the 
+  // body already: the rest is fetched in full, not revalidated, and an 
+  // error can only end the response early
+  if(sent_hdr)
+  {
+    release_cached(stale);
+    errfd = -1;
+  }
+
+  // validators of the stale copy make the request conditional; 
+  // without any the copy is only kept in case the server fails. The 
+  // server decides how long they are, one that does not fit is left out 
+  if(stale->obj != NULL)
+  {
+    if(http_header_value(stale->hdr->data, stale->hdr->len, "ETag", 
+                            buf, MAXLINE) &&
+       (n = snprintf(cond_hdrs, MAXBUF, "If-None-Match: %s\r\n", buf)) < 
+          MAXBUF)
+      cond_len = n;
+    cond_hdrs[cond_len] = '\0';
+    if(http_header_value(stale->hdr->data, stale->hdr->len, 
+                            "Last-Modified", buf, MAXLINE) &&
+       (n = snprintf(cond_hdrs + cond_len, MAXBUF - cond_len, 
+                     "If-Modified-Since: %s\r\n", buf)) < 
+          (ssize_t)(MAXBUF - cond_len))
+      cond_len += n;
+    cond_hdrs[cond_len] = '\0';
+  }
+
+  // a request that does not fit into clientbuf is not sent at all
+  if(!build_headers(req->host, req->port, req->filename, clientbuf, 
+                    req->hdrs, cond_hdrs))
+  {
+    if(errfd >= 0)
+      clienterror(fd, "request", "431", "Request Header Fields Too Large", 
+                      "the request is too long to forward");
+    if(flight)
+      inflight_finish(flight, false);
+    release_cached(stale);
+    webhdr_put(sent_hdr);
     return;
   }
-  
-  dbg_printf("Host : %s, Port : %s, Filename : %s\n", host, port, filename);
 
-  if((clientfd = open_clientfd(host, port)) < 0)
+  // a host served by an upstream group is fetched from one of its 
+  // backends, picked by the policy of the group. While the breaker of 
+  // the server is open the request fails at once
+  backend = lb_pick(req->host, req->key, &grouped);
+  health = backend ? backend->health : 
+           grouped ? NULL : health_get(req->host, req->port, false);
+  if((grouped && backend == NULL) || (health && !health_allow(health)))
   {
-    fprintf(stderr, "Could not open the connection, all connects failed\n");
+    lb_release(backend);
+    webhdr_put(sent_hdr);
+    origin_down(req, stale, errfd, flight, "503", "Service Unavailable");
     return;
   }
 
-  build_headers(&rio, host, filename, clientbuf, buf, addn_hdrs);
+  // a server that just refused a connect is not tried again for a 
+  // moment, unless the client insists; then a failed lookup is 
+  // forgotten as well. A trial claimed above is handed back unused
+  if(req->no_cache)
+    dns_forget_failure(backend ? backend->host : req->host, 
+                       backend ? backend->port : req->port);
+  else if(health && health_connect_cached(health))
+  {
+    health_cancel(health);
+    lb_release(backend);
+    webhdr_put(sent_hdr);
+    origin_down(req, stale, errfd, flight, "502", "Bad Gateway");
+    return;
+  }
 
-  // write the buffer to the client connection fd 
-  Rio_writen(clientfd, clientbuf, strlen(clientbuf));
+  // send the request on a pooled connection if there is one. A pooled 
+  // connection the server closed meanwhile fails the write or the head, 
+  // and then the request is sent once more on a new connection. 
+  // The status line and headers are read on their own, they decide 
+  // whether and for how long the body may be cached
+  for(attempt = 0; ; attempt++)
+  {
+    conn = backend ? upstream_acquire(backend->host, backend->port, 
+                                      attempt > 0) :
+                     upstream_acquire(req->host, req->port, attempt > 0);
+    if(conn == NULL)
+    {
+      fprintf(stderr, "Could not open the connection, "
+                      "all connects failed\n");
+      if(health)
+      {
+        health_report(health, false);
+        health_connect_failed(health);
+      }
+      lb_release(backend);
+      webhdr_put(sent_hdr);
+      origin_down(req, stale, errfd, flight, "502", "Bad Gateway");
+      return;
+    }
 
-  // read the response from the server 
-  rio_readinitb(&clientrio, clientfd);
-  while((n = rio_readnb(&clientrio,clientbuf,MAXLINE)) != 0)
+    request_time = time(NULL);
+    if(rio_writen(conn->fd, clientbuf, strlen(clientbuf)) >= 0)
+    {
+      // a client waits on it: a slow backend may be raced by another
+      if(backend && fd >= 0 && config.hedge_percentile > 0)
+        conn = hedge_request(req, conn, &backend, &health, clientbuf);
+      if((hdr_len = http_read_head(&conn->rio, raw_hdr, MAXBUF)) >= 0)
+        break;
+    }
+
+    reused = conn->reused;
+    upstream_release(conn, false);
+    if(!reused || attempt > 0)
+    {
+      if(health)
+        health_report(health, false);
+      lb_release(backend);
+      webhdr_put(sent_hdr);
+      origin_down(req, stale, errfd, flight, "502", "Bad Gateway");
+      return;
+    }
+    upstream_count_retry();
+  }
+  response_time = time(NULL);
+  http_parse_response(raw_hdr, hdr_len, &meta);
+  http_body_init(&body, &conn->rio, &meta);
+  if(health)
+    health_report(health, !HEALTH_FAILURE(meta.status));
+
+  // the connection headers were between us and the server, the client 
+  // gets its own. A server in trouble gets the stale copy served instead
+  if((hdr_len = http_clean_head(raw_hdr, hdr_len, response_hdr, MAXBUF)) < 0 
+      || (HEALTH_FAILURE(meta.status) && stale->obj != NULL))
   {
-    rio_writen(fd,clientbuf,n);
-    response_length += n;
-    if( (response_length) <= MAX_OBJECT_SIZE)
-      memcpy(server_response + offset, clientbuf, n);
-    offset = response_length;
+    upstream_release(conn, false);
+    lb_release(backend);
+    webhdr_put(sent_hdr);
+    origin_down(req, stale, errfd, flight, "502", "Bad Gateway");
+    return;
   }
 
-  Close(clientfd);
+  if(stale->obj != NULL && cond_hdrs[0] != '\0')
+  {
+    __sync_fetch_and_add(&http_stats.revalidated, 1);
+    if(meta.status == 304)
+    {
+      // still valid: refresh the headers and expiry, keep the body
+      upstream_release(conn, !meta.close);
+      lb_release(backend);
+      __sync_fetch_and_add(&http_stats.not_modified, 1);
+      refresh_cache(req, stale, response_hdr, hdr_len, 
+                        request_time, response_time);
+      publish_cached(req, stale, flight, fd);
+      release_cached(stale);
+      return;
+    }
+  }
+  release_cached(stale);
+
+  // a resumed response must be the one whose head the client has; 
+  // what it got of the body is read past and the rest relayed uncached
+  if(sent_hdr)
+  {
+    if(!same_response(sent_hdr, response_hdr, hdr_len))
+    {
+      upstream_release(conn, false);
+      lb_release(backend);
+      webhdr_put(sent_hdr);
+      return;
+    }
+    while(skip > 0 && (n = http_body_read(&body, clientbuf, 
+                                 skip < MAXLINE ? skip : MAXLINE)) > 0)
+      skip -= n;
+  }
+  else if(fd >= 0)
+    rio_writen(fd, response_hdr, hdr_len);
+
+  // the limit may be changed from the control port while we read
+  object_limit = cache->max_object_size;
+  server_response = NULL;
+  if(sent_hdr == NULL && 
+     http_cacheable(&meta, req->authorized) && hdr_len < object_limit &&
+     (!HTTP_NEGATIVE(meta.status) || response_ttl(meta.status) > 0) &&
+     (header = webhdr_create(response_hdr, hdr_len)) != NULL)
+    server_response = webobj_create();
+  else if(sent_hdr == NULL)
+    __sync_fetch_and_add(&http_stats.uncacheable, 1);
+  webhdr_put(sent_hdr);
+
+  // only a response we may cache may be shared with the followers, and 
+  // one that may outgrow the object limit only if a follower left midway 
+  // can tell its own fetch of it is the same response
+  if(flight && server_response && 
+     (meta.has_etag || meta.last_modified > 0 || (meta.content_length >= 0 
+        && hdr_len + meta.content_length < (long long)object_limit)))
+    inflight_head(flight, header, server_response, req->hdrs);
+  else if(flight)
+  {
+    inflight_finish(flight, false);
+    flight = NULL;
+  }
+
+  // read the body from the server straight into the segments of 
+  // the web object and forward it from there; once it grows past the 
+  // object limit it is dropped and the rest goes through clientbuf, 
+  // the followers fetch what they are missing on their own
+  while(1)
+  {
+    readbuf = clientbuf;
+    avail = MAXLINE;
+    if(server_response && 
+        (hdr_len + server_response->size >= object_limit ||
+        (readbuf = webobj_reserve(server_response, &avail)) == NULL))
+    {
+      if(flight)
+        inflight_detach(flight);
+      flight = NULL;
+      webobj_put(server_response);
+      server_response = NULL;
+      readbuf = clientbuf;
+      avail = MAXLINE;
+    }
+    if(avail > MAXLINE)
+      avail = MAXLINE;
+
+    // nothing of the body is kept any more: splice the rest from the 
+    // server socket to the client instead of copying it through clientbuf
+    if(server_response == NULL && fd >= 0 && config.splice_relay && 
+       body.mode != BODY_CHUNKED)
+    {
+      http_body_relay(&body, fd);
+      break;
+    }
+
+    if((n = http_body_read(&body, readbuf, avail)) <= 0)
+      break;
+    if(fd >= 0)
+      rio_writen(fd, readbuf, n);
+    // a refresh nobody waits for is not worth reading on for
+    if(server_response == NULL && fd < 0)
+      break;
+    if(server_response)
+      webobj_commit(server_response, n);
+    if(flight)
+      inflight_publish(flight, server_response->size);
+  }
+
+  // only a response read to its end leaves the connection usable
+  upstream_release(conn, body.done && !meta.close);
+  lb_release(backend);
+  if(flight)
+    inflight_finish(flight, true);
 
   // insert the element in the cache if the object size is less
-  // than the MAX_OBJECT_SIZE
-  write_to_cache(server_response, response_length, uri);
+  // than the max object size; a response that is stale on arrival 
+  // is only worth keeping if it can be revalidated
+  if(server_response)
+  {
+    expires = http_expires(&meta, request_time, response_time, 
+                              response_ttl(meta.status));
+    if(expires <= response_time && !meta.has_etag && 
+                    meta.last_modified <= 0)
+      __sync_fetch_and_add(&http_stats.uncacheable, 1);
+    else if(hdr_len + server_response->size <= object_limit)
+    {
+      stored = store_body(header, server_response);
+      write_to_cache(header, stored, req, expires);
+      webobj_put(stored);
+      if(HTTP_NEGATIVE(meta.status))
+        __sync_fetch_and_add(&http_stats.negative_stored, 1);
+    }
+    webobj_put(server_response);
+  }
+  webhdr_put(header);
+}
 
-  dbg_printf("Exiting doit()\n");
-  return;
+/* 
+ * same_response() tells whether the response with the header block hdr 
+ * is the one whose head sent was written to a client: same status, 
+ * validators and length. One without a validator is never the same. 
+ */
+bool same_response(webhdr_t *sent, char *hdr, size_t len)
+{
+  char a[MAXLINE], b[MAXLINE];
+  httpmeta_t was, now;
+  bool etag;
+
+  http_parse_response(sent->data, sent->len, &was);
+  http_parse_response(hdr, len, &now);
+  if(was.status != now.status || was.last_modified != now.last_modified || 
+     was.content_length != now.content_length || 
+     was.has_etag != now.has_etag || 
+     (!was.has_etag && was.last_modified <= 0))
+    return false;
+  etag = http_header_value(sent->data, sent->len, "ETag", a, MAXLINE);
+  return !etag || (http_header_value(hdr, len, "ETag", b, MAXLINE) && 
+                   !strcmp(a, b));
+}
+
+/* 
+ * hedge_request() waits for the first byte of the answer to the request 
+ * just sent on conn to *backend. If it takes longer than the hedge delay 
+ * and the budget allows, the request is sent to another backend of the 
+ * group too. The connection that answers first is returned, the other 
+ * is closed, and *backend and *health are those of the winner. 
+ * The breaker of the winner is left for the caller to report to; a 
+ * trial the other claimed is reported if it failed, handed back if it 
+ * was cancelled. 
+ */
+upconn_t *hedge_request(request_t *req, upconn_t *conn, backend_t **backend, 
+                        health_t **health, char *clientbuf)
+{
+  long start = hedge_clock(), delay;
+  backend_t *other = NULL;
+  upconn_t *second = NULL;
+  int fds[2], first;
+
+  // an answer read ahead into the buffer has arrived already
+  if(conn->rio.rio_cnt > 0)
+    return conn;
+  delay = hedge_begin();
+  fds[0] = conn->fd;
+  if(delay < 0 || hedge_wait(fds, 1, delay) == 0)
+  {
+    if(delay < 0)
+      hedge_wait(fds, 1, -1);
+    hedge_record(hedge_clock() - start);
+    return conn;
+  }
+
+  // slower than most: send the request to a second backend. The budget 
+  // goes first, so a breaker trial is only claimed for a hedge we send
+  if((other = lb_pick_other(req->host, *backend)) != NULL && 
+     hedge_admit() && 
+     (other->health == NULL || health_allow(other->health)))
+  {
+    if((second = upstream_acquire(other->host, other->port, false)) == NULL)
+    {
+      if(other->health)
+      {
+        health_report(other->health, false);
+        health_connect_failed(other->health);
+      }
+    }
+    else if(rio_writen(second->fd, clientbuf, strlen(clientbuf)) < 0)
+    {
+      // a pooled connection may just have been closed by the server
+      if(other->health && second->reused)
+        health_cancel(other->health);
+      else if(other->health)
+        health_report(other->health, false);
+      upstream_release(second, false);
+      second = NULL;
+    }
+  }
+  if(second)
+  {
+    fds[1] = second->fd;
+    first = hedge_wait(fds, 2, -1);
+  }
+  else
+  {
+    lb_release(other);
+    first = hedge_wait(fds, 1, -1);
+  }
+  hedge_record(hedge_clock() - start);
+  if(second == NULL)
+    return conn;
+
+  // the loser is cancelled by closing its connection, its request has 
+  // no outcome
+  if(first == 1)
+  {
+    hedge_count_won();
+    upstream_release(conn, false);
+    if(*health)
+      health_cancel(*health);
+    lb_release(*backend);
+    *backend = other;
+    *health = other->health;
+    return second;
+  }
+  upstream_release(second, false);
+  if(other->health)
+    health_cancel(other->health);
+  lb_release(other);
+  return conn;
+}
+
+/* 
+ * origin_down() answers a request the server could not serve: with the 
+ * stale copy if there is one, to the followers of flight as well, and 
+ * otherwise with errnum. The fetch ends and the references in stale 
+ * are dropped. 
+ */
+void origin_down(request_t *req, cached_t *stale, int fd, 
+                 inflight_t *flight, char *errnum, char *shortmsg)
+{
+  if(stale->obj != NULL)
+  {
+    health_count_stale();
+    publish_cached(req, stale, flight, fd);
+  }
+  else
+  {
+    if(fd >= 0)
+      clienterror(fd, req->uri, errnum, shortmsg, 
+                      "the server is not available");
+    if(flight)
+      inflight_finish(flight, false);
+  }
+  release_cached(stale);
+}
+
+/* 
+ * start_refresh() refreshes a cache entry in a detached thread, taking 
+ * its own references to header and web_object. The caller has claimed 
+ * the line by setting its refreshing flag. 
+ */
+void start_refresh(request_t *req, webhdr_t *header, webobj_t *web_object)
+{
+  refresh_t *r;
+  pthread_t tid;
+
+  if(__sync_add_and_fetch(&refreshes, 1) > MAX_REFRESHES ||
+     (r = malloc(sizeof(refresh_t))) == NULL)
+  {
+    __sync_fetch_and_sub(&refreshes, 1);
+    unclaim_refresh(req->key, web_object);
+    return;
+  }
+  r->req = *req;
+  webhdr_get(header);
+  r->stale.hdr = header;
+  webobj_get(web_object);
+  r->stale.obj = web_object;
+  r->key_obj = web_object;
+  __sync_fetch_and_add(&http_stats.refreshes, 1);
+  if(pthread_create(&tid, NULL, refresh_thread, r) != 0)
+  {
+    release_cached(&r->stale);
+    unclaim_refresh(req->key, web_object);
+    __sync_fetch_and_sub(&refreshes, 1);
+    free(r);
+  }
+}
+
+/* 
+ * refresh_thread() fetches the entry again, with a conditional request 
+ * if it can, then releases the line for the next refresh 
+ */
+void *refresh_thread(void *vargp)
+{
+  refresh_t *r = vargp;
+
+  Pthread_detach(pthread_self());
+  dbg_printf("refreshing %s\n", r->req.uri);
+  fetch_origin(&r->req, &r->stale, -1);
+  unclaim_refresh(r->req.key, r->key_obj);
+
+  __sync_fetch_and_sub(&refreshes, 1);
+  free(r);
+  return NULL;
+}
+
+/* 
+ * sweeper() is the thread routine that reclaims, once a second, the 
+ * cache lines past their deadline and the pooled connections that 
+ * idled too long, in batches of sweep_batch. It runs at the lowest 
+ * nice value (per thread on Linux), so it only gets the CPU time the 
+ * request threads leave over. 
+ */
+void *sweeper(void *vargp)
+{
+  Pthread_detach(pthread_self());
+  setpriority(PRIO_PROCESS, 0, 19);
+  while(1)
+  {
+    sleep(1);
+    cache_sweep(cache, config.sweep_batch);
+    upstream_sweep(config.sweep_batch);
+  }
+  return NULL;
+}
+
+/* 
+ * line_deadline() returns when the sweeper may reclaim line: once it 
+ * can no longer be served stale, or with a validator stale_keep seconds 
+ * later, as until then a revalidation may still save its body 
+ */
+time_t line_deadline(cacheline_t *line)
+{
+  httpmeta_t meta;
+  time_t deadline;
+
+  http_parse_response(line->web_header->data, line->web_header->len, 
+                        &meta);
+  deadline = line->expires + http_stale_grace(&meta, config.stale_grace);
+  if(meta.has_etag || meta.last_modified > 0)
+    return config.stale_keep < 0 ? 0 : deadline + config.stale_keep;
+  return deadline;
+}
+
+/* 
+ * unclaim_refresh() clears the refreshing flag of the line of uri if it 
+ * still holds web_object (after a 304 or a failed fetch); a line 
+ * replaced by a new response starts out unclaimed anyway. web_object 
+ * is only compared, never dereferenced. 
+ */
+void unclaim_refresh(char *uri, webobj_t *web_object)
+{
+  cacheq_t *shard = cache_shard(cache, uri);
+  cacheline_t *line;
+
+  cache_wlock(shard);
+  if((line = find_object(shard, uri, web_object)) != NULL)
+    line->refreshing = 0;
+  cache_wunlock(shard);
+}
+
+/* 
+ * find_variant() returns the line of req->key that serves req: one that 
+ * does not vary, or the variant selected by the request headers. Called 
+ * with the lock of shard held. 
+ */
+cacheline_t *find_variant(cacheq_t *shard, request_t *req)
+{
+  cacheline_t *line;
+
+  for(line = search_cache(shard, req->key); line != NULL; 
+      line = search_next(line))
+    if(line->variant == NULL || http_variant_match(line->variant, req->hdrs))
+      return line;
+  return NULL;
+}
+
+/* 
+ * find_object() returns the line of uri holding web_object, whichever 
+ * variant it is. Called with the lock of shard held. 
+ */
+cacheline_t *find_object(cacheq_t *shard, char *uri, webobj_t *web_object)
+{
+  cacheline_t *line;
+
+  for(line = search_cache(shard, uri); line != NULL; line = search_next(line))
+    if(line->web_object == web_object)
+      return line;
+  return NULL;
 }
 
 /* 
  * read the request header into the buffer 
  * using the Rio_readlineb command 
  */
-void parse_requesthdrs(rio_t *rp, char *addn_hdrs)
+void parse_requesthdrs(rio_t *rp, char *addn_hdrs, char *host)
 {
   char hdr_buf[MAXBUF];
+  host[0] = '\0';
   rio_readlineb(rp, hdr_buf, MAXLINE);
   dbg_printf("%s", hdr_buf);
   while(strcmp(hdr_buf, "\r\n"))
   {
+    // the proxy sends its own Host and, when revalidating, its own 
+    // conditional headers
     if((strcasestr(hdr_buf, hdr_useragent_key)) || 
         (strcasestr(hdr_buf, hdr_connection_key)) ||
-        (strcasestr(hdr_buf, hdr_proxyconn_key)))
+        (strcasestr(hdr_buf, hdr_proxyconn_key)) ||
+        !strncasecmp(hdr_buf, hdr_host_key, strlen(hdr_host_key)) ||
+        !strncasecmp(hdr_buf, hdr_inm_key, strlen(hdr_inm_key)) ||
+        !strncasecmp(hdr_buf, hdr_ims_key, strlen(hdr_ims_key)))
         {
+          if(!strncasecmp(hdr_buf, hdr_host_key, strlen(hdr_host_key)))
+            sscanf(hdr_buf + strlen(hdr_host_key), "%s", host);
           rio_readlineb(rp, hdr_buf, MAXLINE);
           continue; 
         }
@@ -372,111 +1333,388 @@ void clienterror(int fd, char *cause, char *errnum,
 
 /* build_headers() builds the headers for the proxy to send 
  * to the server, it takes arguments such as hostname, path, buffer, 
- * and the rio internal buffer and parses them into an HTTP response
- * and returns it to proxy. 
- */
-void build_headers(rio_t *rio, char *host, char *filename, 
-              char *clientbuf, char *buf, char *addn_hdrs)
-{
-  // build the request headers 
-  sprintf(clientbuf, "GET %s HTTP/1.0\r\n", filename);
-  sprintf(buf, "Host: %s\r\n", host);
-  strcat(clientbuf, buf);
-  strcat(clientbuf,hdr_useragent_value);
-  strcat(clientbuf,hdr_connection_value);
-  strcat(clientbuf,hdr_proxyconn_value);
-
-  // parse additional request headers   
-  parse_requesthdrs(rio, addn_hdrs);
-  strcat(clientbuf, addn_hdrs);
-  strcat(clientbuf, "\r\n");
-  return;
+ * the request headers of the client and the conditional headers of a 
+ * revalidation, and puts them together into an HTTP request of at 
+ * most MAXBUF bytes. returns false if they do not fit 
+ */
+bool build_headers(char *host, char *port, char *filename, char *clientbuf, 
+                   char *addn_hdrs, char *cond_hdrs)
+{
+  bool default_port = !strcmp(port, "80");
+  int n;
+
+  // build the request headers; HTTP/1.1 so that the server keeps the 
+  // connection open for the next request
+  n = snprintf(clientbuf, MAXBUF, "GET %s HTTP/1.1\r\n"
+                                  "Host: %s%s%s\r\n%s%s%s%s\r\n", 
+               filename, host, default_port ? "" : ":", 
+               default_port ? "" : port, hdr_useragent_value, 
+               hdr_connection_value, addn_hdrs, cond_hdrs);
+  return n >= 0 && n < MAXBUF;
 }
 
 /* 
- * write_to_cache() will take arguments like server response, 
- * write length and uri and write the key object pair to the cache buffer.
- * It searches the cache whether the object already exists in the cache. 
- * It will add to thhe cache if the object is not found in the 
- * cache. Eviction is done on basis of lru count and evicted till the 
+ * write_to_cache() will take arguments like server response, its 
+ * header block and the request and write the key object pair to the 
+ * cache buffer, under the key of the request.
+ * It searches the cache whether the object already exists in the cache, 
+ * a stored copy is replaced by the newer response. A response with Vary 
+ * is stored as the variant the request headers select, next to the 
+ * other variants of the key; past max_variants the oldest is dropped. 
+ * Eviction is done on basis of lru count and evicted till the 
  * response length is available in the cache. 
  */
-void write_to_cache(char *server_response, size_t write_len, char *uri)
+void write_to_cache(webhdr_t *header, webobj_t *server_response, 
+                              request_t *req, time_t expires)
 {
-  size_t evict_size = 0;
-  sem_wait(&w);
-  if( write_len <= MAX_OBJECT_SIZE )
+  cacheq_t *shard = cache_shard(cache, req->key);
+  size_t write_len = header->len + server_response->size;
+  cacheline_t *line, *next, *oldest;
+  char variant[MAXLINE];
+  bool varies;
+  int n;
+
+  varies = http_variant(header->data, header->len, req->hdrs, variant, 
+                          MAXLINE);
+
+  // Take writer lock of the shard to evict from and add to it
+  cache_wlock(shard);
+  if( write_len <= cache->max_object_size && write_len <= shard->max_size )
   {
-    
+    // the copies this request would be served are replaced; a response 
+    // that does not vary replaces every variant
+    for(line = search_cache(shard, req->key); line != NULL; line = next)
+    {
+      next = search_next(line);
+      if(!varies || line->variant == NULL || 
+         !strcmp(line->variant, variant))
+        remove_from_cache(shard, line);
+    }
+
+    // make room for another variant
+    while(varies)
+    {
+      oldest = NULL;
+      for(n = 0, line = search_cache(shard, req->key); line != NULL; 
+          line = search_next(line), n++)
+        if(oldest == NULL || line->age < oldest->age)
+          oldest = line;
+      if(n < config.max_variants)
+        break;
+      remove_from_cache(shard, oldest);
+      __sync_fetch_and_add(&http_stats.variant_evictions, 1);
+    }
+
     dbg_printf("response size smaller than max_cache_object\n");
-    if(is_cache_full(cache, write_len))
+    if(is_cache_full(shard, write_len))
     {
       
       dbg_printf("Cache full, evicting\n");
-      while(evict_size < write_len && !search_cache(cache, uri))
-      {
-        // Take writer lock to evict from cache
-        evict_size += eviction(cache);
-      }
+      while(is_cache_full(shard, write_len) && eviction(shard))
+        ;
       
     }
     
     dbg_printf("adding to cache\n");
-    // Take writer lock to add to cache
-    if(!add_to_cache(cache, uri, server_response, write_len) 
-          && !search_cache(cache, uri))
+    if(!add_to_cache(shard, req->key, varies ? variant : NULL, header, 
+                      server_response, expires))
       printf("Failed to add to cache\n"); 
+    else
+    {
+      __sync_fetch_and_add(&http_stats.stored, 1);
+      if(varies)
+        __sync_fetch_and_add(&http_stats.variants, 1);
+    }
   }
-  sem_post(&w);
+  cache_wunlock(shard);
 }
 
 /*
- * searches the cache for the string uri and 
- * serves it to the open file descriptor for the client 
+ * searches the cache for the uri of req and 
+ * returns it in hit with references, for the caller to serve. The body 
+ * is as stored, encode_cached() readies it for the client 
  * 
- * It will return true if the element was found in the cache and served 
- * Return false if the element was not found in the cache
+ * It will return true if the element was found in the cache and can be 
+ * served: 
+ * fresh, or stale but within its grace while a background refresh runs. 
+ * Hot elements close to their expiry are refreshed ahead of time. 
+ * Return false if the element was not found in the cache, or was stale 
+ * past its grace; such an element is returned in stale with references 
+ * for the caller to revalidate
  */
-bool read_from_cache(char *uri, int fd)
+bool read_from_cache(request_t *req, cached_t *hit, cached_t *stale)
 {
   cacheline_t *response_object;
+  webobj_t *web_object;
+  webhdr_t *web_header;
+  cacheq_t *shard = cache_shard(cache, req->key);
+  httpmeta_t meta;
+  time_t now = time(NULL);
+  bool fresh, usable, negative, refresh = false;
   // Initailize the reader lock
-  sem_wait(&mutex);
-  readcnt++;
-  if(readcnt == 1)
-    sem_wait(&w);
-  sem_post(&mutex);
+  cache_rlock(shard);
   
-  response_object = search_cache(cache, uri);
+  response_object = find_variant(shard, req);
   
   if(response_object)
   {
     dbg_printf("Cache Hit, replying to browser query\n"); fflush(stdout);
   
-    Rio_writen(fd, response_object->web_object, response_object->size);
+    web_object = response_object->web_object;
+    webobj_get(web_object);
+    web_header = response_object->web_header;
+    webhdr_get(web_header);
+    negative = HTTP_NEGATIVE(http_status(web_header->data, 
+                                         web_header->len));
+    if(negative && req->no_cache)
+    {
+      // the client wants to see for itself whether the error is gone
+      cache_runlock(shard);
+      __sync_fetch_and_add(&http_stats.negative_bypassed, 1);
+      webobj_put(web_object);
+      webhdr_put(web_header);
+      return false;
+    }
+    fresh = usable = response_object->expires > now;
+    if(!fresh)
+    {
+      http_parse_response(web_header->data, web_header->len, &meta);
+      usable = now < response_object->expires + 
+                        http_stale_grace(&meta, config.stale_grace);
+    }
+
+    // one request claims the line for a background refresh: when it is 
+    // stale within its grace, or hot and about to expire
+    if(usable && (!fresh || 
+       (config.refresh_ahead > 0 && 
+        response_object->expires - now <= config.refresh_ahead &&
+        response_object->hits >= config.refresh_min_hits)))
+      refresh = __sync_bool_compare_and_swap(&response_object->refreshing, 
+                                              0, 1);
+    __sync_fetch_and_add(&response_object->hits, 1);
     response_object->age = lru++;
   
-    sem_wait(&mutex);
-    readcnt--;
-    if(readcnt == 0)
-      sem_post(&w);
-  // remove reader lock
-    sem_post(&mutex);
+  // remove reader lock before writing, our reference keeps the 
+  // object alive even if it gets evicted meanwhile
+    cache_runlock(shard);
+
+    if(!usable)
+    {
+      dbg_printf("Cache hit is stale\n");
+      stale->hdr = web_header;
+      stale->obj = web_object;
+      return false;
+    }
+
+    if(refresh)
+      start_refresh(req, web_header, web_object);
+    if(!fresh)
+      __sync_fetch_and_add(&http_stats.stale_served, 1);
+    if(negative)
+      __sync_fetch_and_add(&http_stats.negative_hits, 1);
+
+    hit->hdr = web_header;
+    hit->obj = web_object;
 
     dbg_printf("Cache_hit!\n");
     return true; 
   }
 
-  sem_wait(&mutex);
-  readcnt--;
-  if(readcnt == 0)
-    sem_post(&w);
   // remove reader lock
-  sem_post(&mutex);
+  cache_runlock(shard);
 
   // if found a response in cache, serve to client now
   // Take a writer lock to update the lru
   
   dbg_printf("Cache Miss\n");
   return false;
-}
\ No newline at end of file
+}
+
+/* 
+ * response_ttl() returns the seconds a response with status is cached 
+ * for when the server does not say: errors are only kept briefly 
+ */
+long response_ttl(int status)
+{
+  if(!HTTP_NEGATIVE(status))
+    return config.default_ttl;
+  return status >= 500 ? config.negative_ttl_5xx : config.negative_ttl_4xx;
+}
+
+/* 
+ * refresh_cache() applies a 304 answer to a stale entry: the headers 
+ * of the 304 are merged into the stored header block and the expiry is 
+ * computed again. The body stays where it is. If the entry was evicted 
+ * meanwhile it is added back. stale gets the merged header block. 
+ */
+void refresh_cache(request_t *req, cached_t *stale, char *update, 
+                   size_t update_len, time_t request_time, 
+                   time_t response_time)
+{
+  char merged[MAXBUF];
+  cacheq_t *shard = cache_shard(cache, req->key);
+  cacheline_t *line;
+  webhdr_t *header;
+  httpmeta_t meta;
+  time_t expires;
+  ssize_t len;
+
+  len = http_merge_304(stale->hdr->data, stale->hdr->len, update, 
+                          update_len, merged, MAXBUF);
+  if(len < 0 || (header = webhdr_create(merged, len)) == NULL)
+    return;
+  http_parse_response(merged, len, &meta);
+  expires = http_expires(&meta, request_time, response_time, 
+                            response_ttl(meta.status));
+
+  cache_wlock(shard);
+  if((line = find_object(shard, req->key, stale->obj)) != NULL)
+  {
+    shard->cache_size -= line->web_header->len;
+    shard->cache_size += header->len;
+    line->size = header->len + line->web_object->size;
+    // the 304 may have brought other tags 
+    purge_index_remove(line);
+    webhdr_put(line->web_header);
+    webhdr_get(header);
+    line->web_header = header;
+    purge_index_add(line);
+    line->expires = expires;
+    cache_schedule(shard, line);
+  }
+  else
+    // a newer copy replaced it meanwhile, or nothing did
+    line = find_variant(shard, req);
+  cache_wunlock(shard);
+
+  if(line == NULL)
+    write_to_cache(header, stale->obj, req, expires);
+
+  webhdr_put(stale->hdr);
+  stale->hdr = header;
+}
+
+/* 
+ * serve_cached() writes a cached response, header block and body, to 
+ * the client 
+ */
+void serve_cached(int fd, webhdr_t *header, webobj_t *web_object)
+{
+  if(rio_writen(fd, header->data, header->len) < 0)
+    return;
+  webobj_write(fd, web_object);
+}
+
+/* 
+ * store_body() returns the object to cache as the body of the response 
+ * header: an object already holding the same bytes if cache_dedup finds 
+ * one, else body, compressed if cache_compress says so. The caller gets 
+ * a reference of its own 
+ */
+webobj_t *store_body(webhdr_t *header, webobj_t *body)
+{
+  webobj_t *stored;
+
+  if(config.cache_dedup && body->encoding == WEBOBJ_IDENTITY && 
+     body->size >= DEDUP_MIN_SIZE)
+  {
+    dedup_digest(body);
+    // a compressed copy only where this response may be compressed
+    if((stored = dedup_find(body, 
+                    compress_wanted(header->data, header->len))) != NULL)
+      return stored;
+  }
+  return compress_body(header->data, header->len, body);
+}
+
+/* 
+ * serve_hit() writes a hit of read_from_cache() to fd in a coding the 
+ * client of req takes and drops its references. One that cannot be 
+ * readied is fetched from the origin instead. 
+ */
+void serve_hit(int fd, request_t *req, cached_t *hit)
+{
+  cached_t none = {NULL, NULL};
+
+  if(encode_cached(req, hit))
+  {
+    serve_cached(fd, hit->hdr, hit->obj);
+    release_cached(hit);
+    return;
+  }
+  release_cached(hit);
+  serve_miss(fd, req, &none);
+}
+
+/* 
+ * encode_cached() readies an entry whose body is stored compressed for 
+ * the client of req: one that accepts gzip gets the stored bytes under 
+ * a header block saying so, any other (and a NULL req) the body 
+ * inflated. The references in entry are swapped for the new ones. 
+ * returns false if that failed 
+ */
+bool encode_cached(request_t *req, cached_t *entry)
+{
+  char head[MAXBUF];
+  webhdr_t *header;
+  webobj_t *raw;
+  ssize_t len;
+
+  if(entry->obj->encoding == WEBOBJ_IDENTITY)
+    return true;
+
+  if(req != NULL && http_accepts(req->hdrs, "gzip"))
+  {
+    len = http_encode_head(entry->hdr->data, entry->hdr->len, "gzip", 
+                            entry->obj->size, head, MAXBUF);
+    if(len < 0 || (header = webhdr_create(head, len)) == NULL)
+      return false;
+    webhdr_put(entry->hdr);
+    entry->hdr = header;
+    compress_count_served(true);
+    return true;
+  }
+
+  if((raw = inflate_object(entry->obj)) == NULL)
+    return false;
+  webobj_put(entry->obj);
+  entry->obj = raw;
+  compress_count_served(false);
+  return true;
+}
+
+/* 
+ * publish_cached() answers a fetch with a cached entry: the followers 
+ * of flight get it uncompressed, as they may not all take gzip, and the 
+ * client on fd in the coding it takes. The fetch ends; the references 
+ * in entry stay the caller's 
+ */
+void publish_cached(request_t *req, cached_t *entry, inflight_t *flight, 
+                    int fd)
+{
+  cached_t copy = *entry;
+  bool ok;
+
+  if(flight)
+  {
+    webhdr_get(copy.hdr);
+    webobj_get(copy.obj);
+    if((ok = encode_cached(NULL, &copy)))
+      inflight_head(flight, copy.hdr, copy.obj, req->hdrs);
+    release_cached(&copy);
+    inflight_finish(flight, ok);
+  }
+  if(fd >= 0 && encode_cached(req, entry))
+    serve_cached(fd, entry->hdr, entry->obj);
+}
+
+/* 
+ * release_cached() drops the references held by entry, if any 
+ */
+void release_cached(cached_t *entry)
+{
+  webhdr_put(entry->hdr);
+  webobj_put(entry->obj);
+  entry->hdr = NULL;
+  entry->obj = NULL;
+}
@@ -0,0 +1,526 @@
+/* Cache purge file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+#include "csapp.h"
+#include "purge.h"
+#include "config.h"
+#include "http.h"
+#include "dcache.h"
+#include "snapshot.h"
+
+//#define DEBUG // uncomment this line to enable debugging
+
+#ifdef DEBUG
+/* When debugging is enabled, these form aliases to useful functions */
+#define dbg_printf(...) printf(__VA_ARGS__)
+#else
+/* When debugging is disabled, no code gets generated for these */
+#define dbg_printf(...)
+#endif
+
+#define TAG_SEPARATORS " ,\t"
+
+/* node of the radix tree, the key of a node is the labels on its path */
+typedef struct radix
+{
+    char *label;            // bytes on the edge into the node
+    size_t len;
+    int lines;              // cache lines with the key of the node
+    struct radix *child;    // first child; children differ in label[0]
+    struct radix *sibling;
+}radix_t;
+
+typedef struct tagent tagent_t;
+
+/* one key carrying one tag */
+typedef struct tagref
+{
+    tagent_t *tag;
+    char *key;
+    int lines;                      // cache lines of key with the tag
+    struct tagref *next;            // bucket of (tag, key)
+    struct tagref *prev_key;        // keys of the tag
+    struct tagref *next_key;
+}tagref_t;
+
+struct tagent
+{
+    char *name;
+    tagref_t *keys;
+    struct tagent *next;            // bucket of the name
+};
+
+/* keys collected for a purge */
+typedef struct keylist
+{
+    char **keys;
+    size_t n, cap;
+}keylist_t;
+
+static radix_t root;
+static tagent_t *tags[PURGE_BUCKETS];
+static tagref_t *refs[PURGE_BUCKETS];
+static sem_t purge_mutex;
+static pthread_once_t purge_once = PTHREAD_ONCE_INIT;
+static purge_stats_t pg_stats;
+
+static void purge_init(void)
+{
+    Sem_init(&purge_mutex, 0, 1);
+}
+
+/* a node with a copy of the len bytes at label */
+static radix_t *radix_new(char *label, size_t len)
+{
+    radix_t *node;
+
+    if((node = calloc(1, sizeof(radix_t))) == NULL)
+        return NULL;
+    if((node->label = malloc(len)) == NULL)
+    {
+        free(node);
+        return NULL;
+    }
+    memcpy(node->label, label, len);
+    node->len = len;
+    pg_stats.nodes++;
+    return node;
+}
+
+static void radix_free(radix_t *node)
+{
+    free(node->label);
+    free(node);
+    pg_stats.nodes--;
+}
+
+/* counts a line of key, splitting an edge where key leaves it */
+static void radix_insert(char *key)
+{
+    radix_t **pp, *node = &root, *c, *split;
+    char *rest;
+    size_t i;
+
+    while(*key != '\0')
+    {
+        for(pp = &node->child; (c = *pp) != NULL && c->label[0] != *key;
+            pp = &c->sibling)
+            ;
+        if(c == NULL)
+        {
+            if((c = radix_new(key, strlen(key))) == NULL)
+                return;
+            c->sibling = node->child;
+            node->child = c;
+            node = c;
+            break;
+        }
+        for(i = 1; i < c->len && key[i] == c->label[i]; i++)
+            ;
+        if(i < c->len)
+        {
+            // key parts from the edge: the shared bytes get a node
+            if((split = radix_new(c->label, i)) == NULL)
+                return;
+            if((rest = malloc(c->len - i)) == NULL)
+            {
+                radix_free(split);
+                return;
+            }
+            memcpy(rest, c->label + i, c->len - i);
+            free(c->label);
+            c->label = rest;
+            c->len -= i;
+            split->sibling = c->sibling;
+            split->child = c;
+            c->sibling = NULL;
+            *pp = split;
+            c = split;
+        }
+        node = c;
+        key += i;
+    }
+    if(node->lines++ == 0)
+        pg_stats.keys++;
+}
+
+/*
+ * radix_remove() drops a line of key below node, pruning the nodes
+ * left without lines and merging those left with one child. returns
+ * false if key is not in the tree
+ */
+static bool radix_remove(radix_t *node, char *key)
+{
+    radix_t **pp, *c, *only;
+    char *label;
+
+    if(*key == '\0')
+    {
+        if(node->lines == 0)
+            return false;
+        if(--node->lines == 0)
+            pg_stats.keys--;
+        return true;
+    }
+    for(pp = &node->child; (c = *pp) != NULL && c->label[0] != *key;
+        pp = &c->sibling)
+        ;
+    if(c == NULL || strncmp(key, c->label, c->len) ||
+       !radix_remove(c, key + c->len))
+        return false;
+
+    if(c->lines > 0)
+        return true;
+    if(c->child == NULL)
+    {
+        *pp = c->sibling;
+        radix_free(c);
+    }
+    else if(c->child->sibling == NULL &&
+            (label = malloc(c->len + c->child->len)) != NULL)
+    {
+        only = c->child;
+        memcpy(label, c->label, c->len);
+        memcpy(label + c->len, only->label, only->len);
+        free(only->label);
+        only->label = label;
+        only->len += c->len;
+        only->sibling = c->sibling;
+        *pp = only;
+        radix_free(c);
+    }
+    return true;
+}
+
+/* appends a copy of the len bytes at key to list */
+static void keylist_add(keylist_t *list, char *key, size_t len)
+{
+    char **keys, *copy;
+
+    if(list->n == list->cap)
+    {
+        list->cap = list->cap ? 2 * list->cap : 64;
+        if((keys = realloc(list->keys, list->cap * sizeof(char *))) == NULL)
+        {
+            list->cap = list->n;
+            return;
+        }
+        list->keys = keys;
+    }
+    if((copy = malloc(len + 1)) == NULL)
+        return;
+    memcpy(copy, key, len);
+    copy[len] = '\0';
+    list->keys[list->n++] = copy;
+}
+
+/* collects the keys of node and the nodes below it, path is its key */
+static void radix_collect(radix_t *node, char *path, size_t len,
+                          keylist_t *list)
+{
+    radix_t *c;
+
+    if(node->lines > 0)
+        keylist_add(list, path, len);
+    for(c = node->child; c != NULL; c = c->sibling)
+    {
+        if(len + c->len >= MAXLINE)
+            continue;
+        memcpy(path + len, c->label, c->len);
+        radix_collect(c, path, len + c->len, list);
+    }
+}
+
+/* collects the keys starting with prefix */
+static void radix_prefix(char *prefix, keylist_t *list)
+{
+    char path[MAXLINE];
+    radix_t *node = &root, *c;
+    size_t len = 0, n;
+
+    while(*prefix != '\0')
+    {
+        for(c = node->child; c != NULL && c->label[0] != *prefix;
+            c = c->sibling)
+            ;
+        if(c == NULL)
+            return;
+        // the prefix may end inside the label
+        n = strlen(prefix) < c->len ? strlen(prefix) : c->len;
+        if(strncmp(prefix, c->label, n) || len + c->len >= MAXLINE)
+            return;
+        memcpy(path + len, c->label, c->len);
+        len += c->len;
+        prefix += n;
+        node = c;
+    }
+    radix_collect(node, path, len, list);
+}
+
+/* the entry of the tag name, created if create is set */
+static tagent_t *tag_find(char *name, bool create)
+{
+    tagent_t *t;
+    int b = hash_key(name) % PURGE_BUCKETS;
+
+    for(t = tags[b]; t != NULL; t = t->next)
+        if(!strcmp(t->name, name))
+            return t;
+    if(!create || (t = calloc(1, sizeof(tagent_t))) == NULL)
+        return NULL;
+    if((t->name = strdup(name)) == NULL)
+    {
+        free(t);
+        return NULL;
+    }
+    t->next = tags[b];
+    tags[b] = t;
+    pg_stats.tags++;
+    return t;
+}
+
+/* bucket of the pair (t, key) */
+static int ref_bucket(tagent_t *t, char *key)
+{
+    return (hash_key(key) ^ (unsigned long)t) % PURGE_BUCKETS;
+}
+
+/* counts a line of key tagged name */
+static void tag_add(char *name, char *key)
+{
+    tagent_t *t;
+    tagref_t *r;
+    int b;
+
+    if((t = tag_find(name, true)) == NULL)
+        return;
+    b = ref_bucket(t, key);
+    for(r = refs[b]; r != NULL; r = r->next)
+        if(r->tag == t && !strcmp(r->key, key))
+        {
+            r->lines++;
+            return;
+        }
+    if((r = calloc(1, sizeof(tagref_t))) == NULL)
+        return;
+    if((r->key = strdup(key)) == NULL)
+    {
+        free(r);
+        return;
+    }
+    r->tag = t;
+    r->lines = 1;
+    r->next = refs[b];
+    refs[b] = r;
+    r->next_key = t->keys;
+    if(t->keys != NULL)
+        t->keys->prev_key = r;
+    t->keys = r;
+    pg_stats.tag_refs++;
+}
+
+/* drops a line of key tagged name, and the tag with its last key */
+static void tag_remove(char *name, char *key)
+{
+    tagent_t *t, **tp;
+    tagref_t *r, **pp;
+
+    if((t = tag_find(name, false)) == NULL)
+        return;
+    for(pp = &refs[ref_bucket(t, key)]; (r = *pp) != NULL; pp = &r->next)
+        if(r->tag == t && !strcmp(r->key, key))
+            break;
+    if(r == NULL || --r->lines > 0)
+        return;
+
+    *pp = r->next;
+    if(r->prev_key != NULL)
+        r->prev_key->next_key = r->next_key;
+    else
+        t->keys = r->next_key;
+    if(r->next_key != NULL)
+        r->next_key->prev_key = r->prev_key;
+    free(r->key);
+    free(r);
+    pg_stats.tag_refs--;
+    if(t->keys != NULL)
+        return;
+
+    for(tp = &tags[hash_key(name) % PURGE_BUCKETS]; *tp != t;
+        tp = &(*tp)->next)
+        ;
+    *tp = t->next;
+    free(t->name);
+    free(t);
+    pg_stats.tags--;
+}
+
+/*
+ * purge_tags() copies the tag header of the response header block hdr
+ * into tags. returns false if it has none
+ */
+bool purge_tags(char *hdr, size_t len, char *tags, size_t max)
+{
+    return config.purge_tag_header[0] != '\0' &&
+           http_header_value(hdr, len, config.purge_tag_header, tags, max);
+}
+
+/* whether tag is one of the tags in the header value tags */
+static bool has_tag(char *tags, char *tag)
+{
+    size_t n = strlen(tag);
+    char *p = tags;
+
+    while(*(p += strspn(p, TAG_SEPARATORS)) != '\0')
+    {
+        if(strcspn(p, TAG_SEPARATORS) == n && !strncmp(p, tag, n))
+            return true;
+        p += strcspn(p, TAG_SEPARATORS);
+    }
+    return false;
+}
+
+/*
+ * purge_match() tells whether the entry stored under key, with the tag
+ * header value tags (NULL if none), is one a purge of kind and arg hits
+ */
+bool purge_match(purge_kind_t kind, char *arg, char *key, char *tags)
+{
+    switch(kind)
+    {
+    case PURGE_KEY:
+        return !strcmp(key, arg);
+    case PURGE_PREFIX:
+        return !strncmp(key, arg, strlen(arg));
+    case PURGE_TAG:
+        return tags != NULL && has_tag(tags, arg);
+    }
+    return false;
+}
+
+/* adds or drops a line of key for every tag in the header block hdr */
+static void index_tags(webhdr_t *hdr, char *key, bool add)
+{
+    char value[MAXLINE], *save, *name;
+
+    if(!purge_tags(hdr->data, hdr->len, value, MAXLINE))
+        return;
+    for(name = strtok_r(value, TAG_SEPARATORS, &save); name != NULL;
+        name = strtok_r(NULL, TAG_SEPARATORS, &save))
+    {
+        if(add)
+            tag_add(name, key);
+        else
+            tag_remove(name, key);
+    }
+}
+
+/*
+ * purge_index_add() indexes the key and the tags of a line added to
+ * the cache; called under the shard lock
+ */
+void purge_index_add(cacheline_t *line)
+{
+    pthread_once(&purge_once, purge_init);
+    P(&purge_mutex);
+    radix_insert(line->key);
+    index_tags(line->web_header, line->key, true);
+    V(&purge_mutex);
+}
+
+/* purge_index_remove() forgets a line leaving the cache */
+void purge_index_remove(cacheline_t *line)
+{
+    pthread_once(&purge_once, purge_init);
+    P(&purge_mutex);
+    radix_remove(&root, line->key);
+    index_tags(line->web_header, line->key, false);
+    V(&purge_mutex);
+}
+
+/*
+ * purge_lines() purges the lines of key, only those tagged tag unless
+ * it is NULL. returns the lines purged
+ */
+static size_t purge_lines(cache_t *cache, char *key, char *tag, bool soft)
+{
+    char value[MAXLINE];
+    cacheq_t *shard = cache_shard(cache, key);
+    cacheline_t *line, *next;
+    time_t now = time(NULL);
+    size_t n = 0;
+
+    cache_wlock(shard);
+    for(line = search_cache(shard, key); line != NULL; line = next)
+    {
+        // variants of a key may be tagged differently
+        next = search_next(line);
+        if(tag != NULL && !(purge_tags(line->web_header->data,
+                                       line->web_header->len, value,
+                                       MAXLINE) && has_tag(value, tag)))
+            continue;
+        if(!soft)
+            remove_from_cache(shard, line);
+        else if(line->expires > now)
+        {
+            line->expires = now;
+            cache_schedule(shard, line);
+        }
+        n++;
+    }
+    cache_wunlock(shard);
+    return n;
+}
+
+/*
+ * purge_run() purges, or soft purges, what kind and arg name from all
+ * the tiers. The keys are collected from the index first, the shard
+ * locks are taken after the index is let go as cache.c takes them the
+ * other way round
+ */
+size_t purge_run(cache_t *cache, purge_kind_t kind, char *arg, bool soft)
+{
+    keylist_t list = {NULL, 0, 0};
+    tagent_t *t;
+    tagref_t *r;
+    size_t i, lines = 0, entries = 0;
+
+    pthread_once(&purge_once, purge_init);
+    P(&purge_mutex);
+    if(kind == PURGE_KEY)
+        keylist_add(&list, arg, strlen(arg));
+    else if(kind == PURGE_PREFIX)
+        radix_prefix(arg, &list);
+    else if((t = tag_find(arg, false)) != NULL)
+        for(r = t->keys; r != NULL; r = r->next_key)
+            keylist_add(&list, r->key, strlen(r->key));
+    V(&purge_mutex);
+
+    for(i = 0; i < list.n; i++)
+    {
+        lines += purge_lines(cache, list.keys[i],
+                             kind == PURGE_TAG ? arg : NULL, soft);
+        free(list.keys[i]);
+    }
+    free(list.keys);
+
+    // the other tiers have nothing to revalidate with
+    if(config.disk_dir[0] != '\0')
+        entries += dcache_purge(kind, arg);
+    if(config.snapshot_path[0] != '\0')
+        entries += snapshot_purge(kind, arg);
+
+    dbg_printf("purge: %s %lu lines, %lu entries\n", arg, lines, entries);
+    __sync_fetch_and_add(&pg_stats.purges, 1);
+    __sync_fetch_and_add(soft ? &pg_stats.soft_purged : &pg_stats.purged,
+                         lines);
+    __sync_fetch_and_add(&pg_stats.purged, entries);
+    return lines + entries;
+}
+
+/* purge_get_stats() fills in the counters */
+void purge_get_stats(purge_stats_t *stats)
+{
+    *stats = pg_stats;
+}
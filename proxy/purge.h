@@ -0,0 +1,94 @@
+/* Cache purge header file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+
+/*
+ * Invalidation of cached responses from the control port, by exact
+ * key, by key prefix and by surrogate tag:
+ *
+ *   purge key http://example.com/a.css       one key, all its variants
+ *   purge prefix http://example.com/img/     every key starting so
+ *   purge tag product-42                     every response tagged so
+ *   softpurge ...                            the same, marking stale
+ *
+ * Keys and prefixes are normalized like request URIs (urlkey.c) first.
+ * A purge drops the lines from the memory cache, the disk tier and the
+ * untouched snapshot entries. A soft purge only makes the memory lines
+ * stale: they are served within their stale grace while one request
+ * refreshes them, and revalidated with the origin when they have a
+ * validator, so a purge of a whole site does not send all of its
+ * traffic to the origin at once. Disk and snapshot entries cannot be
+ * revalidated and are dropped either way.
+ *
+ * To find the keys without walking the shards every key in the memory
+ * cache is indexed as it is added (from cache.c, like dedup.c), in a
+ * radix tree for prefixes
+ *
+ *   "http://a.com/" -+- "img/" -+- "1.png"  (line)
+ *                    |          +- "2.png"  (line)
+ *                    +- "index.html"        (line)
+ *
+ * and by the tags the origin lists in the response header named by
+ * purge_tag_header (Surrogate-Key by default), separated by spaces or
+ * commas, in a table of tag -> keys.
+ */
+
+#ifndef __PURGE_H__
+#define __PURGE_H__
+
+#include "csapp.h"
+#include "cache.h"
+
+#define PURGE_TAG_HEADER "Surrogate-Key" /* default header with the tags */
+#define PURGE_BUCKETS 4096
+
+typedef enum purge_kind
+{
+    PURGE_KEY,
+    PURGE_PREFIX,
+    PURGE_TAG
+}purge_kind_t;
+
+typedef struct purge_stats
+{
+    size_t keys;             // distinct keys in the radix tree
+    size_t nodes;            // nodes of the radix tree
+    size_t tags;             // distinct tags
+    size_t tag_refs;         // (tag, key) pairs
+    size_t purges;           // purge commands run
+    size_t purged;           // lines and entries dropped
+    size_t soft_purged;      // lines and entries marked stale
+}purge_stats_t;
+
+/*
+ * purge_index_add() indexes the key and the tags of a line added to
+ * the cache; called under the shard lock
+ */
+void purge_index_add(cacheline_t *line);
+
+/* purge_index_remove() forgets a line leaving the cache */
+void purge_index_remove(cacheline_t *line);
+
+/*
+ * purge_tags() copies the tag header of the response header block hdr
+ * into tags. returns false if it has none
+ */
+bool purge_tags(char *hdr, size_t len, char *tags, size_t max);
+
+/*
+ * purge_match() tells whether the entry stored under key, with the tag
+ * header value tags (NULL if none), is one a purge of kind and arg hits
+ */
+bool purge_match(purge_kind_t kind, char *arg, char *key, char *tags);
+
+/*
+ * purge_run() purges, or soft purges, what kind and arg name from all
+ * the tiers. returns the lines and entries purged
+ */
+size_t purge_run(cache_t *cache, purge_kind_t kind, char *arg, bool soft);
+
+/* purge_get_stats() fills in the counters */
+void purge_get_stats(purge_stats_t *stats);
+
+#endif /* __PURGE_H__ */
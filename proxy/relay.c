@@ -0,0 +1,80 @@
+/* Splice relay file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+#define _GNU_SOURCE         /* splice() */
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include "relay.h"
+
+//#define DEBUG // uncomment this line to enable debugging
+
+#ifdef DEBUG
+/* When debugging is enabled, these form aliases to useful functions */
+#define dbg_printf(...) printf(__VA_ARGS__)
+#else
+/* When debugging is disabled, no code gets generated for these */
+#define dbg_printf(...)
+#endif
+
+/* drains n bytes from the pipe into out. returns -1 on an error */
+static int drain(int pipefd, int out, ssize_t n)
+{
+    ssize_t rc;
+
+    while(n > 0)
+    {
+        rc = splice(pipefd, NULL, out, NULL, n, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if(rc < 0 && errno == EINTR)
+            continue;
+        if(rc <= 0)
+            return -1;
+        n -= rc;
+    }
+    return 0;
+}
+
+/*
+ * relay_splice() moves len bytes from the socket in to the socket out,
+ * or everything up to the end of in if len is negative. *eof is set if
+ * in was closed. returns the bytes moved, or -1 on an error
+ */
+ssize_t relay_splice(int in, int out, long long len, bool *eof)
+{
+    int p[2];
+    ssize_t rc, total = 0;
+    size_t want;
+
+    *eof = false;
+    if(pipe(p) < 0)
+        return -1;
+
+    while(len != 0)
+    {
+        want = (len < 0 || len > RELAY_CHUNK) ? RELAY_CHUNK : len;
+        rc = splice(in, NULL, p[1], NULL, want, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if(rc < 0 && errno == EINTR)
+            continue;
+        if(rc == 0)
+        {
+            *eof = true;
+            break;
+        }
+        // whatever sits in the pipe is lost if the client went away
+        if(rc < 0 || drain(p[0], out, rc) < 0)
+        {
+            dbg_printf("relay: splice failed after %ld bytes\n", (long)total);
+            total = -1;
+            break;
+        }
+        total += rc;
+        if(len > 0)
+            len -= rc;
+    }
+
+    close(p[0]);
+    close(p[1]);
+    return total;
+}
@@ -0,0 +1,32 @@
+/* Splice relay header file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+
+/*
+ * Zero-copy forwarding between two sockets. Bytes are moved from the
+ * server socket into a pipe and from the pipe into the client socket
+ * with splice(), so they never pass through a user space buffer:
+ *
+ *   server socket --splice--> pipe --splice--> client socket
+ *
+ * Kept apart from the rest of the proxy because splice() needs
+ * _GNU_SOURCE, which csapp.h does not build with.
+ */
+
+#ifndef __RELAY_H__
+#define __RELAY_H__
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define RELAY_CHUNK (64 * 1024)     /* bytes moved per splice() call */
+
+/*
+ * relay_splice() moves len bytes from the socket in to the socket out,
+ * or everything up to the end of in if len is negative. *eof is set if
+ * in was closed. returns the bytes moved, or -1 on an error
+ */
+ssize_t relay_splice(int in, int out, long long len, bool *eof);
+
+#endif /* __RELAY_H__ */
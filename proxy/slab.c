@@ -0,0 +1,374 @@
+/* Slab allocator file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+#define _DEFAULT_SOURCE /* MAP_HUGETLB, MADV_HUGEPAGE */
+#include "csapp.h"
+#include "slab.h"
+#include "memfd.h"
+
+//#define DEBUG // uncomment this line to enable debugging
+
+#ifdef DEBUG
+/* When debugging is enabled, these form aliases to useful functions */
+#define dbg_printf(...) printf(__VA_ARGS__)
+#else
+/* When debugging is disabled, no code gets generated for these */
+#define dbg_printf(...)
+#endif
+
+/* free blocks are chained through their first word */
+typedef struct freeblock
+{
+    struct freeblock *next;
+}freeblock_t;
+
+/*
+ * Free blocks are on one of three lists: free, those slab_release() has
+ * not looked at yet; pinned, those it found it cannot release; and
+ * released, those whose pages past the first it gave back. A block
+ * freed again starts over on free.
+ */
+typedef struct slabclass
+{
+    size_t size;            // block size of the class
+    freeblock_t *free;      // free list
+    freeblock_t *pinned;    // free, in the memory file or in hugepages
+    freeblock_t *released;  // free, pages given back to the kernel
+    size_t used;            // blocks handed out
+    size_t carved;          // blocks carved from arenas
+    sem_t mutex;
+}slabclass_t;
+
+static slabclass_t classes[SLAB_NCLASSES];
+
+/* the arena slabs are currently carved from */
+static char *arena_cur;
+static size_t arena_left;
+static bool use_hugepages;
+static bool use_memfd;
+static sem_t arena_mutex;
+
+/* bases of the arenas mapped with MAP_HUGETLB, sorted */
+static char **huge_arenas;
+static int nhuge, maxhuge;
+
+static slab_stats_t stats;
+
+/*
+ * slab_init() must be called once before the first allocation.
+ * With hugepages set the arenas are mapped with MAP_HUGETLB, falling
+ * back to transparent hugepages when none are reserved. With memfd set
+ * they come from the memory file while it can grow, hugepages or not.
+ */
+void slab_init(bool hugepages, bool memfd)
+{
+    int i;
+
+    for(i = 0; i < SLAB_NCLASSES; i++)
+    {
+        classes[i].size = (size_t)SLAB_MIN_CLASS << i;
+        classes[i].free = NULL;
+        classes[i].pinned = NULL;
+        classes[i].released = NULL;
+        classes[i].used = 0;
+        classes[i].carved = 0;
+        Sem_init(&classes[i].mutex, 0, 1);
+    }
+    arena_cur = NULL;
+    arena_left = 0;
+    use_hugepages = hugepages;
+    use_memfd = memfd;
+    if(use_memfd && memfd_init() < 0)
+    {
+        fprintf(stderr, "slab: no memory file, using anonymous arenas\n");
+        use_memfd = false;
+    }
+    memset(&stats, 0, sizeof(stats));
+    Sem_init(&arena_mutex, 0, 1);
+}
+
+/*
+ * add_huge() records the hugepage arena at base, called with the arena
+ * mutex held. An arena that cannot be recorded is unmapped again
+ */
+static bool add_huge(char *base)
+{
+    char **grown;
+    int i;
+
+    if(nhuge == maxhuge)
+    {
+        maxhuge = maxhuge ? 2 * maxhuge : 64;
+        if((grown = realloc(huge_arenas, maxhuge * sizeof(char *))) == NULL)
+        {
+            maxhuge = nhuge;
+            munmap(base, SLAB_ARENA_SIZE);
+            return false;
+        }
+        huge_arenas = grown;
+    }
+    for(i = nhuge; i > 0 && huge_arenas[i - 1] > base; i--)
+        huge_arenas[i] = huge_arenas[i - 1];
+    huge_arenas[i] = base;
+    nhuge++;
+    return true;
+}
+
+/*
+ * in_huge() tells whether block lies in a hugepage arena, called with
+ * the arena mutex held. Those arenas are aligned to their size
+ */
+static bool in_huge(void *block)
+{
+    char *base = (char *)((uintptr_t)block &
+                          ~((uintptr_t)SLAB_ARENA_SIZE - 1));
+    int lo = 0, hi = nhuge - 1, mid;
+
+    while(lo <= hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        if(huge_arenas[mid] == base)
+            return true;
+        if(huge_arenas[mid] < base)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return false;
+}
+
+/*
+ * new_arena() maps a fresh arena. Hugepages are tried first when
+ * enabled; otherwise a 2 MiB aligned region is mapped so that the
+ * kernel can back it with a transparent hugepage.
+ */
+static char *new_arena(void)
+{
+    char *base, *aligned;
+    size_t lead;
+
+    if(use_memfd)
+    {
+        if((base = memfd_grow(SLAB_ARENA_SIZE)) != NULL)
+        {
+            stats.arena_bytes += SLAB_ARENA_SIZE;
+            stats.memfd_bytes += SLAB_ARENA_SIZE;
+            return base;
+        }
+        dbg_printf("slab: memory file full, using anonymous arenas\n");
+    }
+
+    if(use_hugepages)
+    {
+        base = mmap(NULL, SLAB_ARENA_SIZE, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(base != MAP_FAILED && add_huge(base))
+        {
+            stats.arena_bytes += SLAB_ARENA_SIZE;
+            stats.hugepage_bytes += SLAB_ARENA_SIZE;
+            return base;
+        }
+        dbg_printf("slab: no hugepages reserved, using THP\n");
+    }
+
+    // over-map by one arena and trim to get 2 MiB alignment
+    base = mmap(NULL, 2 * SLAB_ARENA_SIZE, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(base == MAP_FAILED)
+        return NULL;
+
+    aligned = (char *)(((uintptr_t)base + SLAB_ARENA_SIZE - 1) &
+                        ~((uintptr_t)SLAB_ARENA_SIZE - 1));
+    lead = aligned - base;
+    if(lead > 0)
+        munmap(base, lead);
+    munmap(aligned + SLAB_ARENA_SIZE, SLAB_ARENA_SIZE - lead);
+
+    if(use_hugepages)
+        madvise(aligned, SLAB_ARENA_SIZE, MADV_HUGEPAGE);
+    stats.arena_bytes += SLAB_ARENA_SIZE;
+    return aligned;
+}
+
+/*
+ * refill() carves one slab out of the current arena and threads its
+ * blocks onto the free list of cls. Called with the class mutex held.
+ */
+static bool refill(slabclass_t *cls)
+{
+    char *slab;
+    size_t i, n;
+
+    P(&arena_mutex);
+    if(arena_left < SLAB_SIZE)
+    {
+        if((arena_cur = new_arena()) == NULL)
+        {
+            arena_left = 0;
+            V(&arena_mutex);
+            return false;
+        }
+        arena_left = SLAB_ARENA_SIZE;
+    }
+    slab = arena_cur;
+    arena_cur += SLAB_SIZE;
+    arena_left -= SLAB_SIZE;
+    stats.slab_bytes += SLAB_SIZE;
+    V(&arena_mutex);
+
+    n = SLAB_SIZE / cls->size;
+    for(i = 0; i < n; i++)
+    {
+        freeblock_t *block = (freeblock_t *)(slab + i * cls->size);
+        block->next = cls->free;
+        cls->free = block;
+    }
+    cls->carved += n;
+    return true;
+}
+
+/* returns the class index for size, -1 if it is too large */
+static int class_of(size_t size)
+{
+    int i;
+
+    for(i = 0; i < SLAB_NCLASSES; i++)
+        if(size <= classes[i].size)
+            return i;
+    return -1;
+}
+
+/* slab_alloc() returns a block of at least size bytes or NULL */
+void *slab_alloc(size_t size)
+{
+    slabclass_t *cls;
+    freeblock_t *block;
+    int c;
+
+    if((c = class_of(size)) < 0)
+    {
+        if((block = malloc(size)) != NULL)
+            __sync_fetch_and_add(&stats.large_bytes, size);
+        return block;
+    }
+
+    cls = &classes[c];
+    P(&cls->mutex);
+    // blocks still in memory first, released ones fault in again
+    if((block = cls->free) != NULL)
+        cls->free = block->next;
+    else if((block = cls->pinned) != NULL)
+        cls->pinned = block->next;
+    else if((block = cls->released) != NULL)
+    {
+        cls->released = block->next;
+        __sync_fetch_and_sub(&stats.released_bytes, cls->size - SLAB_PAGE);
+    }
+    else if(refill(cls))
+    {
+        block = cls->free;
+        cls->free = block->next;
+    }
+    else
+    {
+        V(&cls->mutex);
+        return NULL;
+    }
+    cls->used++;
+    V(&cls->mutex);
+
+    __sync_fetch_and_add(&stats.used_bytes, cls->size);
+    __sync_fetch_and_add(&stats.requested_bytes, size);
+    return block;
+}
+
+/* slab_free() returns a block, size must match the slab_alloc() call */
+void slab_free(void *ptr, size_t size)
+{
+    slabclass_t *cls;
+    freeblock_t *block = ptr;
+    int c;
+
+    if(ptr == NULL)
+        return;
+
+    if((c = class_of(size)) < 0)
+    {
+        __sync_fetch_and_sub(&stats.large_bytes, size);
+        free(ptr);
+        return;
+    }
+
+    cls = &classes[c];
+    P(&cls->mutex);
+    block->next = cls->free;
+    cls->free = block;
+    cls->used--;
+    V(&cls->mutex);
+
+    __sync_fetch_and_sub(&stats.used_bytes, cls->size);
+    __sync_fetch_and_sub(&stats.requested_bytes, size);
+}
+
+/*
+ * slab_release() gives the pages of at most max free blocks of the
+ * largest class back to the kernel. Every block it takes off the free
+ * list is either released or pinned, so no block is looked at twice
+ * until it is freed again. returns the bytes released
+ */
+size_t slab_release(int max)
+{
+    slabclass_t *cls = &classes[SLAB_NCLASSES - 1];
+    size_t len = cls->size - SLAB_PAGE, total = 0;
+    freeblock_t *block;
+
+    P(&cls->mutex);
+    P(&arena_mutex);
+    for(; max > 0 && (block = cls->free) != NULL; max--)
+    {
+        cls->free = block->next;
+        // pages of the memory file are not freed by MADV_DONTNEED, and 
+        // hugepages cannot be released in part
+        if(memfd_contains(block) || in_huge(block) ||
+           madvise((char *)block + SLAB_PAGE, len, MADV_DONTNEED) < 0)
+        {
+            block->next = cls->pinned;
+            cls->pinned = block;
+            continue;
+        }
+        block->next = cls->released;
+        cls->released = block;
+        total += len;
+    }
+    V(&arena_mutex);
+    __sync_fetch_and_add(&stats.released_bytes, total);
+    V(&cls->mutex);
+    dbg_printf("slab: released %lu bytes\n", total);
+    return total;
+}
+
+/* slab_get_stats() fills in the current accounting */
+void slab_get_stats(slab_stats_t *out)
+{
+    P(&arena_mutex);
+    *out = stats;
+    V(&arena_mutex);
+}
+
+/*
+ * slab_class_stats() reports one size class: its block size, blocks
+ * in use and blocks carved. returns -1 when cls is out of range
+ */
+int slab_class_stats(int cls, size_t *size, size_t *used, size_t *carved)
+{
+    if(cls < 0 || cls >= SLAB_NCLASSES)
+        return -1;
+
+    P(&classes[cls].mutex);
+    *size = classes[cls].size;
+    *used = classes[cls].used;
+    *carved = classes[cls].carved;
+    V(&classes[cls].mutex);
+    return 0;
+}
@@ -0,0 +1,84 @@
+/* Slab allocator header file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+
+/*
+ * Size class slab allocator for the cache. Cache lines, keys, web
+ * objects and their segments are all carved from large arenas that are
+ * mmap'd once and never given back; freed blocks go on the free list
+ * of their size class and are reused by the next allocation of that
+ * class. This keeps the heap from fragmenting under cache churn and
+ * makes the real memory footprint visible next to the logical
+ * cache_size.
+ *
+ *   arena (2 MiB, optionally a hugepage)
+ *    ____________________________________________
+ *   | slab: class 64  | slab: class 16K | ...    |
+ *   |_________________|_________________|________|
+ *
+ * Requests larger than the largest class fall back to malloc and are
+ * accounted separately.
+ *
+ * With memfd set the arenas are carved from one memory file instead
+ * (memfd.c), so that cache hits can be sent from it with sendfile().
+ *
+ * Under memory pressure slab_release() hands the pages of free blocks
+ * of the largest class, the body segments, back to the kernel. Only
+ * the first page of a block, holding the free list link, stays; the
+ * rest is faulted in again, zeroed, when the block is reused.
+ */
+
+#ifndef __SLAB_H__
+#define __SLAB_H__
+
+#include "csapp.h"
+
+#define SLAB_ARENA_SIZE (2*1024*1024)  /* one arena, a 2 MiB hugepage */
+#define SLAB_SIZE (256*1024)           /* carved from an arena per refill */
+#define SLAB_MIN_CLASS 32              /* smallest class, doubled per class */
+#define SLAB_NCLASSES 10               /* 32 bytes .. 16 KiB */
+#define SLAB_PAGE 4096                 /* page of a block that is kept */
+
+typedef struct slab_stats
+{
+    size_t arena_bytes;      // mapped from the OS for arenas
+    size_t hugepage_bytes;   // part of arena_bytes backed by hugepages
+    size_t memfd_bytes;      // part of arena_bytes in the memory file
+    size_t slab_bytes;       // carved from arenas into size classes
+    size_t used_bytes;       // class sized blocks handed out
+    size_t requested_bytes;  // bytes asked for by callers
+    size_t large_bytes;      // requests too large for a class (malloc)
+    size_t released_bytes;   // of free blocks, given back to the kernel
+}slab_stats_t;
+
+/*
+ * slab_init() must be called once before the first allocation.
+ * With hugepages set the arenas are mapped with MAP_HUGETLB, falling
+ * back to transparent hugepages when none are reserved. With memfd set
+ * they come from the memory file while it can grow, hugepages or not.
+ */
+void slab_init(bool hugepages, bool memfd);
+
+/* slab_alloc() returns a block of at least size bytes or NULL */
+void *slab_alloc(size_t size);
+
+/* slab_free() returns a block, size must match the slab_alloc() call */
+void slab_free(void *ptr, size_t size);
+
+/*
+ * slab_release() gives the pages of at most max free blocks of the
+ * largest class back to the kernel. returns the bytes released
+ */
+size_t slab_release(int max);
+
+/* slab_get_stats() fills in the current accounting */
+void slab_get_stats(slab_stats_t *stats);
+
+/*
+ * slab_class_stats() reports one size class: its block size, blocks
+ * in use and blocks carved. returns -1 when cls is out of range
+ */
+int slab_class_stats(int cls, size_t *size, size_t *used, size_t *carved);
+
+#endif /* __SLAB_H__ */
@@ -0,0 +1,529 @@
+/* Cache snapshot file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+#include "csapp.h"
+#include "cache.h"
+#include "snapshot.h"
+#include "compress.h"
+#include "purge.h"
+
+//#define DEBUG // uncomment this line to enable debugging
+
+#ifdef DEBUG
+/* When debugging is enabled, these form aliases to useful functions */
+#define dbg_printf(...) printf(__VA_ARGS__)
+#else
+/* When debugging is disabled, no code gets generated for these */
+#define dbg_printf(...)
+#endif
+
+#define SNAP_MAGIC 0x736e6170       /* "snap" */
+#define SNAP_VERSION 2
+
+/* states of a mapped entry */
+#define SNAP_UNTOUCHED 0
+#define SNAP_BUSY 1
+#define SNAP_PROMOTED 2
+#define SNAP_INVALID 3
+#define SNAP_PURGED 4
+
+typedef struct snaphdr
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;
+    int64_t created;
+}snaphdr_t;
+
+typedef struct snaprec
+{
+    uint64_t hash;          // hash_key() of the key
+    uint64_t off;           // key offset in .dat, the response follows it
+    uint32_t keylen;
+    uint32_t hdrlen;        // header block length
+    uint64_t len;           // header block + body length
+    uint64_t sum;           // checksum of the header block and body
+    int64_t expires;
+}snaprec_t;
+
+/* the snapshot mapped at startup */
+static snaprec_t *map_recs;
+static char *map_data;
+static size_t map_count, map_datalen;
+static unsigned char *map_state;
+
+static snapshot_stats_t snap_stats;
+static sem_t snap_mutex;            // one writer at a time
+
+static cache_t *snap_cache;
+static char snap_path[MAXLINE];
+static int snap_interval;
+
+/* FNV-1a over a byte range, continuing from sum */
+static uint64_t checksum(uint64_t sum, const char *buf, size_t len)
+{
+    while(len--)
+    {
+        sum ^= (unsigned char)*buf++;
+        sum *= 1099511628211UL;
+    }
+    return sum;
+}
+
+#define CHECKSUM_INIT 14695981039346656037UL
+
+/* maps a whole file read-only, returns NULL if empty or on error */
+static void *map_file(char *path, size_t *len)
+{
+    struct stat st;
+    void *p;
+    int fd;
+
+    if((fd = open(path, O_RDONLY)) < 0)
+        return NULL;
+    if(fstat(fd, &st) < 0 || st.st_size == 0)
+    {
+        close(fd);
+        return NULL;
+    }
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(p == MAP_FAILED)
+        return NULL;
+    *len = st.st_size;
+    return p;
+}
+
+/*
+ * snapshot_load() maps the snapshot at path, if there is one.
+ * returns the number of entries, 0 if there is no usable snapshot
+ */
+size_t snapshot_load(char *path)
+{
+    char name[MAXLINE];
+    snaphdr_t *hdr;
+    size_t idxlen;
+    void *idx;
+
+    Sem_init(&snap_mutex, 0, 1);
+
+    snprintf(name, MAXLINE, "%s.idx", path);
+    if((idx = map_file(name, &idxlen)) == NULL)
+        return 0;
+
+    hdr = idx;
+    if(idxlen < sizeof(snaphdr_t) || hdr->magic != SNAP_MAGIC ||
+       hdr->version != SNAP_VERSION ||
+       idxlen != sizeof(snaphdr_t) + hdr->count * sizeof(snaprec_t))
+    {
+        fprintf(stderr, "snapshot: %s is not a valid index\n", name);
+        munmap(idx, idxlen);
+        return 0;
+    }
+
+    snprintf(name, MAXLINE, "%s.dat", path);
+    if(hdr->count == 0 ||
+       (map_data = map_file(name, &map_datalen)) == NULL ||
+       (map_state = calloc(hdr->count, 1)) == NULL)
+    {
+        munmap(idx, idxlen);
+        return 0;
+    }
+
+    map_recs = (snaprec_t *)(hdr + 1);
+    map_count = hdr->count;
+    snap_stats.loaded = map_count;
+    return map_count;
+}
+
+/* binary search for the first record with hash */
+static size_t first_with_hash(uint64_t hash)
+{
+    size_t lo = 0, hi = map_count, mid;
+
+    while(lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        if(map_recs[mid].hash < hash)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* an entry is valid if it lies inside the data file and its response
+ * still matches the checksum it was written with */
+static bool validate(snaprec_t *rec)
+{
+    if(rec->off + rec->keylen + rec->len > map_datalen ||
+       rec->hdrlen > rec->len)
+        return false;
+    return checksum(CHECKSUM_INIT, map_data + rec->off + rec->keylen,
+                    rec->len) == rec->sum;
+}
+
+/*
+ * snapshot_lookup() finds key in the mapped snapshot. On first touch
+ * the entry is validated and copied into a new web object, which is
+ * returned with one reference, along with a new header block in hdr
+ * and the expiry time. returns NULL on a miss, on an invalid entry and
+ * on every later touch.
+ */
+webobj_t *snapshot_lookup(char *key, webhdr_t **hdr, time_t *expires)
+{
+    uint64_t hash;
+    size_t i, keylen = strlen(key);
+    snaprec_t *rec;
+    webobj_t *obj = NULL;
+    char *resp;
+
+    if(map_count == 0)
+        return NULL;
+
+    hash = hash_key(key);
+    for(i = first_with_hash(hash);
+            i < map_count && map_recs[i].hash == hash; i++)
+    {
+        rec = &map_recs[i];
+        if(rec->keylen != keylen || rec->off + keylen > map_datalen ||
+           memcmp(map_data + rec->off, key, keylen))
+            continue;
+
+        // only the first toucher promotes the entry
+        if(!__sync_bool_compare_and_swap(&map_state[i],
+                                    SNAP_UNTOUCHED, SNAP_BUSY))
+            return NULL;
+
+        if(!validate(rec))
+        {
+            dbg_printf("snapshot: %s failed validation\n", key);
+            map_state[i] = SNAP_INVALID;
+            __sync_fetch_and_add(&snap_stats.invalid, 1);
+            return NULL;
+        }
+
+        resp = map_data + rec->off + keylen;
+        if((*hdr = webhdr_create(resp, rec->hdrlen)) == NULL ||
+           (obj = webobj_create()) == NULL ||
+           !webobj_append(obj, resp + rec->hdrlen, rec->len - rec->hdrlen))
+        {
+            webhdr_put(*hdr);
+            webobj_put(obj);
+            map_state[i] = SNAP_UNTOUCHED;
+            return NULL;
+        }
+        *expires = rec->expires;
+
+        map_state[i] = SNAP_PROMOTED;
+        __sync_fetch_and_add(&snap_stats.hits, 1);
+        return obj;
+    }
+    return NULL;
+}
+
+/*
+ * snapshot_purge() keeps the untouched entries a purge of kind and arg
+ * hits from being promoted or written again. returns the entries purged
+ */
+size_t snapshot_purge(purge_kind_t kind, char *arg)
+{
+    char key[MAXLINE], tags[MAXLINE];
+    snaprec_t *rec;
+    size_t i = 0, n = 0;
+
+    // a key can only be among the records with its hash
+    if(kind == PURGE_KEY)
+        i = first_with_hash(hash_key(arg));
+    for(; i < map_count; i++)
+    {
+        rec = &map_recs[i];
+        if(kind == PURGE_KEY && rec->hash != hash_key(arg))
+            break;
+        if(map_state[i] != SNAP_UNTOUCHED || rec->keylen >= MAXLINE ||
+           rec->off + rec->keylen + rec->hdrlen > map_datalen)
+            continue;
+        memcpy(key, map_data + rec->off, rec->keylen);
+        key[rec->keylen] = '\0';
+        if(!purge_match(kind, arg, key, kind == PURGE_TAG &&
+                        purge_tags(map_data + rec->off + rec->keylen,
+                                   rec->hdrlen, tags, MAXLINE) ?
+                        tags : NULL))
+            continue;
+        if(__sync_bool_compare_and_swap(&map_state[i], SNAP_UNTOUCHED,
+                                        SNAP_PURGED))
+            n++;
+    }
+    return n;
+}
+
+/* one object to be written */
+typedef struct snapitem
+{
+    char *key;
+    webhdr_t *hdr;          // a memory cache line, or
+    webobj_t *obj;
+    time_t expires;
+    size_t mapped;          // index of an untouched mapped entry
+}snapitem_t;
+
+static int cmp_rec(const void *a, const void *b)
+{
+    const snaprec_t *x = a, *y = b;
+
+    return x->hash < y->hash ? -1 : x->hash > y->hash;
+}
+
+/* makes room for one more item, returns false if out of memory */
+static bool grow(snapitem_t **items, size_t *cap, size_t n)
+{
+    snapitem_t *tmp;
+    size_t newcap;
+
+    if(n < *cap)
+        return true;
+    newcap = *cap ? 2 * *cap : 1024;
+    if((tmp = realloc(*items, newcap * sizeof(snapitem_t))) == NULL)
+        return false;
+    *items = tmp;
+    *cap = newcap;
+    return true;
+}
+
+/* collects referenced objects from every shard, then the untouched
+ * mapped entries that are not in memory */
+static snapitem_t *collect(cache_t *cache, size_t *count)
+{
+    snapitem_t *items = NULL;
+    size_t n = 0, cap = 0, i;
+    cacheline_t *line;
+    cacheq_t *shard;
+    char key[MAXLINE];
+    int s;
+
+    for(s = 0; s < cache->nshards; s++)
+    {
+        shard = &cache->shards[s];
+        cache_rlock(shard);
+        for(line = shard->head; line != NULL; line = line->next)
+        {
+            // the snapshot keeps one response per key, like the disk tier
+            if(line->variant != NULL)
+                continue;
+            if(!grow(&items, &cap, n))
+                break;
+            if((items[n].key = strdup(line->key)) == NULL)
+                break;
+            webobj_get(line->web_object);
+            items[n].obj = line->web_object;
+            webhdr_get(line->web_header);
+            items[n].hdr = line->web_header;
+            items[n].expires = line->expires;
+            n++;
+        }
+        cache_runlock(shard);
+    }
+
+    for(i = 0; i < map_count; i++)
+    {
+        if(map_state[i] != SNAP_UNTOUCHED || map_recs[i].keylen >= MAXLINE ||
+           map_recs[i].off + map_recs[i].keylen > map_datalen)
+            continue;
+        memcpy(key, map_data + map_recs[i].off, map_recs[i].keylen);
+        key[map_recs[i].keylen] = '\0';
+
+        shard = cache_shard(cache, key);
+        cache_rlock(shard);
+        line = search_cache(shard, key);
+        cache_runlock(shard);
+        if(line != NULL)
+            continue;
+
+        if(!grow(&items, &cap, n))
+            break;
+        if((items[n].key = strdup(key)) == NULL)
+            break;
+        items[n].obj = NULL;
+        items[n].hdr = NULL;
+        items[n].mapped = i;
+        n++;
+    }
+
+    *count = n;
+    return items;
+}
+
+/*
+ * snapshot_write() writes the memory cache plus the untouched entries
+ * of the mapped snapshot to path. returns -1 on failure
+ */
+int snapshot_write(cache_t *cache, char *path)
+{
+    char dat[MAXLINE], idx[MAXLINE], tmpdat[MAXLINE], tmpidx[MAXLINE];
+    snapitem_t *items;
+    snaprec_t *recs = NULL;
+    snaphdr_t hdr;
+    segment_t *seg;
+    webobj_t *raw;
+    FILE *df = NULL, *xf = NULL;
+    size_t n = 0, i;
+    uint64_t off = 0, sum;
+    int status = -1;
+
+    P(&snap_mutex);
+    snprintf(dat, MAXLINE, "%s.dat", path);
+    snprintf(idx, MAXLINE, "%s.idx", path);
+    snprintf(tmpdat, MAXLINE, "%s.dat.tmp", path);
+    snprintf(tmpidx, MAXLINE, "%s.idx.tmp", path);
+
+    items = collect(cache, &n);
+    if((n > 0 && (recs = calloc(n, sizeof(snaprec_t))) == NULL) ||
+       (df = fopen(tmpdat, "w")) == NULL || (xf = fopen(tmpidx, "w")) == NULL)
+        goto out;
+
+    for(i = 0; i < n; i++)
+    {
+        recs[i].hash = hash_key(items[i].key);
+        recs[i].off = off;
+        recs[i].keylen = strlen(items[i].key);
+        if(fwrite(items[i].key, 1, recs[i].keylen, df) != recs[i].keylen)
+            goto out;
+
+        // entries are read back as they are sent, uncompressed
+        if(items[i].obj != NULL && items[i].obj->encoding != WEBOBJ_IDENTITY)
+        {
+            if((raw = inflate_object(items[i].obj)) == NULL)
+                goto out;
+            webobj_put(items[i].obj);
+            items[i].obj = raw;
+        }
+
+        if(items[i].obj != NULL)
+        {
+            sum = checksum(CHECKSUM_INIT, items[i].hdr->data, 
+                           items[i].hdr->len);
+            if(fwrite(items[i].hdr->data, 1, items[i].hdr->len, df) 
+                                                    != items[i].hdr->len)
+                goto out;
+            for(seg = items[i].obj->head; seg != NULL; seg = seg->next)
+            {
+                sum = checksum(sum, seg->data, seg->len);
+                if(fwrite(seg->data, 1, seg->len, df) != seg->len)
+                    goto out;
+            }
+            recs[i].hdrlen = items[i].hdr->len;
+            recs[i].len = items[i].hdr->len + items[i].obj->size;
+            recs[i].sum = sum;
+            recs[i].expires = items[i].expires;
+        }
+        else
+        {
+            snaprec_t *old = &map_recs[items[i].mapped];
+            if(fwrite(map_data + old->off + old->keylen, 1, old->len, df)
+                                                            != old->len)
+                goto out;
+            recs[i].hdrlen = old->hdrlen;
+            recs[i].len = old->len;
+            recs[i].sum = old->sum;
+            recs[i].expires = old->expires;
+        }
+        off += recs[i].keylen + recs[i].len;
+    }
+
+    qsort(recs, n, sizeof(snaprec_t), cmp_rec);
+    hdr.magic = SNAP_MAGIC;
+    hdr.version = SNAP_VERSION;
+    hdr.count = n;
+    hdr.created = time(NULL);
+    if(fwrite(&hdr, sizeof(hdr), 1, xf) != 1 ||
+       (n > 0 && fwrite(recs, sizeof(snaprec_t), n, xf) != n))
+        goto out;
+
+    // a crash between the renames leaves the old index over the new 
+    // data, which the checksums reject on first touch
+    if(fflush(df) || fsync(fileno(df)) || fflush(xf) || fsync(fileno(xf)))
+        goto out;
+    if(rename(tmpdat, dat) < 0 || rename(tmpidx, idx) < 0)
+        goto out;
+
+    snap_stats.written = n;
+    snap_stats.last_write = hdr.created;
+    status = 0;
+
+out:
+    if(status < 0)
+        fprintf(stderr, "snapshot: writing %s failed: %s\n",
+                        path, strerror(errno));
+    if(df)
+        fclose(df);
+    if(xf)
+        fclose(xf);
+    for(i = 0; i < n; i++)
+    {
+        webobj_put(items[i].obj);
+        webhdr_put(items[i].hdr);
+        free(items[i].key);
+    }
+    free(items);
+    free(recs);
+    V(&snap_mutex);
+    return status;
+}
+
+/* writes a snapshot every snap_interval seconds */
+static void *snapshot_timer(void *vargp)
+{
+    Pthread_detach(pthread_self());
+    while(1)
+    {
+        sleep(snap_interval);
+        snapshot_write(snap_cache, snap_path);
+    }
+    return NULL;
+}
+
+/* waits for SIGTERM/SIGINT, writes a final snapshot and exits */
+static void *snapshot_on_signal(void *vargp)
+{
+    sigset_t *set = vargp;
+    int sig;
+
+    Pthread_detach(pthread_self());
+    sigwait(set, &sig);
+    printf("caught signal %d, writing snapshot\n", sig);
+    snapshot_write(snap_cache, snap_path);
+    exit(0);
+    return NULL;
+}
+
+/*
+ * snapshot_start() starts the thread writing a snapshot every interval
+ * seconds (none if 0) and the thread writing one on SIGTERM/SIGINT
+ * before exiting. Must be called before any other thread is created,
+ * it blocks those signals for the whole process.
+ */
+void snapshot_start(cache_t *cache, char *path, int interval)
+{
+    static sigset_t set;
+    pthread_t tid;
+
+    snap_cache = cache;
+    strncpy(snap_path, path, MAXLINE - 1);
+    snap_interval = interval;
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    Pthread_create(&tid, NULL, snapshot_on_signal, &set);
+
+    if(interval > 0)
+        Pthread_create(&tid, NULL, snapshot_timer, NULL);
+}
+
+/* snapshot_get_stats() fills in the snapshot counters */
+void snapshot_get_stats(snapshot_stats_t *stats)
+{
+    *stats = snap_stats;
+}
@@ -0,0 +1,85 @@
+/* Cache snapshot header file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+
+/*
+ * Snapshots of the memory cache for warm restarts. A snapshot is a
+ * pair of files next to each other:
+ *
+ *   <path>.dat   key, header block and body of every response
+ *   <path>.idx   header + fixed size records sorted by key hash
+ *
+ *    .idx  _____________________________________________________
+ *         | hdr | rec(hash, off, keylen, hdrlen, len, sum, exp) | ...|
+ *         |_____|______________|_________________________________|
+ *                       |
+ *    .dat  _____________v_______________________________
+ *         | key | headers | body | key | headers | ...   |
+ *         |_____|_________|______|_____|_________|_______|
+ *
+ * Both are written to temporary names and renamed into place, either
+ * every snapshot_interval seconds or when the proxy gets SIGTERM or
+ * SIGINT. At startup both are mmap'd and nothing is read up front; a
+ * memory miss binary searches the index, and on first touch the
+ * checksum is verified and the response is copied into the memory
+ * cache, keeping the expiry time it was snapshotted with.
+ * Entries nobody touched are carried over into the next snapshot.
+ */
+
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include "csapp.h"
+#include "cache.h"
+#include "webobj.h"
+#include "purge.h"
+
+typedef struct snapshot_stats
+{
+    size_t loaded;           // entries in the mapped snapshot
+    size_t hits;             // entries promoted on first touch
+    size_t invalid;          // entries failing validation
+    size_t written;          // entries in the last snapshot written
+    time_t last_write;       // time of the last snapshot written
+}snapshot_stats_t;
+
+/*
+ * snapshot_load() maps the snapshot at path, if there is one.
+ * returns the number of entries, 0 if there is no usable snapshot
+ */
+size_t snapshot_load(char *path);
+
+/*
+ * snapshot_lookup() finds key in the mapped snapshot. On first touch
+ * the entry is validated and copied into a new web object, which is
+ * returned with one reference, along with a new header block in hdr
+ * and the expiry time. returns NULL on a miss, on an invalid entry and
+ * on every later touch.
+ */
+webobj_t *snapshot_lookup(char *key, webhdr_t **hdr, time_t *expires);
+
+/*
+ * snapshot_purge() keeps the untouched entries a purge of kind and arg
+ * hits from being promoted or written again. returns the entries purged
+ */
+size_t snapshot_purge(purge_kind_t kind, char *arg);
+
+/*
+ * snapshot_write() writes the memory cache plus the untouched entries
+ * of the mapped snapshot to path. returns -1 on failure
+ */
+int snapshot_write(cache_t *cache, char *path);
+
+/*
+ * snapshot_start() starts the thread writing a snapshot every interval
+ * seconds (none if 0) and the thread writing one on SIGTERM/SIGINT
+ * before exiting. Must be called before any other thread is created,
+ * it blocks those signals for the whole process.
+ */
+void snapshot_start(cache_t *cache, char *path, int interval);
+
+/* snapshot_get_stats() fills in the snapshot counters */
+void snapshot_get_stats(snapshot_stats_t *stats);
+
+#endif /* __SNAPSHOT_H__ */
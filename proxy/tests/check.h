@@ -0,0 +1,56 @@
+/* Unit check header file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+
+/*
+ * What the unit checks in this directory share. Each check program
+ * links the modules of the proxy it exercises and runs its checks in
+ * order; a failed check prints where it is and what it expected, and
+ * the program goes on, so one run reports every failure:
+ *
+ *   CHECK(meta.max_age == 100);
+ *   CHECK_STR(key, "http://a.com/");
+ *   return check_done("http");
+ *
+ * check_done() prints the tally and returns the exit status, non-zero
+ * if anything failed. "make test" builds and runs them all.
+ */
+
+#ifndef __CHECK_H__
+#define __CHECK_H__
+
+#include <stdio.h>
+#include <string.h>
+
+#define CHECK(cond) check((cond), #cond, __FILE__, __LINE__)
+#define CHECK_STR(got, want) check_str((got), (want), __FILE__, __LINE__)
+
+static int checks_run, checks_failed;
+
+static inline void check(int ok, char *what, char *file, int line)
+{
+    checks_run++;
+    if(ok)
+        return;
+    checks_failed++;
+    fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+}
+
+static inline void check_str(char *got, char *want, char *file, int line)
+{
+    checks_run++;
+    if(!strcmp(got, want))
+        return;
+    checks_failed++;
+    fprintf(stderr, "%s:%d: got \"%s\", want \"%s\"\n", file, line,
+            got, want);
+}
+
+static inline int check_done(char *name)
+{
+    printf("%s: %d checks, %d failed\n", name, checks_run, checks_failed);
+    return checks_failed > 0;
+}
+
+#endif /* __CHECK_H__ */
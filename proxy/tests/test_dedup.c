@@ -0,0 +1,144 @@
+/* Body deduplication check file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+#include "csapp.h"
+#include "config.h"
+#include "cache.h"
+#include "slab.h"
+#include "dedup.h"
+#include "check.h"
+
+#define BODY_SIZE 1000
+
+static dedup_stats_t stats;
+
+/* a digested object of size bytes, all fill */
+static webobj_t *body(int fill, size_t size)
+{
+    char buf[BODY_SIZE];
+    webobj_t *obj = webobj_create();
+
+    memset(buf, fill, size);
+    webobj_append(obj, buf, size);
+    dedup_digest(obj);
+    return obj;
+}
+
+static void check_store(void)
+{
+    webobj_t *a = body('a', BODY_SIZE), *b = body('a', BODY_SIZE);
+    webobj_t *c = body('c', BODY_SIZE), *found;
+
+    CHECK(a->digested);
+    CHECK(!memcmp(a->digest, b->digest, sizeof(a->digest)));
+    CHECK(memcmp(a->digest, c->digest, sizeof(a->digest)));
+
+    // nothing is stored, and a line's own object is not found
+    CHECK(dedup_find(b, false) == NULL);
+    dedup_add(a);
+    CHECK(dedup_find(a, false) == NULL);
+    dedup_get_stats(&stats);
+    CHECK(stats.entries == 1);
+    CHECK(stats.bytes == BODY_SIZE);
+    CHECK(stats.shared_bytes == 0);
+
+    // the same bytes are found, with a reference for the caller
+    CHECK((found = dedup_find(b, false)) == a);
+    CHECK(a->refcnt == 2);
+    webobj_put(found);
+    CHECK(a->refcnt == 1);
+
+    // the store holds none of its own, it counts lines
+    dedup_add(a);
+    dedup_get_stats(&stats);
+    CHECK(stats.entries == 1);
+    CHECK(stats.shared_bytes == BODY_SIZE);
+    CHECK(a->refcnt == 1);
+
+    // an object with the digest but other bytes is not shared
+    memcpy(c->digest, a->digest, sizeof(c->digest));
+    CHECK(dedup_find(c, false) == NULL);
+    CHECK(a->refcnt == 1);
+    dedup_add(c);
+    dedup_remove(c);
+    dedup_get_stats(&stats);
+    CHECK(stats.mismatches == 1);
+    CHECK(stats.entries == 1);
+    CHECK(stats.shared_bytes == BODY_SIZE);
+
+    dedup_remove(a);
+    dedup_get_stats(&stats);
+    CHECK(stats.entries == 1);
+    CHECK(stats.shared_bytes == 0);
+    dedup_remove(a);
+    dedup_get_stats(&stats);
+    CHECK(stats.entries == 0);
+    CHECK(stats.bytes == 0);
+    CHECK(dedup_find(b, false) == NULL);
+
+    // bodies that are not digested are left alone
+    found = webobj_create();
+    dedup_add(found);
+    dedup_get_stats(&stats);
+    CHECK(stats.entries == 0);
+    webobj_put(found);
+
+    webobj_put(a);
+    webobj_put(b);
+    webobj_put(c);
+}
+
+/* lines in the cache take and give back their references */
+static void check_lines(void)
+{
+    char *hdr = "HTTP/1.1 200 OK\r\n\r\n";
+    cache_t *cache = create_cache(64 * 1024 * 1024, 1024 * 1024, 1);
+    cacheq_t *shard = cache->shards;
+    webhdr_t *whdr = webhdr_create(hdr, strlen(hdr));
+    webobj_t *a = body('x', BODY_SIZE), *b = body('x', BODY_SIZE), *found;
+
+    cache_wlock(shard);
+    CHECK(add_to_cache(shard, "http://a.com/1", NULL, whdr, a, 0));
+    cache_wunlock(shard);
+    CHECK(a->refcnt == 2);
+
+    // a second URI with the same body gets the stored object
+    CHECK((found = dedup_find(b, false)) == a);
+    webobj_put(b);
+    cache_wlock(shard);
+    CHECK(add_to_cache(shard, "http://a.com/2", NULL, whdr, found, 0));
+    cache_wunlock(shard);
+    webobj_put(found);
+    CHECK(a->refcnt == 3);
+    dedup_get_stats(&stats);
+    CHECK(stats.entries == 1);
+    CHECK(stats.shared_bytes == BODY_SIZE);
+
+    cache_wlock(shard);
+    CHECK(remove_from_cache(shard, search_cache(shard, "http://a.com/1")));
+    cache_wunlock(shard);
+    dedup_get_stats(&stats);
+    CHECK(stats.entries == 1);
+    CHECK(stats.shared_bytes == 0);
+    CHECK(a->refcnt == 2);
+
+    cache_wlock(shard);
+    CHECK(remove_from_cache(shard, search_cache(shard, "http://a.com/2")));
+    cache_wunlock(shard);
+    dedup_get_stats(&stats);
+    CHECK(stats.entries == 0);
+    CHECK(a->refcnt == 1);
+
+    webobj_put(a);
+    webhdr_put(whdr);
+}
+
+int main(void)
+{
+    config_defaults(&config);
+    slab_init(false, false);
+    check_store();
+    check_lines();
+    return check_done("dedup");
+}
@@ -0,0 +1,180 @@
+/* HTTP freshness check file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+#include "csapp.h"
+#include "http.h"
+#include "check.h"
+
+#define DATE 784111777L             /* Sun, 06 Nov 1994 08:49:37 GMT */
+
+static httpmeta_t meta;
+
+/* parses the header block hdr into meta */
+static void parse(char *hdr)
+{
+    http_parse_response(hdr, strlen(hdr), &meta);
+}
+
+/* the expiry of hdr, received at DATE and asked for at request_time */
+static time_t expires(char *hdr, time_t request_time, long default_ttl)
+{
+    parse(hdr);
+    return http_expires(&meta, request_time, DATE, default_ttl);
+}
+
+static void check_parse(void)
+{
+    parse("HTTP/1.1 200 OK\r\n"
+          "Cache-Control: public, max-age=100, s-maxage=50, "
+          "stale-while-revalidate=30\r\n"
+          "Age: 7\r\n"
+          "ETag: \"v1\"\r\n"
+          "Content-Length: 1234\r\n"
+          "\r\n");
+    CHECK(meta.status == 200);
+    CHECK(meta.cc & CC_PUBLIC);
+    CHECK(meta.max_age == 100);
+    CHECK(meta.s_maxage == 50);
+    CHECK(meta.swr == 30);
+    CHECK(meta.age == 7);
+    CHECK(meta.has_etag);
+    CHECK(meta.content_length == 1234);
+    CHECK(meta.date == -1);
+    CHECK(meta.expires == -1);
+    CHECK(meta.last_modified == -1);
+
+    parse("HTTP/1.1 404 Not Found\r\n"
+          "cache-control: no-cache, must-revalidate\r\n"
+          "Transfer-Encoding: chunked\r\n"
+          "Vary: *\r\n"
+          "\r\n");
+    CHECK(meta.status == 404);
+    CHECK(meta.cc & CC_NO_CACHE);
+    CHECK(meta.cc & CC_MUST_REVALIDATE);
+    CHECK(meta.chunked);
+    CHECK(meta.has_vary_star);
+    CHECK(meta.max_age == -1);
+    CHECK(meta.content_length == -1);
+}
+
+static void check_dates(void)
+{
+    CHECK(http_parse_date("Sun, 06 Nov 1994 08:49:37 GMT") == DATE);
+    CHECK(http_parse_date("Sunday, 06-Nov-94 08:49:37 GMT") == DATE);
+    CHECK(http_parse_date("Sun Nov  6 08:49:37 1994") == DATE);
+    CHECK(http_parse_date("yesterday") == 0);
+
+    // an invalid Expires means already expired
+    parse("HTTP/1.1 200 OK\r\nExpires: 0\r\n\r\n");
+    CHECK(meta.expires == 0);
+}
+
+static void check_expires(void)
+{
+    // explicit freshness, s-maxage first
+    CHECK(expires("HTTP/1.1 200 OK\r\nCache-Control: max-age=100\r\n\r\n",
+                  DATE, 0) == DATE + 100);
+    CHECK(expires("HTTP/1.1 200 OK\r\n"
+                  "Cache-Control: max-age=100, s-maxage=50\r\n\r\n",
+                  DATE, 0) == DATE + 50);
+    CHECK(expires("HTTP/1.1 200 OK\r\n"
+                  "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+                  "Expires: Sun, 06 Nov 1994 08:59:37 GMT\r\n\r\n",
+                  DATE, 0) == DATE + 600);
+    CHECK(expires("HTTP/1.1 200 OK\r\n"
+                  "Cache-Control: max-age=100\r\n"
+                  "Expires: Sun, 06 Nov 1994 08:59:37 GMT\r\n\r\n",
+                  DATE, 0) == DATE + 100);
+
+    // the age it arrived with is used up: Age plus the round trip
+    CHECK(expires("HTTP/1.1 200 OK\r\nCache-Control: max-age=100\r\n"
+                  "Age: 30\r\n\r\n", DATE, 0) == DATE + 70);
+    CHECK(expires("HTTP/1.1 200 OK\r\nCache-Control: max-age=100\r\n"
+                  "Age: 30\r\n\r\n", DATE - 10, 0) == DATE + 60);
+    CHECK(expires("HTTP/1.1 200 OK\r\nCache-Control: max-age=100\r\n"
+                  "Age: 200\r\n\r\n", DATE, 0) == 0);
+
+    // and so is a Date in the past
+    CHECK(expires("HTTP/1.1 200 OK\r\nCache-Control: max-age=100\r\n"
+                  "Date: Sun, 06 Nov 1994 08:48:37 GMT\r\n\r\n",
+                  DATE, 0) == DATE + 40);
+
+    // heuristic: a tenth of the time since Last-Modified, at most a day
+    CHECK(expires("HTTP/1.1 200 OK\r\n"
+                  "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+                  "Last-Modified: Sun, 06 Nov 1994 06:02:57 GMT\r\n\r\n",
+                  DATE, 0) == DATE + 1000);
+    CHECK(expires("HTTP/1.1 200 OK\r\n"
+                  "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+                  "Last-Modified: Tue, 07 Nov 1989 08:49:37 GMT\r\n\r\n",
+                  DATE, 0) == DATE + HEURISTIC_MAX);
+
+    // but not for errors, they get the default
+    CHECK(expires("HTTP/1.1 404 Not Found\r\n"
+                  "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+                  "Last-Modified: Sun, 06 Nov 1994 06:02:57 GMT\r\n\r\n",
+                  DATE, 10) == DATE + 10);
+    CHECK(expires("HTTP/1.1 200 OK\r\n\r\n", DATE, 60) == DATE + 60);
+    CHECK(expires("HTTP/1.1 200 OK\r\n\r\n", DATE, 0) == 0);
+
+    // stored but checked before every use
+    CHECK(expires("HTTP/1.1 200 OK\r\nCache-Control: no-cache, "
+                  "max-age=100\r\n\r\n", DATE, 0) == 0);
+    CHECK(expires("HTTP/1.1 200 OK\r\nCache-Control: max-age=0\r\n\r\n",
+                  DATE, 0) == 0);
+}
+
+static void check_cacheable(void)
+{
+    parse("HTTP/1.1 200 OK\r\n\r\n");
+    CHECK(http_cacheable(&meta, false));
+    CHECK(!http_cacheable(&meta, true));
+
+    parse("HTTP/1.1 200 OK\r\nCache-Control: public\r\n\r\n");
+    CHECK(http_cacheable(&meta, true));
+    parse("HTTP/1.1 200 OK\r\nCache-Control: s-maxage=5\r\n\r\n");
+    CHECK(http_cacheable(&meta, true));
+
+    parse("HTTP/1.1 200 OK\r\nCache-Control: no-store\r\n\r\n");
+    CHECK(!http_cacheable(&meta, false));
+    parse("HTTP/1.1 200 OK\r\nCache-Control: private\r\n\r\n");
+    CHECK(!http_cacheable(&meta, false));
+    parse("HTTP/1.1 200 OK\r\nVary: *\r\n\r\n");
+    CHECK(!http_cacheable(&meta, false));
+
+    // negative entries are, other errors and redirects are not
+    parse("HTTP/1.1 404 Not Found\r\n\r\n");
+    CHECK(http_cacheable(&meta, false));
+    parse("HTTP/1.1 503 Service Unavailable\r\n\r\n");
+    CHECK(http_cacheable(&meta, false));
+    parse("HTTP/1.1 302 Found\r\n\r\n");
+    CHECK(!http_cacheable(&meta, false));
+    parse("HTTP/1.1 403 Forbidden\r\n\r\n");
+    CHECK(!http_cacheable(&meta, false));
+}
+
+static void check_stale_grace(void)
+{
+    parse("HTTP/1.1 200 OK\r\nCache-Control: max-age=1\r\n\r\n");
+    CHECK(http_stale_grace(&meta, 10) == 10);
+    parse("HTTP/1.1 200 OK\r\n"
+          "Cache-Control: max-age=1, stale-while-revalidate=30\r\n\r\n");
+    CHECK(http_stale_grace(&meta, 10) == 30);
+    parse("HTTP/1.1 200 OK\r\n"
+          "Cache-Control: max-age=1, must-revalidate\r\n\r\n");
+    CHECK(http_stale_grace(&meta, 10) == 0);
+    parse("HTTP/1.1 404 Not Found\r\n"
+          "Cache-Control: stale-while-revalidate=30\r\n\r\n");
+    CHECK(http_stale_grace(&meta, 10) == 0);
+}
+
+int main(void)
+{
+    check_parse();
+    check_dates();
+    check_expires();
+    check_cacheable();
+    check_stale_grace();
+    return check_done("http");
+}
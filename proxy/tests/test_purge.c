@@ -0,0 +1,164 @@
+/* Cache purge check file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+#include "csapp.h"
+#include "config.h"
+#include "cache.h"
+#include "slab.h"
+#include "purge.h"
+#include "check.h"
+
+static cache_t *cache;
+static purge_stats_t stats;
+
+/* caches an empty response under key, with the tags if not NULL */
+static void add(char *key, char *variant, char *tags, time_t expires)
+{
+    char hdr[MAXLINE];
+    cacheq_t *shard = cache_shard(cache, key);
+    webhdr_t *whdr;
+    webobj_t *obj = webobj_create();
+
+    if(tags != NULL)
+        sprintf(hdr, "HTTP/1.1 200 OK\r\nSurrogate-Key: %s\r\n\r\n", tags);
+    else
+        sprintf(hdr, "HTTP/1.1 200 OK\r\n\r\n");
+    whdr = webhdr_create(hdr, strlen(hdr));
+    cache_wlock(shard);
+    CHECK(add_to_cache(shard, key, variant, whdr, obj, expires));
+    cache_wunlock(shard);
+    webhdr_put(whdr);
+    webobj_put(obj);
+}
+
+/* the lines cached under key */
+static int lines(char *key)
+{
+    cacheq_t *shard = cache_shard(cache, key);
+    cacheline_t *line;
+    int n = 0;
+
+    cache_rlock(shard);
+    for(line = search_cache(shard, key); line != NULL;
+        line = search_next(line))
+        n++;
+    cache_runlock(shard);
+    return n;
+}
+
+static void check_index(void)
+{
+    time_t later = time(NULL) + 100;
+
+    add("http://a.com/img/1.png", NULL, "img a-site", later);
+    add("http://a.com/img/2.png", NULL, "img", later);
+    add("http://a.com/index.html", NULL, "a-site", later);
+    add("http://b.com/x", NULL, NULL, later);
+
+    // "http://" -+- "a.com/i" -+- "mg/" -+- "1.png"
+    //            |             |         +- "2.png"
+    //            |             +- "ndex.html"
+    //            +- "b.com/x"
+    purge_get_stats(&stats);
+    CHECK(stats.keys == 4);
+    CHECK(stats.nodes == 7);
+    CHECK(stats.tags == 2);
+    CHECK(stats.tag_refs == 4);
+
+    // the subtree goes and "a.com/i" merges with its last child
+    CHECK(purge_run(cache, PURGE_PREFIX, "http://a.com/img/", false) == 2);
+    CHECK(lines("http://a.com/img/1.png") == 0);
+    CHECK(lines("http://a.com/img/2.png") == 0);
+    purge_get_stats(&stats);
+    CHECK(stats.keys == 2);
+    CHECK(stats.nodes == 3);
+    CHECK(stats.tags == 1);
+    CHECK(stats.tag_refs == 1);
+    CHECK(stats.purged == 2);
+
+    // a prefix inside an edge, and one nothing starts with
+    CHECK(purge_run(cache, PURGE_PREFIX, "http://a.com/ind", true) == 1);
+    CHECK(purge_run(cache, PURGE_PREFIX, "http://c.com/", false) == 0);
+
+    CHECK(purge_run(cache, PURGE_TAG, "img", false) == 0);
+    CHECK(purge_run(cache, PURGE_TAG, "a-site", false) == 1);
+    CHECK(lines("http://a.com/index.html") == 0);
+    CHECK(lines("http://b.com/x") == 1);
+
+    CHECK(purge_run(cache, PURGE_KEY, "http://b.com/x", false) == 1);
+    purge_get_stats(&stats);
+    CHECK(stats.keys == 0);
+    CHECK(stats.nodes == 0);
+    CHECK(stats.tags == 0);
+    CHECK(stats.tag_refs == 0);
+}
+
+/* a soft purge keeps the line, stale */
+static void check_soft(void)
+{
+    cacheq_t *shard;
+    cacheline_t *line;
+    char *key = "http://a.com/soft";
+
+    add(key, NULL, "s", time(NULL) + 100);
+    CHECK(purge_run(cache, PURGE_TAG, "s", true) == 1);
+    shard = cache_shard(cache, key);
+    cache_rlock(shard);
+    line = search_cache(shard, key);
+    CHECK(line != NULL && line->expires <= time(NULL));
+    cache_runlock(shard);
+    purge_get_stats(&stats);
+    CHECK(stats.soft_purged == 2);
+
+    CHECK(purge_run(cache, PURGE_KEY, key, false) == 1);
+    CHECK(lines(key) == 0);
+}
+
+/* variants of a key are tagged apart, and counted once in the tree */
+static void check_variants(void)
+{
+    char *key = "http://a.com/v";
+
+    add(key, "gzip", "zipped", time(NULL) + 100);
+    add(key, "identity", "plain", time(NULL) + 100);
+    purge_get_stats(&stats);
+    CHECK(stats.keys == 1);
+    CHECK(stats.nodes == 1);
+    CHECK(stats.tags == 2);
+
+    CHECK(purge_run(cache, PURGE_TAG, "zipped", false) == 1);
+    CHECK(lines(key) == 1);
+    CHECK(purge_run(cache, PURGE_KEY, key, false) == 1);
+    purge_get_stats(&stats);
+    CHECK(stats.keys == 0);
+    CHECK(stats.nodes == 0);
+    CHECK(stats.tags == 0);
+}
+
+static void check_match(void)
+{
+    CHECK(purge_match(PURGE_KEY, "http://a.com/", "http://a.com/", NULL));
+    CHECK(!purge_match(PURGE_KEY, "http://a.com/", "http://a.com/x", NULL));
+    CHECK(purge_match(PURGE_PREFIX, "http://a.com/", "http://a.com/x",
+                      NULL));
+    CHECK(!purge_match(PURGE_PREFIX, "http://a.com/x", "http://a.com/",
+                       NULL));
+    CHECK(purge_match(PURGE_TAG, "b", "k", "a, b,c"));
+    CHECK(purge_match(PURGE_TAG, "c", "k", "a, b,c"));
+    CHECK(!purge_match(PURGE_TAG, "a-", "k", "a-site"));
+    CHECK(!purge_match(PURGE_TAG, "site", "k", "a-site"));
+    CHECK(!purge_match(PURGE_TAG, "a", "k", NULL));
+}
+
+int main(void)
+{
+    config_defaults(&config);
+    slab_init(false, false);
+    cache = create_cache(64 * 1024 * 1024, 1024 * 1024, 4);
+    check_index();
+    check_soft();
+    check_variants();
+    check_match();
+    return check_done("purge");
+}
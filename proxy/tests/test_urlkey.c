@@ -0,0 +1,79 @@
+/* Cache key check file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+#include "csapp.h"
+#include "config.h"
+#include "urlkey.h"
+#include "check.h"
+
+static char key[MAXLINE], other[MAXLINE];
+
+/* the cache key of uri */
+static char *make(char *uri)
+{
+    urlkey_make(uri, key, sizeof(key));
+    return key;
+}
+
+static void check_normalize(void)
+{
+    config.cache_key_normalize = true;
+    strcpy(config.cache_key_strip, "utm_* fbclid gclid");
+
+    CHECK_STR(make("http://WWW.Example.com:80/a/%7Ebob"
+                   "?utm_source=x&c=2&b=1#top"),
+              "http://www.example.com/a/~bob?b=1&c=2");
+
+    // scheme, host and default ports
+    CHECK_STR(make("HTTP://A.com"), "http://a.com/");
+    CHECK_STR(make("http://a.com:8080/"), "http://a.com:8080/");
+    CHECK_STR(make("https://a.com:443/x"), "https://a.com/x");
+    CHECK_STR(make("http://a.com:443/x"), "http://a.com:443/x");
+    CHECK_STR(make("http://User@A.com/"), "http://User@a.com/");
+    CHECK_STR(make("http://[::1]:80/"), "http://[::1]/");
+
+    // escapes: unreserved decoded, the rest uppercased, paths keep case
+    CHECK_STR(make("http://a.com/%41%2d%5f%2e/B"), "http://a.com/A-_./B");
+    CHECK_STR(make("http://a.com/a%2fb%3a"), "http://a.com/a%2Fb%3A");
+    CHECK_STR(make("http://a.com/?q=%e2%82%ac"), "http://a.com/?q=%E2%82%AC");
+
+    // parameters sorted, stripped by name or by prefix
+    CHECK_STR(make("http://a.com/?z=1&a=2&m"), "http://a.com/?a=2&m&z=1");
+    CHECK_STR(make("http://a.com/?utm_medium=m&fbclid=1&gclidx=2"),
+              "http://a.com/?gclidx=2");
+    CHECK_STR(make("http://a.com/p?utm_=1"), "http://a.com/p");
+    CHECK_STR(make("http://a.com/p?fbclid"), "http://a.com/p");
+
+    // the fragment only
+    CHECK_STR(make("http://a.com/p#frag"), "http://a.com/p");
+
+    // not normalized: its own key
+    CHECK_STR(make("/relative?b=1&a=2"), "/relative?b=1&a=2");
+    CHECK_STR(make("http:///nohost"), "http:///nohost");
+    CHECK_STR(make("ht-tp://a.com/"), "ht-tp://a.com/");
+
+    // spellings of one resource share a key
+    strcpy(other, make("http://a.com:80/?b=2&a=1"));
+    CHECK_STR(make("http://A.COM/?a=1&b=2"), other);
+}
+
+static void check_off(void)
+{
+    config.cache_key_normalize = false;
+    CHECK_STR(make("http://WWW.Example.com:80/a/%7Ebob?utm_source=x#top"),
+              "http://WWW.Example.com:80/a/%7Ebob?utm_source=x#top");
+
+    // keys never overflow
+    config.cache_key_normalize = true;
+    urlkey_make("http://a.com/0123456789", key, 10);
+    CHECK_STR(key, "http://a.");
+}
+
+int main(void)
+{
+    config_defaults(&config);
+    check_normalize();
+    check_off();
+    return check_done("urlkey");
+}
@@ -0,0 +1,145 @@
+/* Timer wheel check file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+#include "csapp.h"
+#include "wheel.h"
+#include "check.h"
+
+#define START 1000000L
+#define RANDOM_TIMERS 2000
+
+static wheel_t wheel;
+
+/* turns the wheel to second now, returning how many timers fired */
+static int expire(long now)
+{
+    void *fired[SWEEP_BATCH_MAX];
+
+    return wheel_expire(&wheel, now, fired, SWEEP_BATCH_MAX);
+}
+
+/*
+ * files a timer in each level, and past the top, and checks that each
+ * fires in its second and not before
+ */
+static void check_levels(void)
+{
+    long delays[] = {0, 5, 63, 64, 70, 4095, 5000, 262143, 300000,
+                     20000000};
+    int n = sizeof(delays) / sizeof(delays[0]), i;
+    wheel_timer_t timers[n];
+    void *fired[1];
+
+    wheel_init(&wheel, START);
+    for(i = 0; i < n; i++)
+    {
+        wheel_timer_init(&timers[i], &timers[i]);
+        wheel_add(&wheel, &timers[i], START + delays[i]);
+    }
+    CHECK(wheel.count == (size_t)n);
+
+    for(i = 0; i < n; i++)
+    {
+        if(delays[i] > 0)
+            CHECK(wheel_expire(&wheel, START + delays[i] - 1, fired, 1) == 0);
+        CHECK(wheel_expire(&wheel, START + delays[i], fired, 1) == 1);
+        CHECK(fired[0] == &timers[i]);
+        CHECK(timers[i].next == NULL);
+    }
+    CHECK(wheel.count == 0);
+}
+
+static void check_moves(void)
+{
+    wheel_timer_t a, b, c;
+    void *fired[4];
+
+    wheel_init(&wheel, START);
+    wheel_timer_init(&a, &a);
+    wheel_timer_init(&b, &b);
+    wheel_timer_init(&c, &c);
+
+    // removed timers never fire, removing twice is harmless
+    wheel_add(&wheel, &a, START + 10);
+    wheel_remove(&wheel, &a);
+    wheel_remove(&wheel, &a);
+    CHECK(wheel.count == 0);
+    CHECK(expire(START + 100) == 0);
+
+    // adding again moves a timer, it is counted once
+    wheel_add(&wheel, &b, START + 200);
+    wheel_add(&wheel, &b, START + 5000);
+    CHECK(wheel.count == 1);
+    CHECK(expire(START + 4999) == 0);
+    CHECK(expire(START + 5000) == 1);
+
+    // a second that has passed fires in the next the wheel turns
+    wheel_add(&wheel, &c, START);
+    CHECK(wheel.count == 1);
+    CHECK(wheel_expire(&wheel, START + 5000, fired, 4) == 0);
+    CHECK(wheel_expire(&wheel, START + 5001, fired, 4) == 1);
+    CHECK(fired[0] == &c);
+}
+
+/* timers take turns in batches of max, none are lost between them */
+static void check_batches(void)
+{
+    wheel_timer_t timers[10];
+    void *fired[4];
+    int i;
+
+    wheel_init(&wheel, START);
+    for(i = 0; i < 10; i++)
+    {
+        wheel_timer_init(&timers[i], &timers[i]);
+        wheel_add(&wheel, &timers[i], START + 3 + i % 2);
+    }
+    CHECK(wheel_expire(&wheel, START + 10, fired, 4) == 4);
+    CHECK(wheel_expire(&wheel, START + 10, fired, 4) == 4);
+    CHECK(wheel_expire(&wheel, START + 10, fired, 4) == 2);
+    CHECK(wheel_expire(&wheel, START + 10, fired, 4) == 0);
+    CHECK(wheel.count == 0);
+}
+
+/* timers spread over every level fire exactly in their second */
+static void check_random(void)
+{
+    static wheel_timer_t timers[RANDOM_TIMERS];
+    void *fired[SWEEP_BATCH_MAX];
+    long now, last = START;
+    int i, n, count = 0, late = 0;
+
+    srand(42);
+    wheel_init(&wheel, START);
+    for(i = 0; i < RANDOM_TIMERS; i++)
+    {
+        wheel_timer_init(&timers[i], &timers[i]);
+        wheel_add(&wheel, &timers[i], START + (rand() % 2 ?
+                                               rand() % 300000 :
+                                               rand() % 5000));
+        if(timers[i].when > last)
+            last = timers[i].when;
+    }
+    for(now = START; now <= last; now++)
+    {
+        while((n = wheel_expire(&wheel, now, fired, SWEEP_BATCH_MAX)) > 0)
+        {
+            for(i = 0; i < n; i++)
+                late += ((wheel_timer_t *)fired[i])->when != now;
+            count += n;
+        }
+    }
+    CHECK(count == RANDOM_TIMERS);
+    CHECK(late == 0);
+    CHECK(wheel.count == 0);
+}
+
+int main(void)
+{
+    check_levels();
+    check_moves();
+    check_batches();
+    check_random();
+    return check_done("wheel");
+}
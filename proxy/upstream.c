@@ -0,0 +1,420 @@
+/* Upstream connection pool file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+#include "csapp.h"
+#include "cache.h"
+#include "config.h"
+#include "dns.h"
+#include "upstream.h"
+#include <poll.h>
+
+//#define DEBUG // uncomment this line to enable debugging
+
+#ifdef DEBUG
+/* When debugging is enabled, these form aliases to useful functions */
+#define dbg_printf(...) printf(__VA_ARGS__)
+#else
+/* When debugging is disabled, no code gets generated for these */
+#define dbg_printf(...)
+#endif
+
+/* the idle connections to one origin */
+typedef struct origin
+{
+    char name[MAXLINE];     // "host:port"
+    upconn_t *idle;         // most recently released first
+    int nidle;
+    struct origin *next;
+}origin_t;
+
+static origin_t *buckets[UPSTREAM_BUCKETS];
+static wheel_t idle_wheel;      // pooled connections by when they expire
+static sem_t pool_mutex;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static upstream_stats_t up_stats;
+
+static void pool_init(void)
+{
+    Sem_init(&pool_mutex, 0, 1);
+    wheel_init(&idle_wheel, time(NULL));
+}
+
+/* finds or adds the origin called name, called with pool_mutex held */
+static origin_t *find_origin(char *name, bool create)
+{
+    unsigned long b = hash_key(name) % UPSTREAM_BUCKETS;
+    origin_t *o;
+
+    for(o = buckets[b]; o != NULL; o = o->next)
+        if(!strcmp(o->name, name))
+            return o;
+    if(!create || (o = calloc(1, sizeof(origin_t))) == NULL)
+        return NULL;
+    strcpy(o->name, name);
+    o->next = buckets[b];
+    buckets[b] = o;
+    return o;
+}
+
+/* takes conn out of the pool of o, called with pool_mutex held */
+static void unpool(origin_t *o, upconn_t *conn)
+{
+    if(conn->prev != NULL)
+        conn->prev->next = conn->next;
+    else
+        o->idle = conn->next;
+    if(conn->next != NULL)
+        conn->next->prev = conn->prev;
+    conn->next = conn->prev = NULL;
+    o->nidle--;
+    up_stats.idle--;
+    wheel_remove(&idle_wheel, &conn->timer);
+}
+
+/* closes a connection and frees it */
+static void conn_close(upconn_t *conn)
+{
+    close(conn->fd);
+    free(conn);
+}
+
+/*
+ * conn_alive() tells whether a pooled connection can carry a request:
+ * within its limits, and the server has neither closed it nor sent
+ * anything unasked
+ */
+static bool conn_alive(upconn_t *conn, time_t now)
+{
+    struct pollfd pfd;
+
+    if(now - conn->idle_since > config.upstream_idle_timeout ||
+       now - conn->created > config.upstream_max_lifetime)
+        return false;
+    pfd.fd = conn->fd;
+    pfd.events = POLLIN;
+    return poll(&pfd, 1, 0) == 0;
+}
+
+/* milliseconds on the monotonic clock */
+static long now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+/*
+ * interleave() orders the addresses for racing: alternating address
+ * families, starting with the family the resolver listed first, so a
+ * broken IPv6 path costs one attempt rather than all of them
+ */
+static void interleave(dnsaddr_t *addrs, int n, dnsaddr_t **order)
+{
+    int first = addrs[0].family;
+    int k = 0, s = 0, o = 0;
+
+    while(k < n)
+    {
+        while(s < n && addrs[s].family != first)
+            s++;
+        if(s < n)
+            order[k++] = &addrs[s++];
+        while(o < n && addrs[o].family == first)
+            o++;
+        if(o < n)
+            order[k++] = &addrs[o++];
+    }
+}
+
+/*
+ * start_connect() starts a non-blocking connect to addr. returns the
+ * socket, with *done set if it connected at once, or -1 if it failed
+ */
+static int start_connect(dnsaddr_t *addr, bool *done)
+{
+    int fd;
+
+    *done = false;
+    if((fd = socket(addr->family, addr->socktype, addr->protocol)) < 0)
+        return -1;
+    if(fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    if(connect(fd, (struct sockaddr *)&addr->addr, addr->addrlen) == 0)
+        *done = true;
+    else if(errno != EINPROGRESS)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * upstream_connect() connects to host:port, racing the addresses the DNS
+ * cache has for it. The first attempt starts at once and another one
+ * every upstream_race_delay ms while none has connected, or as soon as
+ * an attempt fails. An attempt is given up after upstream_attempt_timeout
+ * ms and the whole connect after upstream_connect_timeout ms. The first
+ * socket to connect is returned in blocking mode and the others are
+ * closed. returns -1 if none connected.
+ */
+int upstream_connect(char *host, char *port)
+{
+    dnsaddr_t *addrs, **order = NULL;
+    struct pollfd *pfd = NULL;
+    long *started = NULL;
+    long now, deadline, next_start, wait;
+    int fd = -1, n, i, next = 0, pending = 0, err;
+    socklen_t len;
+    bool done;
+
+    if((n = dns_resolve(host, port, &addrs)) <= 0)
+        return -1;
+    if((order = malloc(n * sizeof(dnsaddr_t *))) == NULL ||
+       (pfd = malloc(n * sizeof(struct pollfd))) == NULL ||
+       (started = malloc(n * sizeof(long))) == NULL)
+        goto out;
+    interleave(addrs, n, order);
+
+    now = now_ms();
+    deadline = now + config.upstream_connect_timeout;
+    next_start = now;
+    while(1)
+    {
+        now = now_ms();
+        if(next < n && (pending == 0 || now >= next_start))
+        {
+            i = next++;
+            if(i > 0)
+                __sync_fetch_and_add(&up_stats.raced, 1);
+            started[i] = now;
+            next_start = now + config.upstream_race_delay;
+            pfd[i].events = POLLOUT;
+            pfd[i].revents = 0;
+            if((pfd[i].fd = start_connect(order[i], &done)) < 0)
+                continue;
+            if(done)
+            {
+                fd = pfd[i].fd;
+                pfd[i].fd = -1;
+                break;
+            }
+            pending++;
+            continue;
+        }
+        if(pending == 0)
+            break;
+        if(now >= deadline)
+        {
+            dbg_printf("upstream: connect to %s:%s timed out\n", host, port);
+            __sync_fetch_and_add(&up_stats.timeouts, 1);
+            break;
+        }
+
+        // sleep until something connects or fails, the next attempt is
+        // due, or an attempt runs out of time
+        wait = deadline - now;
+        if(next < n && next_start - now < wait)
+            wait = next_start - now;
+        for(i = 0; i < next; i++)
+            if(pfd[i].fd >= 0 &&
+               started[i] + config.upstream_attempt_timeout - now < wait)
+                wait = started[i] + config.upstream_attempt_timeout - now;
+        if(poll(pfd, next, wait < 0 ? 0 : wait) < 0 && errno != EINTR)
+            break;
+
+        now = now_ms();
+        for(i = 0; i < next; i++)
+        {
+            if(pfd[i].fd < 0)
+                continue;
+            if(pfd[i].revents != 0)
+            {
+                len = sizeof(err);
+                if(getsockopt(pfd[i].fd, SOL_SOCKET, SO_ERROR, &err,
+                              &len) == 0 && err == 0)
+                {
+                    fd = pfd[i].fd;
+                    pfd[i].fd = -1;
+                    break;
+                }
+            }
+            else if(now - started[i] < config.upstream_attempt_timeout)
+                continue;
+            // refused, unreachable or too slow: try the next one now
+            close(pfd[i].fd);
+            pfd[i].fd = -1;
+            pending--;
+            next_start = now;
+        }
+        if(fd >= 0)
+            break;
+    }
+
+    for(i = 0; i < next; i++)
+        if(pfd[i].fd >= 0)
+            close(pfd[i].fd);
+    if(fd >= 0)
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+out:
+    free(started);
+    free(pfd);
+    free(order);
+    free(addrs);
+    return fd;
+}
+
+/*
+ * upstream_acquire() returns a connection to host:port, from the pool
+ * unless fresh is set. returns NULL if no connection could be opened
+ */
+upconn_t *upstream_acquire(char *host, char *port, bool fresh)
+{
+    char name[MAXLINE];
+    time_t now = time(NULL);
+    upconn_t *conn;
+    origin_t *o;
+    int fd;
+
+    pthread_once(&pool_once, pool_init);
+    snprintf(name, MAXLINE, "%s:%s", host, port);
+
+    while(!fresh)
+    {
+        P(&pool_mutex);
+        if((o = find_origin(name, false)) == NULL || o->idle == NULL)
+        {
+            V(&pool_mutex);
+            break;
+        }
+        conn = o->idle;
+        unpool(o, conn);
+        V(&pool_mutex);
+
+        if(conn_alive(conn, now))
+        {
+            dbg_printf("upstream: reusing connection to %s\n", name);
+            conn->reused = true;
+            __sync_fetch_and_add(&up_stats.reused, 1);
+            return conn;
+        }
+        conn_close(conn);
+    }
+
+    if((fd = upstream_connect(host, port)) < 0)
+        return NULL;
+    if((conn = malloc(sizeof(upconn_t))) == NULL)
+    {
+        close(fd);
+        return NULL;
+    }
+    conn->fd = fd;
+    rio_readinitb(&conn->rio, fd);
+    conn->created = now;
+    conn->reused = false;
+    strcpy(conn->origin, name);
+    conn->next = conn->prev = NULL;
+    wheel_timer_init(&conn->timer, conn);
+    __sync_fetch_and_add(&up_stats.connects, 1);
+    return conn;
+}
+
+/*
+ * upstream_release() gives conn back to its pool if reusable is set and
+ * the pool limits allow, and closes it otherwise
+ */
+void upstream_release(upconn_t *conn, bool reusable)
+{
+    time_t now = time(NULL), expires;
+    origin_t *o;
+
+    // unread bytes mean the response was not framed the way we thought
+    if(!reusable || !config.upstream_keepalive || conn->rio.rio_cnt > 0 ||
+       now - conn->created > config.upstream_max_lifetime)
+    {
+        conn_close(conn);
+        return;
+    }
+
+    P(&pool_mutex);
+    if((o = find_origin(conn->origin, true)) == NULL ||
+       o->nidle >= config.upstream_max_idle)
+    {
+        V(&pool_mutex);
+        conn_close(conn);
+        return;
+    }
+    conn->idle_since = now;
+    conn->prev = NULL;
+    conn->next = o->idle;
+    if(o->idle != NULL)
+        o->idle->prev = conn;
+    o->idle = conn;
+    o->nidle++;
+    up_stats.idle++;
+    // filed for the first second conn_alive() would turn it down
+    expires = now + config.upstream_idle_timeout;
+    if(expires > conn->created + config.upstream_max_lifetime)
+        expires = conn->created + config.upstream_max_lifetime;
+    wheel_add(&idle_wheel, &conn->timer, expires + 1);
+    V(&pool_mutex);
+}
+
+/*
+ * upstream_sweep() closes the pooled connections that have idled too
+ * long or outlived their lifetime, at most batch per hold of the pool
+ * lock. returns how many were closed
+ */
+size_t upstream_sweep(int batch)
+{
+    void *fired[SWEEP_BATCH_MAX];
+    upconn_t *conn;
+    origin_t *o;
+    time_t now = time(NULL);
+    size_t total = 0;
+    int i, n;
+
+    if(batch <= 0)
+        return 0;
+    if(batch > SWEEP_BATCH_MAX)
+        batch = SWEEP_BATCH_MAX;
+    pthread_once(&pool_once, pool_init);
+    do
+    {
+        P(&pool_mutex);
+        n = wheel_expire(&idle_wheel, now, fired, batch);
+        for(i = 0; i < n; i++)
+        {
+            conn = (upconn_t *)fired[i];
+            if((o = find_origin(conn->origin, false)) != NULL)
+                unpool(o, conn);
+        }
+        up_stats.swept += n;
+        V(&pool_mutex);
+        // the sockets are closed outside the lock
+        for(i = 0; i < n; i++)
+            conn_close((upconn_t *)fired[i]);
+        total += n;
+    }while(n == batch);
+    return total;
+}
+
+/* upstream_count_retry() counts a request retried on a new connection */
+void upstream_count_retry(void)
+{
+    __sync_fetch_and_add(&up_stats.retries, 1);
+}
+
+/* upstream_get_stats() fills in the pool counters */
+void upstream_get_stats(upstream_stats_t *stats)
+{
+    pthread_once(&pool_once, pool_init);
+    P(&pool_mutex);
+    *stats = up_stats;
+    V(&pool_mutex);
+}
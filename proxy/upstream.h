@@ -0,0 +1,102 @@
+/* Upstream connection pool header file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+
+/*
+ * Pools of idle keep-alive connections to the origin servers, one per
+ * host:port. A fetch takes a connection from the pool of its origin, or
+ * opens a new one, and gives it back once the response has been read
+ * to its end. Idle connections are reused most recently used first.
+ *
+ *   bucket -> origin "example.com:80" -> conn -> conn -> conn
+ *          -> origin "cdn.example:8080" -> conn
+ *
+ * A connection is not pooled when the server asked to close it, when
+ * its response was not read completely, when the pool of its origin
+ * holds upstream_max_idle connections already, or when it is older
+ * than upstream_max_lifetime. Pooled connections idle for longer than
+ * upstream_idle_timeout, or that the server closed meanwhile, are
+ * closed instead of being reused. Every pooled connection is filed in
+ * a timer wheel (wheel.c) by the second it runs out of idle time or
+ * lifetime, and upstream_sweep() closes those whose time has come, so
+ * an origin that is not asked again does not keep its sockets open.
+ *
+ * New connections race the addresses of the origin, alternating IPv6
+ * and IPv4, with non-blocking connects (happy eyeballs). A blackholed
+ * address costs at most upstream_attempt_timeout ms, and no connect
+ * takes longer than upstream_connect_timeout ms.
+ */
+
+#ifndef __UPSTREAM_H__
+#define __UPSTREAM_H__
+
+#include "csapp.h"
+#include "wheel.h"
+
+#define UPSTREAM_BUCKETS 256
+#define UPSTREAM_MAX_IDLE 8         /* default idle connections per origin */
+#define UPSTREAM_IDLE_TIMEOUT 30    /* default seconds a connection idles */
+#define UPSTREAM_MAX_LIFETIME 300   /* default seconds a connection is used */
+#define UPSTREAM_CONNECT_TIMEOUT 5000  /* default ms for one connect */
+#define UPSTREAM_ATTEMPT_TIMEOUT 2000  /* default ms for one address */
+#define UPSTREAM_RACE_DELAY 250        /* default ms before the next address */
+
+typedef struct upconn upconn_t;
+
+typedef struct upconn
+{
+    int fd;
+    rio_t rio;              // buffered reader over fd
+    time_t created;
+    time_t idle_since;
+    bool reused;            // taken from the pool, may have gone stale
+    char origin[MAXLINE];   // "host:port"
+    wheel_timer_t timer;    // filed while the connection is pooled
+    upconn_t *next;
+    upconn_t *prev;
+}upconn_t;
+
+typedef struct upstream_stats
+{
+    size_t connects;         // connections opened
+    size_t reused;           // requests sent on a pooled connection
+    size_t retries;          // requests retried after a stale connection
+    size_t idle;             // connections in the pools now
+    size_t raced;            // extra addresses tried while connecting
+    size_t timeouts;         // connects given up at their deadline
+    size_t swept;            // idle connections closed by the sweeper
+}upstream_stats_t;
+
+/*
+ * upstream_connect() opens a new connection to host:port, racing its
+ * addresses within the connect deadlines. returns the socket or -1
+ */
+int upstream_connect(char *host, char *port);
+
+/*
+ * upstream_acquire() returns a connection to host:port, from the pool
+ * unless fresh is set. returns NULL if no connection could be opened
+ */
+upconn_t *upstream_acquire(char *host, char *port, bool fresh);
+
+/*
+ * upstream_release() gives conn back to its pool if reusable is set and
+ * the pool limits allow, and closes it otherwise
+ */
+void upstream_release(upconn_t *conn, bool reusable);
+
+/*
+ * upstream_sweep() closes the pooled connections that have idled too
+ * long or outlived their lifetime, at most batch per hold of the pool
+ * lock. returns how many were closed
+ */
+size_t upstream_sweep(int batch);
+
+/* upstream_count_retry() counts a request retried on a new connection */
+void upstream_count_retry(void);
+
+/* upstream_get_stats() fills in the pool counters */
+void upstream_get_stats(upstream_stats_t *stats);
+
+#endif /* __UPSTREAM_H__ */
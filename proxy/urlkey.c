@@ -0,0 +1,215 @@
+/* Cache key file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+#include "csapp.h"
+#include "config.h"
+#include "urlkey.h"
+
+//#define DEBUG // uncomment this line to enable debugging
+
+#ifdef DEBUG
+/* When debugging is enabled, these form aliases to useful functions */
+#define dbg_printf(...) printf(__VA_ARGS__)
+#else
+/* When debugging is disabled, no code gets generated for these */
+#define dbg_printf(...)
+#endif
+
+static urlkey_stats_t key_stats;
+
+/*
+ * appends c to the key being built, whose last byte is at limit.
+ * returns false once it has overflowed
+ */
+static bool put(char **out, char *limit, int c)
+{
+    if(*out < limit)
+        **out = c;
+    return ++*out <= limit;
+}
+
+static int hexval(int c)
+{
+    if(isdigit(c))
+        return c - '0';
+    c = toupper(c);
+    return c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+}
+
+static bool unreserved(int c)
+{
+    return isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~';
+}
+
+/*
+ * appends src up to end, decoding the escapes of unreserved characters
+ * and uppercasing the others. returns false if the key is full
+ */
+static bool put_decoded(char **out, char *limit, char *src, char *end)
+{
+    int hi, lo;
+
+    for(; src < end; src++)
+    {
+        if(*src == '%' && end - src > 2 &&
+           (hi = hexval((unsigned char)src[1])) >= 0 &&
+           (lo = hexval((unsigned char)src[2])) >= 0)
+        {
+            if(unreserved(hi * 16 + lo))
+            {
+                if(!put(out, limit, hi * 16 + lo))
+                    return false;
+            }
+            else if(!put(out, limit, '%') ||
+                    !put(out, limit, toupper((unsigned char)src[1])) ||
+                    !put(out, limit, toupper((unsigned char)src[2])))
+                return false;
+            src += 2;
+        }
+        else if(!put(out, limit, *src))
+            return false;
+    }
+    return true;
+}
+
+/* whether the query parameter param is named in cache_key_strip */
+static bool stripped(char *param)
+{
+    char list[MAXLINE], *save, *name;
+    size_t n = strcspn(param, "="), len;
+
+    strcpy(list, config.cache_key_strip);
+    for(name = strtok_r(list, " ,\t", &save); name != NULL;
+        name = strtok_r(NULL, " ,\t", &save))
+    {
+        len = strlen(name);
+        if(name[len - 1] == '*' ? n >= len - 1 &&
+                                  !strncmp(param, name, len - 1) :
+                                  n == len && !strncmp(param, name, n))
+            return true;
+    }
+    return false;
+}
+
+static int param_cmp(const void *a, const void *b)
+{
+    return strcmp(*(char **)a, *(char **)b);
+}
+
+/* whether port, of length n, is the default one of scheme */
+static bool default_port(char *scheme, char *port, size_t n)
+{
+    return (!strcmp(scheme, "http") && n == 2 && !strncmp(port, "80", 2)) ||
+           (!strcmp(scheme, "https") && n == 3 && !strncmp(port, "443", 3));
+}
+
+/*
+ * urlkey_make() writes the cache key of uri into key, of size len.
+ * A URI that cannot be normalized is its own key
+ */
+void urlkey_make(char *uri, char *key, size_t len)
+{
+    char scheme[16], query[MAXLINE], *params[URLKEY_MAX_PARAMS];
+    char *out = key, *limit = key + len - 1, *qout = query;
+    char *p, *auth, *end, *host_end, *at, *path_end, *q;
+    int n = 0, i;
+
+    __sync_fetch_and_add(&key_stats.keys, 1);
+    if(!config.cache_key_normalize || (p = strstr(uri, "://")) == NULL ||
+       p == uri || p - uri >= (long)sizeof(scheme))
+        goto raw;
+
+    // scheme and host are case insensitive
+    for(i = 0; uri + i < p; i++)
+    {
+        if(!isalpha((unsigned char)uri[i]))
+            goto raw;
+        scheme[i] = tolower((unsigned char)uri[i]);
+        put(&out, limit, scheme[i]);
+    }
+    scheme[i] = '\0';
+    put(&out, limit, ':');
+    put(&out, limit, '/');
+    put(&out, limit, '/');
+
+    auth = p + 3;
+    end = auth + strcspn(auth, "/?#");
+    if((at = memchr(auth, '@', end - auth)) != NULL)
+    {
+        for(; auth <= at; auth++)
+            put(&out, limit, *auth);
+    }
+    if(*auth == '[')
+    {
+        if((host_end = memchr(auth, ']', end - auth)) == NULL)
+            goto raw;
+        host_end++;
+    }
+    else if((host_end = memchr(auth, ':', end - auth)) == NULL)
+        host_end = end;
+    if(host_end == auth)
+        goto raw;
+    for(; auth < host_end; auth++)
+        put(&out, limit, tolower((unsigned char)*auth));
+    if(host_end < end && *host_end == ':' && end - host_end > 1 &&
+       !default_port(scheme, host_end + 1, end - host_end - 1))
+    {
+        for(; host_end < end; host_end++)
+            put(&out, limit, *host_end);
+    }
+
+    // the path, "/" if there is none
+    path_end = end + strcspn(end, "?#");
+    if(path_end == end)
+        put(&out, limit, '/');
+    else if(!put_decoded(&out, limit, end, path_end))
+        goto raw;
+
+    // the query parameters in order, without the ones stripped
+    if(*path_end == '?')
+    {
+        q = path_end + 1;
+        if(!put_decoded(&qout, query + MAXLINE - 1, q, 
+                        q + strcspn(q, "#")))
+            goto raw;
+        *qout = '\0';
+        for(q = strtok_r(query, "&", &p); q != NULL;
+            q = strtok_r(NULL, "&", &p))
+        {
+            if(config.cache_key_strip[0] != '\0' && stripped(q))
+                __sync_fetch_and_add(&key_stats.stripped, 1);
+            else if(n == URLKEY_MAX_PARAMS)
+                goto raw;
+            else
+                params[n++] = q;
+        }
+        qsort(params, n, sizeof(char *), param_cmp);
+        for(i = 0; i < n; i++)
+        {
+            put(&out, limit, i == 0 ? '?' : '&');
+            for(q = params[i]; *q; q++)
+                put(&out, limit, *q);
+        }
+    }
+    if(out > limit)
+        goto raw;
+    *out = '\0';
+
+    if(strcmp(key, uri))
+    {
+        __sync_fetch_and_add(&key_stats.rewritten, 1);
+        dbg_printf("key: %s -> %s\n", uri, key);
+    }
+    return;
+
+raw:
+    strncpy(key, uri, len - 1);
+    key[len - 1] = '\0';
+}
+
+/* urlkey_get_stats() fills in the counters */
+void urlkey_get_stats(urlkey_stats_t *stats)
+{
+    *stats = key_stats;
+}
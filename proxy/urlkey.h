@@ -0,0 +1,49 @@
+/* Cache key header file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+
+/*
+ * Normalization of request URIs into cache keys, so that spellings of
+ * one resource share one cache line:
+ *
+ *   http://WWW.Example.com:80/a/%7Ebob?utm_source=x&c=2&b=1#top
+ *   -> http://www.example.com/a/~bob?b=1&c=2
+ *
+ * The scheme and host are lowercased, the default port of the scheme
+ * is dropped, and so is the fragment. In the path and the query
+ * percent-encoded unreserved characters (letters, digits, "-._~") are
+ * decoded and the hex digits of the other escapes uppercased. Query
+ * parameters are sorted, and those named in cache_key_strip are left
+ * out; a name ending in '*' matches every name starting with the rest:
+ *
+ *   cache_key_strip = utm_* fbclid gclid
+ *
+ * The key is only used to look up and store responses, the origin is
+ * sent the URI the client asked for.
+ */
+
+#ifndef __URLKEY_H__
+#define __URLKEY_H__
+
+#include "csapp.h"
+
+#define URLKEY_MAX_PARAMS 128       /* query parameters that are sorted */
+
+typedef struct urlkey_stats
+{
+    size_t keys;             // keys made
+    size_t rewritten;        // keys that differ from their URI
+    size_t stripped;         // query parameters left out
+}urlkey_stats_t;
+
+/*
+ * urlkey_make() writes the cache key of uri into key, of size len.
+ * A URI that cannot be normalized is its own key
+ */
+void urlkey_make(char *uri, char *key, size_t len);
+
+/* urlkey_get_stats() fills in the counters */
+void urlkey_get_stats(urlkey_stats_t *stats);
+
+#endif /* __URLKEY_H__ */
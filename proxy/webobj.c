@@ -0,0 +1,168 @@
+/* Web object file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+#include "csapp.h"
+#include "webobj.h"
+#include "slab.h"
+#include "memfd.h"
+
+/* creates an empty object holding one reference */
+webobj_t *webobj_create(void)
+{
+    webobj_t *obj = slab_alloc(sizeof(webobj_t));
+
+    if(obj == NULL)
+        return NULL;
+    obj->head = NULL;
+    obj->tail = NULL;
+    obj->size = 0;
+    obj->refcnt = 1;
+    obj->encoding = WEBOBJ_IDENTITY;
+    obj->raw_size = 0;
+    obj->digested = false;
+    return obj;
+}
+
+/* takes another reference to obj */
+void webobj_get(webobj_t *obj)
+{
+    __sync_add_and_fetch(&obj->refcnt, 1);
+}
+
+/* drops a reference, the last one frees the segments */
+void webobj_put(webobj_t *obj)
+{
+    segment_t *seg, *next;
+
+    if(obj == NULL || __sync_sub_and_fetch(&obj->refcnt, 1) > 0)
+        return;
+
+    for(seg = obj->head; seg != NULL; seg = next)
+    {
+        next = seg->next;
+        slab_free(seg, sizeof(segment_t));
+    }
+    slab_free(obj, sizeof(webobj_t));
+}
+
+/*
+ * webobj_reserve() returns the free space at the end of the tail
+ * segment, adding a new segment when the tail is full, and stores its
+ * length in avail. Returns NULL if no segment could be allocated.
+ */
+char *webobj_reserve(webobj_t *obj, size_t *avail)
+{
+    segment_t *seg;
+
+    if(obj->tail == NULL || obj->tail->len == SEGMENT_DATA_SIZE)
+    {
+        if((seg = slab_alloc(sizeof(segment_t))) == NULL)
+            return NULL;
+        seg->next = NULL;
+        seg->len = 0;
+        if(obj->tail == NULL)
+            obj->head = seg;
+        else
+            obj->tail->next = seg;
+        obj->tail = seg;
+    }
+
+    *avail = SEGMENT_DATA_SIZE - obj->tail->len;
+    return obj->tail->data + obj->tail->len;
+}
+
+/* webobj_commit() accounts n bytes written into the reserved space */
+void webobj_commit(webobj_t *obj, size_t n)
+{
+    obj->tail->len += n;
+    obj->size += n;
+}
+
+/* webobj_append() copies n bytes to the end of the object */
+bool webobj_append(webobj_t *obj, char *buf, size_t n)
+{
+    size_t avail, len;
+    char *dst;
+
+    while(n > 0)
+    {
+        if((dst = webobj_reserve(obj, &avail)) == NULL)
+            return false;
+        len = n < avail ? n : avail;
+        memcpy(dst, buf, len);
+        webobj_commit(obj, len);
+        buf += len;
+        n -= len;
+    }
+    return true;
+}
+
+/*
+ * webobj_write() writes the whole object to fd. Segments in the memory
+ * file are sent from it with sendfile(), the others are written; it
+ * then waits for the socket to drain, the caller may drop obj after.
+ * returns the bytes written or -1 on a write error
+ */
+ssize_t webobj_write(int fd, webobj_t *obj)
+{
+    segment_t *seg;
+    size_t off;
+    ssize_t n, written = obj->size;
+    bool sent_file = false;
+
+    for(seg = obj->head; seg != NULL && written >= 0; seg = seg->next)
+    {
+        if(!memfd_contains(seg->data))
+        {
+            if(rio_writen(fd, seg->data, seg->len) < 0)
+                written = -1;
+            continue;
+        }
+        for(off = 0; off < seg->len; off += n)
+        {
+            if((n = memfd_send(fd, seg->data + off, seg->len - off)) <= 0)
+            {
+                if(n < 0 && errno == EINTR)
+                {
+                    n = 0;
+                    continue;
+                }
+                written = -1;
+                break;
+            }
+            sent_file = true;
+        }
+    }
+    // the socket still refers to the pages of what it has not sent
+    if(sent_file)
+        memfd_drain(fd);
+    return written;
+}
+
+/* webhdr_create() copies a header block, holding one reference */
+webhdr_t *webhdr_create(char *buf, size_t len)
+{
+    webhdr_t *hdr = slab_alloc(sizeof(webhdr_t) + len);
+
+    if(hdr == NULL)
+        return NULL;
+    hdr->refcnt = 1;
+    hdr->len = len;
+    memcpy(hdr->data, buf, len);
+    return hdr;
+}
+
+/* takes another reference to hdr */
+void webhdr_get(webhdr_t *hdr)
+{
+    __sync_add_and_fetch(&hdr->refcnt, 1);
+}
+
+/* drops a reference, the last one frees the block */
+void webhdr_put(webhdr_t *hdr)
+{
+    if(hdr == NULL || __sync_sub_and_fetch(&hdr->refcnt, 1) > 0)
+        return;
+    slab_free(hdr, sizeof(webhdr_t) + hdr->len);
+}
@@ -0,0 +1,115 @@
+/* Web object header file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+
+/*
+ * A web object is the body of a cached response stored as a chain of
+ * fixed size segments. The proxy reads the server response straight
+ * into the tail segment and writes it to the client from there, so a
+ * response is never staged in a flat buffer and large objects need no
+ * contiguous allocation.
+ *
+ *  ________      _________     _________     ____________
+ * |        |    |         |   |         |   |            |
+ * | webobj |--->| segment |-->| segment |-->| segment    |
+ * |________|    |__full___|   |__full___|   |_partial____|
+ *
+ * Objects are reference counted: the cache holds one reference and
+ * every thread serving a hit holds another while it writes, so a hit
+ * is written to the client without holding the cache lock and an
+ * eviction never frees an object under a reader.
+ *
+ * The header block of a cached response (status line and headers) is
+ * kept apart from the body in a small reference counted webhdr, so a
+ * revalidation can swap the headers without touching the body.
+ *
+ * An object may hold its body compressed (compress.c), encoding then
+ * says how and raw_size gives the size of the body itself; the header
+ * block stays the one of the uncompressed response.
+ *
+ * Cache lines whose bodies hold the same bytes share one object, found
+ * by the digest of the body (dedup.c).
+ */
+
+#ifndef __WEBOBJ_H__
+#define __WEBOBJ_H__
+
+#include "csapp.h"
+
+/* Size of one storage segment including its header, one slab block */
+#define SEGMENT_SIZE (16*1024)
+#define SEGMENT_DATA_SIZE (SEGMENT_SIZE - sizeof(segment_t *) - sizeof(size_t))
+
+/* How the bytes of an object encode the body */
+#define WEBOBJ_IDENTITY 0
+#define WEBOBJ_GZIP 1
+
+typedef struct segment segment_t;
+typedef struct webobj webobj_t;
+typedef struct webhdr webhdr_t;
+
+typedef struct segment
+{
+    segment_t *next;
+    size_t len;                 // bytes used in data
+    char data[SEGMENT_DATA_SIZE];
+}segment_t;
+
+typedef struct webobj
+{
+    segment_t *head;
+    segment_t *tail;
+    size_t size;                // total bytes over all segments
+    int refcnt;
+    int encoding;               // WEBOBJ_IDENTITY or WEBOBJ_GZIP
+    size_t raw_size;            // bytes of the body once decoded
+    uint64_t digest[2];         // hash of the body (dedup.c), if digested
+    bool digested;
+}webobj_t;
+
+typedef struct webhdr
+{
+    int refcnt;
+    size_t len;                 // bytes in data
+    char data[];
+}webhdr_t;
+
+/* creates an empty object holding one reference */
+webobj_t *webobj_create(void);
+
+/* takes another reference to obj */
+void webobj_get(webobj_t *obj);
+
+/* drops a reference, the last one frees the segments */
+void webobj_put(webobj_t *obj);
+
+/*
+ * webobj_reserve() returns the free space at the end of the tail
+ * segment, adding a new segment when the tail is full, and stores its
+ * length in avail. Returns NULL if no segment could be allocated.
+ */
+char *webobj_reserve(webobj_t *obj, size_t *avail);
+
+/* webobj_commit() accounts n bytes written into the reserved space */
+void webobj_commit(webobj_t *obj, size_t n);
+
+/* webobj_append() copies n bytes to the end of the object */
+bool webobj_append(webobj_t *obj, char *buf, size_t n);
+
+/*
+ * webobj_write() writes the whole object to fd.
+ * returns the bytes written or -1 on a write error
+ */
+ssize_t webobj_write(int fd, webobj_t *obj);
+
+/* webhdr_create() copies a header block, holding one reference */
+webhdr_t *webhdr_create(char *buf, size_t len);
+
+/* takes another reference to hdr */
+void webhdr_get(webhdr_t *hdr);
+
+/* drops a reference, the last one frees the block */
+void webhdr_put(webhdr_t *hdr);
+
+#endif /* __WEBOBJ_H__ */
@@ -0,0 +1,153 @@
+/* Timer wheel file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+#include "csapp.h"
+#include "wheel.h"
+
+//#define DEBUG // uncomment this line to enable debugging
+
+#ifdef DEBUG
+/* When debugging is enabled, these form aliases to useful functions */
+#define dbg_printf(...) printf(__VA_ARGS__)
+#else
+/* When debugging is disabled, no code gets generated for these */
+#define dbg_printf(...)
+#endif
+
+/* seconds covered by the whole wheel */
+#define WHEEL_SPAN (1L << (WHEEL_BITS * WHEEL_LEVELS))
+
+/* wheel_init() sets up an empty wheel that fires from second now on */
+void wheel_init(wheel_t *wheel, long now)
+{
+    int level, slot;
+
+    wheel->now = now;
+    wheel->count = 0;
+    for(level = 0; level < WHEEL_LEVELS; level++)
+    {
+        for(slot = 0; slot < WHEEL_SLOTS; slot++)
+        {
+            wheel->slots[level][slot].next = &wheel->slots[level][slot];
+            wheel->slots[level][slot].prev = &wheel->slots[level][slot];
+        }
+    }
+}
+
+/* wheel_timer_init() sets up a timer that is not filed, for data */
+void wheel_timer_init(wheel_timer_t *timer, void *data)
+{
+    timer->next = timer->prev = NULL;
+    timer->when = 0;
+    timer->data = data;
+}
+
+static void unlink_timer(wheel_timer_t *timer)
+{
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = timer->prev = NULL;
+}
+
+/* links timer into the slot its second falls in, relative to now */
+static void file(wheel_t *wheel, wheel_timer_t *timer)
+{
+    wheel_timer_t *head;
+    long when = timer->when, delta;
+    int level;
+
+    if(when < wheel->now)
+        when = wheel->now;
+    // too far out: parked in the last slot of the top level
+    if((delta = when - wheel->now) >= WHEEL_SPAN)
+    {
+        when = wheel->now + WHEEL_SPAN - 1;
+        delta = WHEEL_SPAN - 1;
+    }
+    for(level = 0; level < WHEEL_LEVELS - 1 &&
+                   delta >= 1L << (WHEEL_BITS * (level + 1)); level++)
+        ;
+    head = &wheel->slots[level]
+                        [(when >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1)];
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+/*
+ * wheel_add() files timer to fire in second when, or in the next second
+ * the wheel fires if that has passed. A filed timer is moved
+ */
+void wheel_add(wheel_t *wheel, wheel_timer_t *timer, long when)
+{
+    if(timer->next != NULL)
+        unlink_timer(timer);
+    else
+        wheel->count++;
+    timer->when = when;
+    file(wheel, timer);
+}
+
+/* wheel_remove() takes timer out of the wheel if it is filed */
+void wheel_remove(wheel_t *wheel, wheel_timer_t *timer)
+{
+    if(timer->next == NULL)
+        return;
+    unlink_timer(timer);
+    wheel->count--;
+}
+
+/*
+ * cascade() spreads the slots of the upper levels that start at the
+ * new second over the levels below, once level 0 has come round
+ */
+static void cascade(wheel_t *wheel)
+{
+    wheel_timer_t *head, *timer;
+    int level;
+
+    for(level = 1; level < WHEEL_LEVELS; level++)
+    {
+        if(wheel->now & ((1L << (WHEEL_BITS * level)) - 1))
+            break;
+        head = &wheel->slots[level][(wheel->now >> (WHEEL_BITS * level)) &
+                                    (WHEEL_SLOTS - 1)];
+        while((timer = head->next) != head)
+        {
+            unlink_timer(timer);
+            file(wheel, timer);
+        }
+    }
+}
+
+/*
+ * wheel_expire() turns the wheel up to second now and takes out at most
+ * max timers that fired, storing their data in fired. returns how many;
+ * fewer than max means none are left before now
+ */
+int wheel_expire(wheel_t *wheel, long now, void **fired, int max)
+{
+    wheel_timer_t *head;
+    int n = 0;
+
+    // nothing to cascade in an empty wheel, it may jump ahead
+    if(wheel->count == 0 && wheel->now < now)
+        wheel->now = now;
+
+    while(n < max && wheel->now <= now)
+    {
+        head = &wheel->slots[0][wheel->now & (WHEEL_SLOTS - 1)];
+        if(head->next != head)
+        {
+            fired[n++] = head->next->data;
+            wheel_remove(wheel, head->next);
+            continue;
+        }
+        wheel->now++;
+        cascade(wheel);
+    }
+    dbg_printf("wheel: %d fired, %lu left\n", n, wheel->count);
+    return n;
+}
@@ -0,0 +1,76 @@
+/* Timer wheel header file
+ * Name: Raghav Sharma
+ * Andrew.ID = rvsharma
+ */
+
+/*
+ * Hierarchical timer wheel, indexing things by the second at which
+ * something has to be done about them: cache lines by when they may be
+ * reclaimed, pooled connections by when they have idled too long.
+ *
+ *   level 0: 64 slots of 1 s          (the next minute)
+ *   level 1: 64 slots of 64 s         (the next hour or so)
+ *   level 2: 64 slots of 4096 s       (the next 3 days)
+ *   level 3: 64 slots of 262144 s     (the next 194 days)
+ *
+ * A timer is filed in the lowest level whose range covers it, in the
+ * slot of its second; filing and removing are O(1). As the wheel turns,
+ * each slot of level 0 fires in its second, and whenever level 0 comes
+ * round the next slot of level 1 is spread over level 0, and so on up.
+ * Timers further out than the top level are parked in its last slot and
+ * filed again when it comes round.
+ *
+ * The timers are linked into the wheel, no memory is allocated. The
+ * wheel has no lock of its own, its owner locks it.
+ */
+
+#ifndef __WHEEL_H__
+#define __WHEEL_H__
+
+#include "csapp.h"
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)   /* slots per level */
+#define WHEEL_LEVELS 4
+#define SWEEP_BATCH 32              /* default things swept per lock hold */
+#define SWEEP_BATCH_MAX 256
+
+typedef struct wheel_timer wheel_timer_t;
+
+typedef struct wheel_timer
+{
+    wheel_timer_t *next, *prev;     // NULL while not filed
+    long when;                      // second the timer fires
+    void *data;                     // what it is the timer of
+}wheel_timer_t;
+
+typedef struct wheel
+{
+    long now;                       // next second to fire
+    size_t count;                   // timers filed
+    wheel_timer_t slots[WHEEL_LEVELS][WHEEL_SLOTS];  // list heads
+}wheel_t;
+
+/* wheel_init() sets up an empty wheel that fires from second now on */
+void wheel_init(wheel_t *wheel, long now);
+
+/* wheel_timer_init() sets up a timer that is not filed, for data */
+void wheel_timer_init(wheel_timer_t *timer, void *data);
+
+/*
+ * wheel_add() files timer to fire in second when, or in the next second
+ * the wheel fires if that has passed. A filed timer is moved
+ */
+void wheel_add(wheel_t *wheel, wheel_timer_t *timer, long when);
+
+/* wheel_remove() takes timer out of the wheel if it is filed */
+void wheel_remove(wheel_t *wheel, wheel_timer_t *timer);
+
+/*
+ * wheel_expire() turns the wheel up to second now and takes out at most
+ * max timers that fired, storing their data in fired. returns how many;
+ * fewer than max means none are left before now
+ */
+int wheel_expire(wheel_t *wheel, long now, void **fired, int max);
+
+#endif /* __WHEEL_H__ */